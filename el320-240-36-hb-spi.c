@@ -15,59 +15,9 @@
 #include <linux/module.h>
 #include <linux/spi/spi.h>
 
-#include <drm/tinydrm/tinydrm.h>
-#include <drm/tinydrm/tinydrm-helpers.h>
-
-/* will be added to helpers */
-#include <linux/dma-buf.h>
-#include <drm/drm_gem_cma_helper.h>
 #include <drm/drm_fb_cma_helper.h>
-static
-int tinydrm_rgb565_buf_copy(void *dst, struct drm_framebuffer *fb,
-			    struct drm_clip_rect *clip, bool swap)
-{
-	struct drm_gem_cma_object *cma_obj = drm_fb_cma_get_gem_obj(fb, 0);
-	struct dma_buf_attachment *import_attach = cma_obj->base.import_attach;
-	struct drm_format_name_buf format_name;
-	void *src = cma_obj->vaddr;
-	int ret = 0;
-
-	if (import_attach) {
-		ret = dma_buf_begin_cpu_access(import_attach->dmabuf,
-					       DMA_FROM_DEVICE);
-		if (ret)
-			return ret;
-	}
-
-	switch (fb->format->format) {
-	case DRM_FORMAT_RGB565:
-		if (swap)
-			tinydrm_swab16(dst, src, fb, clip);
-		else
-			tinydrm_memcpy(dst, src, fb, clip);
-		break;
-	case DRM_FORMAT_XRGB8888:
-		tinydrm_xrgb8888_to_rgb565(dst, src, fb, clip, swap);
-		break;
-	default:
-		dev_err_once(fb->dev->dev, "Format is not supported: %s\n",
-			     drm_get_format_name(fb->format->format,
-						 &format_name));
-		return -EINVAL;
-	}
-
-	if (import_attach)
-		ret = dma_buf_end_cpu_access(import_attach->dmabuf,
-					     DMA_FROM_DEVICE);
-	return ret;
-}
-
-
-
-
-
-
-
+#include <drm/tinydrm/tinydrm.h>
+#include <drm/tinydrm/tinydrm-helpers2.h>
 
 #define WHITE		0xff
 #define BLACK		0
@@ -232,6 +182,7 @@ struct el320_240_36_hb {
 	bool next_full;
 	bool blanked;
 	void *tx_buf;
+	struct tinydrm_fingerprint fingerprint;
 };
 
 static inline struct el320_240_36_hb *
@@ -265,6 +216,7 @@ static int el320_240_36_hb_fb_dirty(struct drm_framebuffer *fb,
 	if (priv->next_full) {
 		priv->next_full = false;
 		clips = NULL;
+		tinydrm_fingerprint_reset(&priv->fingerprint);
 	}
 
 //	tinydrm_merge_clips(&clip, clips, num_clips, flags,
@@ -276,6 +228,12 @@ static int el320_240_36_hb_fb_dirty(struct drm_framebuffer *fb,
 	clip.y1 = 0;
 	clip.y2 = fb->height;
 
+	/* The whole frame is sent, so that's the region to fingerprint */
+	if (tinydrm_fingerprint_unchanged(&priv->fingerprint, fb, &clip)) {
+		DRM_DEBUG("Skipping unchanged [FB:%d]\n", fb->base.id);
+		goto out_unlock;
+	}
+
 	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u\n",
 		  fb->base.id, clip.x1, clip.x2, clip.y1, clip.y2);
 
@@ -328,6 +286,9 @@ static int el320_240_36_hb_fb_dirty(struct drm_framebuffer *fb,
 	ret = spi_sync_transfer(priv->spi, tr_data, 2);
 
 out_unlock:
+	if (ret)
+		tinydrm_fingerprint_reset(&priv->fingerprint);
+
 	mutex_unlock(&tdev->dirty_lock);
 
 	if (ret)
@@ -427,11 +388,26 @@ static const struct drm_display_mode el320_240_36_hb_mode = {
 	TINYDRM_MODE(320, 240, 115, 86),
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int el320_240_36_hb_debugfs_init(struct drm_minor *minor)
+{
+	struct tinydrm_device *tdev = minor->dev->dev_private;
+	struct el320_240_36_hb *priv = priv_from_tinydrm(tdev);
+
+	return tinydrm_fingerprint_debugfs_init(&priv->fingerprint,
+						minor->debugfs_root,
+						&tdev->dirty_lock);
+}
+#else
+#define el320_240_36_hb_debugfs_init	NULL
+#endif
+
 static struct drm_driver el320_240_36_hb_driver = {
 	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_PRIME |
 				  DRIVER_ATOMIC,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
+	.debugfs_init		= el320_240_36_hb_debugfs_init,
 	.name			= "el320-240-36-hb-spi",
 	.desc			= "Benq EL320.240.36-HB SPI",
 	.date			= "20170221",
@@ -534,6 +510,7 @@ static struct spi_driver el320_240_36_hb_spi_driver = {
 		.name = "el320-240-36-hb",
 		.owner = THIS_MODULE,
 		.of_match_table = el320_240_36_hb_of_match,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.id_table = el320_240_36_hb_id,
 	.probe = el320_240_36_hb_probe,
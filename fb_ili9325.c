@@ -98,34 +98,39 @@ MODULE_PARM_DESC(vcm, "Set the internal VcomH voltage (ili9325)");
  * VCOMH - VCOML < 6.0   =>  4.79 < 6.0
  */
 
-static void tinydrm_ili9325_set_rotation(struct tinydrm_ili9325 *ili9325)
+static unsigned int tinydrm_ili9325_entry_mode(struct tinydrm_ili9325 *ili9325)
 {
 	struct device *dev = ili9325->tinydrm.drm->dev;
-	struct regmap *reg = ili9325->reg;
-	bool bgr;
+	unsigned int bgr;
 
+	/* Reset value */
 	if (no_rotation)
-		return;
+		return 0x0030;
 
-	bgr = device_property_read_bool(dev, "bgr");
+	bgr = device_property_read_bool(dev, "bgr") << 12;
 
-	switch (ili9325->rotation) {
 	/* AM: GRAM update direction */
-	case 0:
-		regmap_write(reg, 0x0003, 0x0030 | (bgr << 12));
-		break;
+	switch (ili9325->rotation) {
 	case 180:
-		regmap_write(reg, 0x0003, 0x0000 | (bgr << 12));
-		break;
+		return 0x0000 | bgr;
 	case 270:
-		regmap_write(reg, 0x0003, 0x0028 | (bgr << 12));
-		break;
+		return 0x0028 | bgr;
 	case 90:
-		regmap_write(reg, 0x0003, 0x0018 | (bgr << 12));
-		break;
+		return 0x0018 | bgr;
+	default:
+		return 0x0030 | bgr;
 	}
 }
 
+static void tinydrm_ili9325_set_rotation(struct tinydrm_ili9325 *ili9325)
+{
+	if (no_rotation)
+		return;
+
+	regmap_write(ili9325->reg, 0x0003,
+		     tinydrm_ili9325_entry_mode(ili9325));
+}
+
 /*
  * Gamma string format:
  *  VRP0 VRP1 RP0 RP1 KP0 KP1 KP2 KP3 KP4 KP5
@@ -161,14 +166,10 @@ static void tinydrm_ili9325_set_gamma(struct tinydrm_ili9325 *ili9325,
 	regmap_write(reg, 0x003D, vrn[1] << 8 | vrn[0]);
 }
 
-static void fb_ili9325_pipe_enable(struct drm_simple_display_pipe *pipe,
-				   struct drm_crtc_state *crtc_state)
+static int fb_ili9325_hw_init(struct tinydrm_ili9325 *ili9325)
 {
-	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
-	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
-	struct drm_framebuffer *fb = pipe->plane.fb;
+	struct device *dev = ili9325->tinydrm.drm->dev;
 	struct regmap *reg = ili9325->reg;
-	struct device *dev = tdev->drm->dev;
 	u16 gamma_curves[2 * 10];
 	unsigned int devcode;
 	int ret;
@@ -177,7 +178,7 @@ static void fb_ili9325_pipe_enable(struct drm_simple_display_pipe *pipe,
 				      FB_ILI9325_DEFAULT_GAMMA, 2, 10);
 	if (ret) {
 		dev_err(dev, "Failed to get gamma\n");
-		return;
+		return ret;
 	}
 
 	tinydrm_ili9325_reset(ili9325);
@@ -190,7 +191,7 @@ static void fb_ili9325_pipe_enable(struct drm_simple_display_pipe *pipe,
 		goto set_rotation;
 	} else if (ret != -ENOENT) {
 		dev_err(dev, "tinydrm_fbtft_init failed\n");
-		return;
+		return ret;
 	}
 
 	bt &= 0x07;
@@ -204,7 +205,7 @@ static void fb_ili9325_pipe_enable(struct drm_simple_display_pipe *pipe,
 	ret = regmap_write(reg, 0x00E3, 0x3008); /* Set internal timing */
 	if (ret) {
 		dev_err(dev, "Failed to write register\n");
-		return;
+		return ret;
 	}
 
 	regmap_write(reg, 0x00E7, 0x0012); /* Set internal timing */
@@ -264,35 +265,81 @@ set_rotation:
 	tinydrm_ili9325_set_rotation(ili9325);
 	tinydrm_ili9325_set_gamma(ili9325, gamma_curves);
 
-	ili9325->enabled = true;
-	fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	ili9325->initialized = true;
+
+	/* The panel content was lost on reset */
+	tinydrm_fingerprint_reset(&ili9325->fingerprint);
+
+	return 0;
+}
+
+/*
+ * With a 'splash' or 'adopt-running' property the controller is set up in
+ * probe, so the first enable finds it running with an image up.
+ */
+static void fb_ili9325_enable_common(struct drm_simple_display_pipe *pipe,
+				     int (*hw_init)(struct tinydrm_ili9325 *))
+{
+	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
+	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
+	struct drm_framebuffer *fb = pipe->plane.fb;
+	bool splash = ili9325->next_full;
+	int ret = 0;
+
+	drm_crtc_vblank_on(&pipe->crtc);
+
+	/* The I80 throughput benchmark runs under dirty_lock while disabled */
+	mutex_lock(&tdev->dirty_lock);
+	/*
+	 * Leave the image up until there's damage to flush. Blank/unblank only
+	 * needs the display turned back on.
+	 */
+	if (!splash && !tinydrm_ili9325_display_on(ili9325))
+		ret = hw_init(ili9325);
+	if (!ret)
+		ili9325->enabled = true;
+	mutex_unlock(&tdev->dirty_lock);
+	if (ret)
+		return;
+
+	if (!splash)
+		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
 
 	tinydrm_enable_backlight(ili9325->backlight);
 }
 
+static void fb_ili9325_pipe_enable(struct drm_simple_display_pipe *pipe,
+				   struct drm_crtc_state *crtc_state)
+{
+	fb_ili9325_enable_common(pipe, fb_ili9325_hw_init);
+}
+
 static void fb_ili9325_pipe_disable(struct drm_simple_display_pipe *pipe)
 {
 	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
 	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
 
+	drm_crtc_vblank_off(&pipe->crtc);
+
+	mutex_lock(&tdev->dirty_lock);
 	ili9325->enabled = false;
+	/* The splash goes dark too, enable does a full flush */
+	ili9325->next_full = false;
+	tinydrm_ili9325_display_off(ili9325);
+	mutex_unlock(&tdev->dirty_lock);
 }
 
 static const struct drm_simple_display_pipe_funcs fb_ili9325_funcs = {
 	.enable =  fb_ili9325_pipe_enable,
 	.disable = fb_ili9325_pipe_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_ili9325_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
-static void fb_ili9320_pipe_enable(struct drm_simple_display_pipe *pipe,
-				   struct drm_crtc_state *crtc_state)
+static int fb_ili9320_hw_init(struct tinydrm_ili9325 *ili9325)
 {
-	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
-	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
-	struct drm_framebuffer *fb = pipe->plane.fb;
+	struct device *dev = ili9325->tinydrm.drm->dev;
 	struct regmap *reg = ili9325->reg;
-	struct device *dev = tdev->drm->dev;
 	u16 gamma_curves[2 * 10];
 	unsigned int devcode;
 	int ret;
@@ -301,7 +348,7 @@ static void fb_ili9320_pipe_enable(struct drm_simple_display_pipe *pipe,
 				      FB_ILI9320_DEFAULT_GAMMA, 2, 10);
 	if (ret) {
 		dev_err(dev, "Failed to get gamma\n");
-		return;
+		return ret;
 	}
 
 	tinydrm_ili9325_reset(ili9325);
@@ -314,7 +361,7 @@ static void fb_ili9320_pipe_enable(struct drm_simple_display_pipe *pipe,
 		goto set_rotation;
 	} else if (ret != -ENOENT) {
 		dev_err(dev, "tinydrm_fbtft_init failed\n");
-		return;
+		return ret;
 	}
 
 	/* Initialization sequence from ILI9320 Application Notes */
@@ -366,25 +413,25 @@ static void fb_ili9320_pipe_enable(struct drm_simple_display_pipe *pipe,
 	regmap_write(reg, 0x0013, 0x0000);
 
 	/* Dis-charge capacitor power voltage */
-	mdelay(200);
+	msleep(200);
 
 	/* SAP, BT[3:0], AP, DSTB, SLP, STB */
 	regmap_write(reg, 0x0010, 0x17B0);
 
 	/* R11h=0x0031 at VCI=3.3V DC1[2:0], DC0[2:0], VC[2:0] */
 	regmap_write(reg, 0x0011, 0x0031);
-	mdelay(50);
+	msleep(50);
 
 	/* R12h=0x0138 at VCI=3.3V VREG1OUT voltage */
 	regmap_write(reg, 0x0012, 0x0138);
-	mdelay(50);
+	msleep(50);
 
 	/* R13h=0x1800 at VCI=3.3V VDV[4:0] for VCOM amplitude */
 	regmap_write(reg, 0x0013, 0x1800);
 
 	/* R29h=0x0008 at VCI=3.3V VCM[4:0] for VCOMH */
 	regmap_write(reg, 0x0029, 0x0008);
-	mdelay(50);
+	msleep(50);
 
 	/* GRAM horizontal Address */
 	regmap_write(reg, 0x0020, 0x0000);
@@ -435,16 +482,24 @@ set_rotation:
 	tinydrm_ili9325_set_rotation(ili9325);
 	tinydrm_ili9325_set_gamma(ili9325, gamma_curves);
 
-	ili9325->enabled = true;
-	fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	ili9325->initialized = true;
 
-	tinydrm_enable_backlight(ili9325->backlight);
+	/* The panel content was lost on reset */
+	tinydrm_fingerprint_reset(&ili9325->fingerprint);
+
+	return 0;
+}
+
+static void fb_ili9320_pipe_enable(struct drm_simple_display_pipe *pipe,
+				   struct drm_crtc_state *crtc_state)
+{
+	fb_ili9325_enable_common(pipe, fb_ili9320_hw_init);
 }
 
 static const struct drm_simple_display_pipe_funcs fb_ili9320_funcs = {
 	.enable =  fb_ili9320_pipe_enable,
 	.disable = fb_ili9325_pipe_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_ili9325_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
@@ -457,6 +512,8 @@ static struct drm_driver fb_ili9325_driver = {
 				  DRIVER_ATOMIC,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
+	.enable_vblank		= tinydrm_vblank_enable,
+	.disable_vblank		= tinydrm_vblank_disable,
 	.debugfs_init		= tinydrm_ili9325_debugfs_init,
 	.name			= "fb_ili9325",
 	.desc			= "fb_ili9325",
@@ -489,12 +546,32 @@ fb_ili9325_probe_common(struct device *dev, struct regmap *reg,
 		return ERR_CAST(ili9325->backlight);
 
 	tinydrm_fbtft_get_rotation(dev, &rotation);
+	/* The GRAM direction stays at its reset value, flush unrotated */
+	if (no_rotation)
+		rotation = 0;
 
 	ret = tinydrm_ili9325_init(dev, ili9325, funcs, reg, &fb_ili9325_driver,
 				   &fb_ili9325_mode, rotation);
 	if (ret)
 		return ERR_PTR(ret);
 
+	ret = devm_tinydrm_vblank_init(&ili9325->tinydrm, 0, NULL);
+	if (ret)
+		return ERR_PTR(ret);
+
+	/*
+	 * Keep what the bootloader left on the panel, or else show the splash
+	 * right after init, before the device is registered.
+	 */
+	if (tinydrm_ili9325_adopt(ili9325, tinydrm_ili9325_entry_mode(ili9325)))
+		ili9325->splash = false;
+	if (ili9325->splash) {
+		ret = funcs == &fb_ili9320_funcs ? fb_ili9320_hw_init(ili9325) :
+						   fb_ili9325_hw_init(ili9325);
+		if (!ret)
+			tinydrm_ili9325_splash(ili9325);
+	}
+
 	tdev = &ili9325->tinydrm;
 	ret = devm_tinydrm_register(tdev);
 	if (ret)
@@ -607,7 +684,7 @@ static int fb_ili9325_probe_pdev(struct platform_device *pdev)
 		return PTR_ERR(db);
 	}
 
-	reg = tinydrm_i80_init(dev, 16, cs, dc, wr, db);
+	reg = tinydrm_ili9325_i80_init(dev, cs, dc, wr, db);
 	if (IS_ERR(reg))
 		return PTR_ERR(reg);
 
@@ -623,6 +700,31 @@ static int fb_ili9325_probe_pdev(struct platform_device *pdev)
 	return 0;
 }
 
+static int __maybe_unused fb_ili9325_pm_suspend(struct device *dev)
+{
+	struct drm_device *drm = dev_get_drvdata(dev);
+	struct tinydrm_device *tdev = drm->dev_private;
+	int ret;
+
+	ret = tinydrm_suspend(tdev);
+	if (ret)
+		return ret;
+
+	tinydrm_ili9325_power_down(tinydrm_to_ili9325(tdev));
+
+	return 0;
+}
+
+static int __maybe_unused fb_ili9325_pm_resume(struct device *dev)
+{
+	struct drm_device *drm = dev_get_drvdata(dev);
+
+	return tinydrm_resume(drm->dev_private);
+}
+
+static SIMPLE_DEV_PM_OPS(fb_ili9325_pm_ops, fb_ili9325_pm_suspend,
+			 fb_ili9325_pm_resume);
+
 static const struct spi_device_id fb_ili9325_spi_ids[] = {
 	{ "fb_ili9320", (unsigned long)&fb_ili9320_funcs },
 	{ "fb_ili9325", (unsigned long)&fb_ili9325_funcs },
@@ -635,6 +737,8 @@ static struct spi_driver fb_ili9325_spi_driver = {
 		.name   = "fb_ili9325",
 		.owner  = THIS_MODULE,
 		.of_match_table = of_match_ptr(fb_ili9325_of_match),
+		.pm = &fb_ili9325_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.id_table = fb_ili9325_spi_ids,
 	.probe = fb_ili9325_probe_spi,
@@ -652,6 +756,8 @@ static struct platform_driver fb_ili9325_platform_driver = {
 		.name   = "fb_ili9325",
 		.owner  = THIS_MODULE,
 		.of_match_table = of_match_ptr(fb_ili9325_of_match),
+		.pm = &fb_ili9325_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.id_table = fb_ili9325_platform_ids,
 	.probe = fb_ili9325_probe_pdev,
@@ -42,7 +42,7 @@ static int init_display(struct fbtft_par *par)
 
 	/* oscillator start */
 	write_reg(par, 0x000, 0x0001);	/*oscillator 0: stop, 1: operation */
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	/* Power settings */
 	write_reg(par, 0x100, 0x0000); /* power supply setup */
@@ -52,10 +52,10 @@ static int init_display(struct fbtft_par *par)
 	write_reg(par, 0x110, 0x009d);
 	write_reg(par, 0x111, 0x0022);
 	write_reg(par, 0x100, 0x0120);
-	mdelay(20);
+	tinydrm_msleep(20);
 
 	write_reg(par, 0x100, 0x3120);
-	mdelay(80);
+	tinydrm_msleep(80);
 	/* Display control */
 	write_reg(par, 0x001, 0x0100);
 	write_reg(par, 0x002, 0x0000);
@@ -108,7 +108,7 @@ static int init_display(struct fbtft_par *par)
 	write_reg(par, 0x201, 0x0000);
 	write_reg(par, 0x100, 0x7120);
 	write_reg(par, 0x007, 0x0103);
-	mdelay(10);
+	tinydrm_msleep(10);
 	write_reg(par, 0x007, 0x0113);
 
 	return 0;
@@ -60,7 +60,7 @@ static int init_display(struct fbtft_par *par)
 	 * is started, and panel scanning is started.
 	 */
 	write_reg(par, 0x11);
-	mdelay(150);
+	tinydrm_msleep(150);
 
 	/* Undoc'd register? */
 	write_reg(par, 0xCA, 0x70, 0x00, 0xD9);
@@ -75,7 +75,7 @@ static int init_display(struct fbtft_par *par)
 
 	/* Drive ability setting */
 	write_reg(par, 0xC9, 0x90, 0x49, 0x10, 0x28, 0x28, 0x10, 0x00, 0x06);
-	mdelay(20);
+	tinydrm_msleep(20);
 
 	/*
 	 * SETPWCTR5: Set Power Control 5(B5h)
@@ -94,7 +94,7 @@ static int init_display(struct fbtft_par *par)
 	 *			for VGH and VGL voltage generation.
 	 */
 	write_reg(par, 0xB4, 0x33, 0x25, 0x4C);
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	/*
 	 * Interface Pixel Format (3Ah)
@@ -110,7 +110,7 @@ static int init_display(struct fbtft_par *par)
 	 * Output from the Frame Memory is enabled.
 	 */
 	write_reg(par, MIPI_DCS_SET_DISPLAY_ON);
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	return 0;
 }
@@ -192,7 +192,7 @@ static int set_gamma(struct fbtft_par *par, unsigned long *curves)
 		  CURVE(1, 6),
 		  (CURVE(1, 1) << 4) | CURVE(1, 0));
 
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	return 0;
 }
@@ -58,13 +58,13 @@ static int init_display(struct fbtft_par *par)
 	write_reg(par, 0x19, 0x01); /* start osc */
 	write_reg(par, 0x01, 0x00); /* wakeup */
 	write_reg(par, 0x1F, 0x88);
-	mdelay(5);
+	tinydrm_msleep(5);
 	write_reg(par, 0x1F, 0x80);
-	mdelay(5);
+	tinydrm_msleep(5);
 	write_reg(par, 0x1F, 0x90);
-	mdelay(5);
+	tinydrm_msleep(5);
 	write_reg(par, 0x1F, 0xD0);
-	mdelay(5);
+	tinydrm_msleep(5);
 
 	/* color selection */
 	write_reg(par, 0x17, 0x05); /* 65k */
@@ -74,7 +74,7 @@ static int init_display(struct fbtft_par *par)
 
 	/*display on */
 	write_reg(par, 0x28, 0x38);
-	mdelay(40);
+	tinydrm_msleep(40);
 	write_reg(par, 0x28, 0x3C);
 
 	/* orientation */
@@ -29,7 +29,7 @@
 static int init_display(struct fbtft_par *par)
 {
 	par->fbtftops.reset(par);
-	mdelay(150);
+	tinydrm_msleep(150);
 
 	/* SETEXTC */
 	write_reg(par, 0xB9, 0xFF, 0x83, 0x53);
@@ -51,7 +51,7 @@ static int init_display(struct fbtft_par *par)
 
 	/* SLPOUT - Sleep out & booster on */
 	write_reg(par, MIPI_DCS_EXIT_SLEEP_MODE);
-	mdelay(150);
+	tinydrm_msleep(150);
 
 	/* DISPON - Display On */
 	write_reg(par, MIPI_DCS_SET_DISPLAY_ON);
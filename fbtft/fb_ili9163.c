@@ -90,9 +90,9 @@ static int init_display(struct fbtft_par *par)
 		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
 
 	write_reg(par, MIPI_DCS_SOFT_RESET); /* software reset */
-	mdelay(500);
+	tinydrm_msleep(500);
 	write_reg(par, MIPI_DCS_EXIT_SLEEP_MODE); /* exit sleep */
-	mdelay(5);
+	tinydrm_msleep(5);
 	write_reg(par, MIPI_DCS_SET_PIXEL_FORMAT, MIPI_DCS_PIXEL_FMT_16BIT);
 	/* default gamma curve 3 */
 	write_reg(par, MIPI_DCS_SET_GAMMA_CURVE, 0x02);
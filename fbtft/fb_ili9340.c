@@ -81,7 +81,7 @@ static int init_display(struct fbtft_par *par)
 
 	write_reg(par, MIPI_DCS_EXIT_SLEEP_MODE);
 
-	mdelay(120);
+	tinydrm_msleep(120);
 
 	write_reg(par, MIPI_DCS_SET_DISPLAY_ON);
 
@@ -41,7 +41,7 @@ static int init_display(struct fbtft_par *par)
 
 	/* startup sequence for MI0283QT-9A */
 	write_reg(par, MIPI_DCS_SOFT_RESET);
-	mdelay(5);
+	tinydrm_msleep(5);
 	write_reg(par, MIPI_DCS_SET_DISPLAY_OFF);
 	/* --------------------------------------------------------- */
 	write_reg(par, 0xCF, 0x00, 0x83, 0x30);
@@ -67,9 +67,9 @@ static int init_display(struct fbtft_par *par)
 	write_reg(par, 0xB7, 0x07); /* entry mode set */
 	write_reg(par, 0xB6, 0x0A, 0x82, 0x27, 0x00);
 	write_reg(par, MIPI_DCS_EXIT_SLEEP_MODE);
-	mdelay(100);
+	tinydrm_msleep(100);
 	write_reg(par, MIPI_DCS_SET_DISPLAY_ON);
-	mdelay(20);
+	tinydrm_msleep(20);
 
 	return 0;
 }
@@ -157,6 +157,8 @@ static struct fbtft_display display = {
 	.gamma_num = 1,
 	.gamma_len = 1,
 	.gamma = DEFAULT_GAMMA,
+	.reset_assert_us = 1,
+	.reset_settle_ms = 1,
 	.fbtftops = {
 		.init_display = init_display,
 		.set_addr_win = set_addr_win,
@@ -17,37 +17,204 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/delay.h>
+#include <linux/jhash.h>
+#include <linux/sizes.h>
 
 #include <linux/gpio.h>
+#include <asm/unaligned.h>
 #include "fbtft.h"
 
 #define DRVNAME "fb_ra8875"
 
-static int write_spi(struct fbtft_par *par, void *buf, size_t len)
+/* The controller needs this long after each command and data write */
+#define RA8875_REG_DELAY_US	100
+
+/*
+ * Block Transfer Engine
+ *
+ * With bte=1 the driver keeps a copy of what the panel shows and compares
+ * each flush against it. Lines that moved vertically, a band that moved
+ * horizontally and solid color bands are done by the BTE inside display RAM,
+ * unchanged lines are skipped and only the rest is sent as pixels.
+ * The BTE is polled through the status register, so MISO must be wired.
+ */
+#define RA8875_BECR0		0x50
+#define RA8875_BECR1		0x51
+#define RA8875_HSBE0		0x54
+#define RA8875_HDBE0		0x58
+#define RA8875_BEWR0		0x5C
+#define RA8875_FGCR0		0x63
+
+#define RA8875_BECR0_START	BIT(7)
+#define RA8875_BTE_MOVE_POS	0xC2	/* ROP = source, forward */
+#define RA8875_BTE_MOVE_NEG	0xC3	/* ROP = source, backward */
+#define RA8875_BTE_FILL		0x0C
+#define RA8875_STATUS_READ	0xC0
+#define RA8875_STATUS_BTE_BUSY	BIT(6)
+
+/* A BTE operation costs about as much bus time as this many pixel lines */
+#define RA8875_BTE_MIN_LINES	8
+/* Matching lines to try per sample line when looking for a move */
+#define RA8875_BTE_CANDIDATES	4
+/* Pixels matched when looking for a horizontal move */
+#define RA8875_BTE_KEY		16
+
+static bool use_bte;
+module_param_named(bte, use_bte, bool, 0000);
+MODULE_PARM_DESC(bte, "Use the Block Transfer Engine for moves and fills (needs MISO)");
+
+enum ra8875_line {
+	RA8875_LINE_PIXELS,
+	RA8875_LINE_SAME,
+	RA8875_LINE_SOLID,
+	RA8875_LINE_MOVED,
+};
+
+struct ra8875_bte {
+	u16 *shadow;
+	u32 *hash;
+	u32 *new_hash;
+	u8 *class;
+	u16 *color;
+	bool valid;
+};
+
+static int bte_init(struct fbtft_par *par)
 {
-	struct spi_transfer t = {
-		.tx_buf = buf,
-		.len = len,
-		.speed_hz = 1000000,
-	};
-	struct spi_message m;
+	struct device *dev = par->info->device;
+	unsigned int yres = par->info->var.yres;
+	struct ra8875_bte *bte = par->extra;
 
-	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
-			  "%s(len=%d): ", __func__, len);
+	if (!bte) {
+		bte = devm_kzalloc(dev, sizeof(*bte), GFP_KERNEL);
+		if (!bte)
+			return -ENOMEM;
 
-	if (!par->spi) {
-		dev_err(par->info->device,
-			"%s: par->spi is unexpectedly NULL\n", __func__);
-		return -1;
+		bte->shadow = devm_kzalloc(dev, yres *
+					   par->info->fix.line_length,
+					   GFP_KERNEL);
+		bte->hash = devm_kcalloc(dev, yres, sizeof(u32), GFP_KERNEL);
+		bte->new_hash = devm_kcalloc(dev, yres, sizeof(u32),
+					     GFP_KERNEL);
+		bte->class = devm_kcalloc(dev, yres, sizeof(u8), GFP_KERNEL);
+		bte->color = devm_kcalloc(dev, yres, sizeof(u16), GFP_KERNEL);
+		if (!bte->shadow || !bte->hash || !bte->new_hash ||
+		    !bte->class || !bte->color)
+			return -ENOMEM;
+
+		par->extra = bte;
+	}
+
+	/* Display RAM content is unknown until the next full flush */
+	bte->valid = false;
+
+	return 0;
+}
+
+/*
+ * Layers
+ *
+ * With flip=1 the display RAM holds two layers. Flushes go to the hidden
+ * layer and end with a switch of the displayed layer, so slow updates are
+ * never seen drawing. The hidden layer is two frames old, so it gets the
+ * previous damage as well. depth=8 sends RGB332, half the bytes of RGB565.
+ * Two layers at 640x480 and 800x480 only fit at 8 bpp.
+ */
+#define RA8875_RAM_SIZE		SZ_768K
+
+#define RA8875_SYSR		0x10
+#define RA8875_SYSR_256		0x00
+#define RA8875_DPCR		0x20
+#define RA8875_DPCR_2LAYERS	BIT(7)
+#define RA8875_MWCR1		0x41
+#define RA8875_LTPR0		0x52
+
+static bool use_flip;
+module_param_named(flip, use_flip, bool, 0000);
+MODULE_PARM_DESC(flip, "Flush to a hidden layer and switch layers when done");
+
+static unsigned int depth = 16;
+module_param(depth, uint, 0000);
+MODULE_PARM_DESC(depth, "Bits per pixel on the wire: 8, 16 (default)");
+
+struct ra8875_layers {
+	u8 *buf;
+	unsigned int bpp;
+	bool flip;
+	unsigned int hidden;
+	unsigned int stale;
+	int prev_ys;
+	int prev_ye;
+};
+
+/* par->extra holds struct ra8875_layers or struct ra8875_bte */
+static struct ra8875_layers *ra8875_layers(struct fbtft_par *par)
+{
+	return use_flip || depth == 8 ? par->extra : NULL;
+}
+
+static int layers_init(struct fbtft_par *par)
+{
+	size_t pixels = par->info->var.xres * par->info->var.yres;
+	struct device *dev = par->info->device;
+	struct ra8875_layers *layers = par->extra;
+
+	if (!layers) {
+		layers = devm_kzalloc(dev, sizeof(*layers), GFP_KERNEL);
+		if (!layers)
+			return -ENOMEM;
+
+		layers->flip = use_flip;
+		layers->bpp = depth;
+		if (layers->flip && layers->bpp == 16 &&
+		    pixels * 2 * 2 > RA8875_RAM_SIZE) {
+			dev_warn(dev, "Two layers need depth=8 at %ux%u\n",
+				 par->info->var.xres, par->info->var.yres);
+			layers->bpp = 8;
+		}
+
+		if (layers->bpp == 8) {
+			layers->buf = devm_kmalloc(dev, pixels, GFP_KERNEL);
+			if (!layers->buf)
+				return -ENOMEM;
+		}
+
+		if (use_bte)
+			dev_warn(dev, "BTE is not used with flip or depth=8\n");
+
+		par->extra = layers;
+	}
+
+	if (layers->bpp == 8)
+		write_reg(par, RA8875_SYSR, RA8875_SYSR_256);
+
+	if (layers->flip) {
+		write_reg(par, RA8875_DPCR, RA8875_DPCR_2LAYERS);
+		/* Show and write layer 1, the first flush goes to layer 2 */
+		write_reg(par, RA8875_LTPR0, 0x00);
+		write_reg(par, RA8875_MWCR1, 0x00);
+		layers->hidden = 1;
 	}
 
-	spi_message_init(&m);
-	spi_message_add_tail(&t, &m);
-	return spi_sync(par->spi, &m);
+	/* Display RAM content is unknown until every layer is rewritten */
+	layers->stale = layers->flip ? 2 : 1;
+
+	return 0;
+}
+
+static inline u8 rgb565_to_rgb332(u16 c)
+{
+	return ((c >> 8) & 0xE0) | ((c >> 6) & 0x1C) | ((c >> 3) & 0x03);
 }
 
 static int init_display(struct fbtft_par *par)
 {
+	if (depth != 8 && depth != 16) {
+		dev_err(par->info->device, "depth=%u is not supported\n",
+			depth);
+		return -EINVAL;
+	}
+
 	gpio_set_value(par->gpio.dc, 1);
 
 	fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
@@ -63,12 +230,12 @@ static int init_display(struct fbtft_par *par)
 		/* PLL clock frequency */
 		write_reg(par, 0x88, 0x0A);
 		write_reg(par, 0x89, 0x02);
-		mdelay(10);
+		tinydrm_msleep(10);
 		/* color deep / MCU Interface */
 		write_reg(par, 0x10, 0x0C);
 		/* pixel clock period  */
 		write_reg(par, 0x04, 0x03);
-		mdelay(1);
+		tinydrm_msleep(1);
 		/* horizontal settings */
 		write_reg(par, 0x14, 0x27);
 		write_reg(par, 0x15, 0x00);
@@ -88,12 +255,12 @@ static int init_display(struct fbtft_par *par)
 		/* PLL clock frequency  */
 		write_reg(par, 0x88, 0x0A);
 		write_reg(par, 0x89, 0x02);
-		mdelay(10);
+		tinydrm_msleep(10);
 		/* color deep / MCU Interface */
 		write_reg(par, 0x10, 0x0C);
 		/* pixel clock period  */
 		write_reg(par, 0x04, 0x82);
-		mdelay(1);
+		tinydrm_msleep(1);
 		/* horizontal settings */
 		write_reg(par, 0x14, 0x3B);
 		write_reg(par, 0x15, 0x00);
@@ -113,12 +280,12 @@ static int init_display(struct fbtft_par *par)
 		/* PLL clock frequency */
 		write_reg(par, 0x88, 0x0B);
 		write_reg(par, 0x89, 0x02);
-		mdelay(10);
+		tinydrm_msleep(10);
 		/* color deep / MCU Interface */
 		write_reg(par, 0x10, 0x0C);
 		/* pixel clock period */
 		write_reg(par, 0x04, 0x01);
-		mdelay(1);
+		tinydrm_msleep(1);
 		/* horizontal settings */
 		write_reg(par, 0x14, 0x4F);
 		write_reg(par, 0x15, 0x05);
@@ -138,12 +305,12 @@ static int init_display(struct fbtft_par *par)
 		/* PLL clock frequency */
 		write_reg(par, 0x88, 0x0B);
 		write_reg(par, 0x89, 0x02);
-		mdelay(10);
+		tinydrm_msleep(10);
 		/* color deep / MCU Interface */
 		write_reg(par, 0x10, 0x0C);
 		/* pixel clock period */
 		write_reg(par, 0x04, 0x81);
-		mdelay(1);
+		tinydrm_msleep(1);
 		/* horizontal settings */
 		write_reg(par, 0x14, 0x63);
 		write_reg(par, 0x15, 0x03);
@@ -166,45 +333,622 @@ static int init_display(struct fbtft_par *par)
 	/* PWM clock */
 	write_reg(par, 0x8a, 0x81);
 	write_reg(par, 0x8b, 0xFF);
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	/* Display ON */
 	write_reg(par, 0x01, 0x80);
-	mdelay(10);
+	tinydrm_msleep(10);
+
+	if (use_flip || depth == 8)
+		return layers_init(par);
+
+	if (use_bte)
+		return bte_init(par);
 
 	return 0;
 }
 
+/* Set_Active_Window and Set_Memory_Write_Cursor, the window is inclusive */
+#define RA8875_WINDOW_REGS	12
+
+static void window_regs(u8 regs[][2], int xs, int ys, int xe, int ye)
+{
+	const u8 win[RA8875_WINDOW_REGS][2] = {
+		/* Set_Active_Window */
+		{ 0x30, xs & 0x00FF },
+		{ 0x31, (xs & 0xFF00) >> 8 },
+		{ 0x32, ys & 0x00FF },
+		{ 0x33, (ys & 0xFF00) >> 8 },
+		{ 0x34, xe & 0x00FF },
+		{ 0x35, (xe & 0xFF00) >> 8 },
+		{ 0x36, ye & 0x00FF },
+		{ 0x37, (ye & 0xFF00) >> 8 },
+		/* Set_Memory_Write_Cursor */
+		{ 0x46,  xs & 0xff },
+		{ 0x47, (xs >> 8) & 0x03 },
+		{ 0x48,  ys & 0xff },
+		{ 0x49, (ys >> 8) & 0x01 },
+	};
+
+	memcpy(regs, win, sizeof(win));
+}
+
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 {
-	/* Set_Active_Window */
-	write_reg(par, 0x30, xs & 0x00FF);
-	write_reg(par, 0x31, (xs & 0xFF00) >> 8);
-	write_reg(par, 0x32, ys & 0x00FF);
-	write_reg(par, 0x33, (ys & 0xFF00) >> 8);
-	write_reg(par, 0x34, (xs + xe) & 0x00FF);
-	write_reg(par, 0x35, ((xs + xe) & 0xFF00) >> 8);
-	write_reg(par, 0x36, (ys + ye) & 0x00FF);
-	write_reg(par, 0x37, ((ys + ye) & 0xFF00) >> 8);
-
-	/* Set_Memory_Write_Cursor */
-	write_reg(par, 0x46,  xs & 0xff);
-	write_reg(par, 0x47, (xs >> 8) & 0x03);
-	write_reg(par, 0x48,  ys & 0xff);
-	write_reg(par, 0x49, (ys >> 8) & 0x01);
+	u8 regs[RA8875_WINDOW_REGS][2];
+	int i;
+
+	window_regs(regs, xs, ys, xe, ye);
+	for (i = 0; i < RA8875_WINDOW_REGS; i++)
+		write_reg(par, regs[i][0], regs[i][1]);
 
 	write_reg(par, 0x02);
 }
 
+/* Same startbytes and timing as write_reg8_bus8(), queued in the frame */
+static int frame_add_reg(struct fbtft_par *par, u8 reg, u8 val)
+{
+	u8 buf[2] = { 0x80, reg };
+	int ret;
+
+	ret = fbtft_frame_add_hdr(par, buf, 2, fbtft_cmd_hz(par),
+				  RA8875_REG_DELAY_US, true);
+	if (ret)
+		return ret;
+
+	buf[0] = 0x00;
+	buf[1] = val;
+
+	return fbtft_frame_add_hdr(par, buf, 2, fbtft_cmd_hz(par),
+				   RA8875_REG_DELAY_US, true);
+}
+
+static int write_reg_frame(struct fbtft_par *par, u8 reg, u8 val)
+{
+	int ret;
+
+	fbtft_frame_begin(par);
+
+	ret = frame_add_reg(par, reg, val);
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+
+/* set_addr_win(), memory write and the pixels in one SPI message */
+static int write_window(struct fbtft_par *par, int xs, int ys, int xe, int ye,
+			size_t offset, size_t len)
+{
+	struct ra8875_layers *layers = ra8875_layers(par);
+	u8 regs[RA8875_WINDOW_REGS][2];
+	u16 *vmem16 = par->info->screen_buffer + offset;
+	u8 buf[2] = { 0x80, 0x02 };
+	int i, ret;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
+		      __func__, offset, len);
+
+	fbtft_frame_begin(par);
+
+	if (layers && layers->flip) {
+		ret = frame_add_reg(par, RA8875_MWCR1, layers->hidden);
+		if (ret)
+			return ret;
+	}
+
+	window_regs(regs, xs, ys, xe, ye);
+	for (i = 0; i < RA8875_WINDOW_REGS; i++) {
+		ret = frame_add_reg(par, regs[i][0], regs[i][1]);
+		if (ret)
+			return ret;
+	}
+
+	ret = fbtft_frame_add_hdr(par, buf, 2, fbtft_cmd_hz(par),
+				  RA8875_REG_DELAY_US, true);
+	if (ret)
+		return ret;
+
+	buf[0] = 0x00;
+	ret = fbtft_frame_add_hdr(par, buf, 1, fbtft_pixel_hz(par), 0, false);
+	if (ret)
+		return ret;
+
+	if (layers && layers->bpp == 8) {
+		for (i = 0; i < len / 2; i++)
+			layers->buf[i] = rgb565_to_rgb332(vmem16[i]);
+		ret = fbtft_frame_add_buf(par, layers->buf, len / 2, 8,
+					  fbtft_pixel_hz(par));
+	} else if (!par->frame.buf) {
+		ret = fbtft_frame_add_buf(par, vmem16, len, 16,
+					  fbtft_pixel_hz(par));
+	} else {
+		if (len > par->frame.len)
+			return -EINVAL;
+		for (i = 0; i < len / 2; i++)
+			((__be16 *)par->frame.buf)[i] = cpu_to_be16(vmem16[i]);
+		ret = fbtft_frame_add_buf(par, par->frame.buf, len, 8,
+					  fbtft_pixel_hz(par));
+	}
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+
+static u16 *bte_line(struct fbtft_par *par, void *vmem, int y)
+{
+	return vmem + y * par->info->fix.line_length;
+}
+
+/* New line @n is the same as shadow line @o */
+static bool bte_line_equal(struct fbtft_par *par, int n, int o)
+{
+	struct ra8875_bte *bte = par->extra;
+
+	return bte->new_hash[n] == bte->hash[o] &&
+	       !memcmp(bte_line(par, par->info->screen_buffer, n),
+		       bte_line(par, bte->shadow, o),
+		       par->info->fix.line_length);
+}
+
+static bool bte_line_solid(struct fbtft_par *par, int y, u16 *color)
+{
+	u16 *line = bte_line(par, par->info->screen_buffer, y);
+	unsigned int x;
+
+	for (x = 1; x < par->info->var.xres; x++)
+		if (line[x] != line[0])
+			return false;
+
+	*color = line[0];
+
+	return true;
+}
+
+/* Longest run of damaged lines that moved vertically by the same amount */
+static bool bte_find_vmove(struct fbtft_par *par, int ys, int ye,
+			   int *start, int *end, int *dy)
+{
+	struct ra8875_bte *bte = par->extra;
+	int yres = par->info->var.yres;
+	int h = ye - ys + 1;
+	int samples[] = { ys + h / 2, ys + h / 4, ys + h * 3 / 4 };
+	int i, r, s, d, lo, hi, tries, best = 0;
+	u16 color;
+
+	for (i = 0; i < ARRAY_SIZE(samples); i++) {
+		r = samples[i];
+		/* Solid lines match everywhere, leave them to the fill */
+		if (bte_line_solid(par, r, &color))
+			continue;
+
+		for (s = 0, tries = 0;
+		     s < yres && tries < RA8875_BTE_CANDIDATES; s++) {
+			if (s == r || bte->hash[s] != bte->new_hash[r])
+				continue;
+
+			tries++;
+			d = s - r;
+			if (!bte_line_equal(par, r, s))
+				continue;
+
+			lo = r;
+			while (lo > ys && lo - 1 + d >= 0 &&
+			       bte_line_equal(par, lo - 1, lo - 1 + d))
+				lo--;
+			hi = r + 1;
+			while (hi <= ye && hi + d < yres &&
+			       bte_line_equal(par, hi, hi + d))
+				hi++;
+
+			if (hi - lo > best) {
+				best = hi - lo;
+				*start = lo;
+				*end = hi;
+				*dy = d;
+			}
+		}
+	}
+
+	return best >= RA8875_BTE_MIN_LINES;
+}
+
+/* The whole damaged band moved horizontally, the source is at x + @dx */
+static bool bte_find_hmove(struct fbtft_par *par, int ys, int ye, int *dx)
+{
+	struct ra8875_bte *bte = par->extra;
+	int xres = par->info->var.xres;
+	int key = xres / 2 - RA8875_BTE_KEY / 2;
+	int r = ys + (ye - ys) / 2;
+	u16 *line = bte_line(par, par->info->screen_buffer, r);
+	u16 *prev = bte_line(par, bte->shadow, r);
+	int p, y, d, w, tries = 0;
+	u16 color;
+
+	if (ye - ys + 1 < RA8875_BTE_MIN_LINES || bte_line_solid(par, r, &color))
+		return false;
+
+	for (p = 0; p <= xres - RA8875_BTE_KEY &&
+		    tries < RA8875_BTE_CANDIDATES; p++) {
+		if (p == key || memcmp(prev + p, line + key, RA8875_BTE_KEY * 2))
+			continue;
+
+		tries++;
+		d = p - key;
+		w = xres - abs(d);
+		/* Not worth it if more than half has to be sent anyway */
+		if (w < xres / 2)
+			continue;
+
+		for (y = ys; y <= ye; y++) {
+			if (memcmp(bte_line(par, par->info->screen_buffer, y) +
+				   max(-d, 0),
+				   bte_line(par, bte->shadow, y) + max(d, 0),
+				   w * 2))
+				break;
+		}
+		if (y > ye) {
+			*dx = d;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int bte_add_xy(struct fbtft_par *par, u8 reg, int x, int y)
+{
+	const u8 vals[] = {
+		x & 0xFF, (x >> 8) & 0x03, y & 0xFF, (y >> 8) & 0x01,
+	};
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(vals); i++) {
+		ret = frame_add_reg(par, reg + i, vals[i]);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Status read, the BTE busy bit clears when the operation is done */
+static int bte_wait(struct fbtft_par *par)
+{
+	struct spi_transfer tr[2] = {
+		{
+			.tx_buf = par->buf,
+			.len = 1,
+			.speed_hz = fbtft_read_hz(par),
+		}, {
+			.rx_buf = par->buf + 1,
+			.len = 1,
+			.speed_hz = fbtft_read_hz(par),
+		},
+	};
+	unsigned long timeout = jiffies + msecs_to_jiffies(100);
+	int ret;
+
+	do {
+		par->buf[0] = RA8875_STATUS_READ;
+		ret = spi_sync_transfer(par->spi, tr, ARRAY_SIZE(tr));
+		if (ret)
+			return ret;
+
+		if (!(par->buf[1] & RA8875_STATUS_BTE_BUSY))
+			return 0;
+
+		usleep_range(50, 100);
+	} while (time_before(jiffies, timeout));
+
+	return -ETIMEDOUT;
+}
+
+static int bte_run(struct fbtft_par *par, u8 op)
+{
+	int ret;
+
+	ret = frame_add_reg(par, RA8875_BECR1, op);
+	if (ret)
+		return ret;
+
+	ret = frame_add_reg(par, RA8875_BECR0, RA8875_BECR0_START);
+	if (ret)
+		return ret;
+
+	ret = fbtft_frame_submit(par);
+	if (ret)
+		return ret;
+
+	return bte_wait(par);
+}
+
+static int bte_add_size(struct fbtft_par *par, int w, int h)
+{
+	return bte_add_xy(par, RA8875_BEWR0, w, h);
+}
+
+/* Copy a @w x @h block from (@sx, @sy) to (@tx, @ty) */
+static int bte_move(struct fbtft_par *par, int sx, int sy, int tx, int ty,
+		    int w, int h)
+{
+	u8 op = RA8875_BTE_MOVE_POS;
+	int ret;
+
+	/* Overlapping blocks are copied from the end when moving down/right */
+	if (ty > sy || (ty == sy && tx > sx)) {
+		op = RA8875_BTE_MOVE_NEG;
+		sx += w - 1;
+		sy += h - 1;
+		tx += w - 1;
+		ty += h - 1;
+	}
+
+	fbtft_frame_begin(par);
+
+	ret = bte_add_xy(par, RA8875_HSBE0, sx, sy);
+	if (!ret)
+		ret = bte_add_xy(par, RA8875_HDBE0, tx, ty);
+	if (!ret)
+		ret = bte_add_size(par, w, h);
+	if (ret)
+		return ret;
+
+	return bte_run(par, op);
+}
+
+static int bte_fill(struct fbtft_par *par, int x, int y, int w, int h,
+		    u16 color)
+{
+	int ret;
+
+	fbtft_frame_begin(par);
+
+	ret = bte_add_xy(par, RA8875_HDBE0, x, y);
+	if (!ret)
+		ret = bte_add_size(par, w, h);
+	if (!ret)
+		ret = frame_add_reg(par, RA8875_FGCR0, color >> 11);
+	if (!ret)
+		ret = frame_add_reg(par, RA8875_FGCR0 + 1, (color >> 5) & 0x3F);
+	if (!ret)
+		ret = frame_add_reg(par, RA8875_FGCR0 + 2, color & 0x1F);
+	if (ret)
+		return ret;
+
+	return bte_run(par, RA8875_BTE_FILL);
+}
+
+static int write_lines(struct fbtft_par *par, int ys, int ye)
+{
+	size_t line_length = par->info->fix.line_length;
+
+	return write_window(par, 0, ys, par->info->var.xres - 1, ye,
+			    ys * line_length, (ye - ys + 1) * line_length);
+}
+
+/* A block narrower than the display, streamed through txbuf */
+static int write_block(struct fbtft_par *par, int x, int y, int w, int h)
+{
+	size_t max = (par->txbuf.len - 1) / 2, num = 0;
+	u8 *txbuf8 = par->txbuf.buf;
+	int i, j, ret;
+	u16 *line;
+
+	set_addr_win(par, x, y, x + w - 1, y + h - 1);
+
+	txbuf8[0] = 0x00;
+	for (j = y; j < y + h; j++) {
+		line = bte_line(par, par->info->screen_buffer, j);
+		for (i = x; i < x + w; i++) {
+			put_unaligned_be16(line[i], txbuf8 + 1 + num * 2);
+			if (++num < max)
+				continue;
+
+			ret = par->fbtftops.write(par, txbuf8, 1 + num * 2);
+			if (ret < 0)
+				return ret;
+			num = 0;
+		}
+	}
+
+	if (num) {
+		ret = par->fbtftops.write(par, txbuf8, 1 + num * 2);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Whole screen active window, so nothing clips the BTE */
+static int bte_full_window(struct fbtft_par *par)
+{
+	int ret;
+
+	fbtft_frame_begin(par);
+
+	ret = bte_add_xy(par, 0x30, 0, 0);
+	if (!ret)
+		ret = bte_add_xy(par, 0x34, par->info->var.xres - 1,
+				 par->info->var.yres - 1);
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+
+static int bte_flush(struct fbtft_par *par, int ys, int ye)
+{
+	struct ra8875_bte *bte = par->extra;
+	int xres = par->info->var.xres;
+	int y, run, start, end, dy, dx;
+	bool window = false;
+	u8 class;
+	int ret;
+
+	if (bte_find_hmove(par, ys, ye, &dx)) {
+		ret = bte_full_window(par);
+		if (!ret)
+			ret = bte_move(par, max(dx, 0), ys, max(-dx, 0), ys,
+				       xres - abs(dx), ye - ys + 1);
+		if (ret)
+			return ret;
+
+		return write_block(par, dx > 0 ? xres - dx : 0, ys, abs(dx),
+				   ye - ys + 1);
+	}
+
+	for (y = ys; y <= ye; y++) {
+		if (bte_line_equal(par, y, y))
+			bte->class[y] = RA8875_LINE_SAME;
+		else if (bte_line_solid(par, y, &bte->color[y]))
+			bte->class[y] = RA8875_LINE_SOLID;
+		else
+			bte->class[y] = RA8875_LINE_PIXELS;
+	}
+
+	if (bte_find_vmove(par, ys, ye, &start, &end, &dy)) {
+		ret = bte_full_window(par);
+		if (!ret)
+			ret = bte_move(par, 0, start + dy, 0, start, xres,
+				       end - start);
+		if (ret)
+			return ret;
+
+		window = true;
+		for (y = start; y < end; y++)
+			bte->class[y] = RA8875_LINE_MOVED;
+	}
+
+	/* Short skips and fills cost more than sending the pixels */
+	for (y = ys; y <= ye; y += run) {
+		class = bte->class[y];
+		for (run = 1; y + run <= ye && bte->class[y + run] == class &&
+		     (class != RA8875_LINE_SOLID ||
+		      bte->color[y + run] == bte->color[y]); run++)
+			;
+
+		if (class == RA8875_LINE_MOVED || class == RA8875_LINE_PIXELS ||
+		    run >= RA8875_BTE_MIN_LINES)
+			continue;
+
+		/* Unchanged lines at the edges are free to skip */
+		if (class == RA8875_LINE_SAME && (y == ys || y + run > ye))
+			continue;
+
+		memset(bte->class + y, RA8875_LINE_PIXELS, run);
+	}
+
+	for (y = ys; y <= ye; y += run) {
+		class = bte->class[y];
+		for (run = 1; y + run <= ye && bte->class[y + run] == class &&
+		     (class != RA8875_LINE_SOLID ||
+		      bte->color[y + run] == bte->color[y]); run++)
+			;
+
+		if (class == RA8875_LINE_SOLID) {
+			if (!window) {
+				ret = bte_full_window(par);
+				if (ret)
+					return ret;
+				window = true;
+			}
+			ret = bte_fill(par, 0, y, xres, run, bte->color[y]);
+		} else if (class == RA8875_LINE_PIXELS) {
+			ret = write_lines(par, y, y + run - 1);
+		} else {
+			ret = 0;
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * Write the damage and what the hidden layer missed, then show it. After init
+ * or a failed write the whole screen is written until every layer has had a
+ * successful flush.
+ */
+static int layers_write(struct fbtft_par *par, int ys, int ye)
+{
+	struct ra8875_layers *layers = ra8875_layers(par);
+	int start = ys, end = ye;
+	int ret;
+
+	if (layers->stale) {
+		start = 0;
+		end = par->info->var.yres - 1;
+	} else if (layers->flip) {
+		start = min(ys, layers->prev_ys);
+		end = max(ye, layers->prev_ye);
+	}
+
+	ret = write_lines(par, start, end);
+	if (!ret && layers->flip)
+		ret = write_reg_frame(par, RA8875_LTPR0, layers->hidden);
+	if (ret) {
+		/* Start over with every layer */
+		layers->stale = layers->flip ? 2 : 1;
+		return ret;
+	}
+
+	if (layers->stale)
+		layers->stale--;
+	layers->prev_ys = ys;
+	layers->prev_ye = ye;
+	layers->hidden ^= 1;
+
+	return 0;
+}
+
+static int write_frame(struct fbtft_par *par, int xs, int ys, int xe, int ye,
+		       size_t offset, size_t len)
+{
+	size_t line_length = par->info->fix.line_length;
+	struct ra8875_bte *bte;
+	int y, ret;
+
+	if (ra8875_layers(par))
+		return layers_write(par, ys, ye);
+
+	bte = par->extra;
+	if (!bte)
+		return write_window(par, xs, ys, xe, ye, offset, len);
+
+	for (y = ys; y <= ye; y++)
+		bte->new_hash[y] = jhash(bte_line(par, par->info->screen_buffer,
+						  y), line_length, 0);
+
+	if (bte->valid)
+		ret = bte_flush(par, ys, ye);
+	else
+		ret = write_window(par, xs, ys, xe, ye, offset, len);
+	if (ret) {
+		bte->valid = false;
+		return ret;
+	}
+
+	memcpy(bte_line(par, bte->shadow, ys),
+	       bte_line(par, par->info->screen_buffer, ys),
+	       (ye - ys + 1) * line_length);
+	memcpy(bte->hash + ys, bte->new_hash + ys, (ye - ys + 1) * sizeof(u32));
+
+	if (!ys && ye == par->info->var.yres - 1)
+		bte->valid = true;
+
+	return 0;
+}
+
 static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 {
 	va_list args;
 	int i, ret;
 	u8 *buf = par->buf;
 
-	/* slow down spi-speed for writing registers */
-	par->fbtftops.write = write_spi;
-
 	if (unlikely(par->debug & DEBUG_WRITE_REGISTER)) {
 		va_start(args, len);
 		for (i = 0; i < len; i++)
@@ -217,7 +961,7 @@ static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 	va_start(args, len);
 	*buf++ = 0x80;
 	*buf = (u8)va_arg(args, unsigned int);
-	ret = par->fbtftops.write(par, par->buf, 2);
+	ret = fbtft_write_cmd_bytes(par, par->buf, 2);
 	if (ret < 0) {
 		va_end(args);
 		dev_err(par->info->device, "write() failed and returned %dn",
@@ -226,7 +970,7 @@ static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 	}
 	len--;
 
-	udelay(100);
+	udelay(RA8875_REG_DELAY_US);
 
 	if (len) {
 		buf = (u8 *)par->buf;
@@ -235,7 +979,7 @@ static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 		while (i--)
 			*buf++ = (u8)va_arg(args, unsigned int);
 
-		ret = par->fbtftops.write(par, par->buf, len + 1);
+		ret = fbtft_write_cmd_bytes(par, par->buf, len + 1);
 		if (ret < 0) {
 			va_end(args);
 			dev_err(par->info->device,
@@ -245,15 +989,15 @@ static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 	}
 	va_end(args);
 
-	/* restore user spi-speed */
-	par->fbtftops.write = fbtft_write_spi;
-	udelay(100);
+	udelay(RA8875_REG_DELAY_US);
 }
 
 static int write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 {
+	struct ra8875_layers *layers = ra8875_layers(par);
+	size_t bytes = layers && layers->bpp == 8 ? 1 : 2;
 	u16 *vmem16;
-	u16 *txbuf16 = par->txbuf.buf;
+	u8 *txbuf8;
 	size_t remain;
 	size_t to_copy;
 	size_t tx_array_size;
@@ -266,9 +1010,8 @@ static int write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 
 	remain = len / 2;
 	vmem16 = (u16 *)(par->info->screen_buffer + offset);
-	tx_array_size = par->txbuf.len / 2;
-		txbuf16 = par->txbuf.buf + 1;
-		tx_array_size -= 2;
+	tx_array_size = (par->txbuf.len - 1) / bytes;
+		txbuf8 = par->txbuf.buf + 1;
 		*(u8 *)(par->txbuf.buf) = 0x00;
 		startbyte_size = 1;
 
@@ -277,12 +1020,17 @@ static int write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 		dev_dbg(par->info->device, "    to_copy=%zu, remain=%zu\n",
 			to_copy, remain - to_copy);
 
-		for (i = 0; i < to_copy; i++)
-			txbuf16[i] = cpu_to_be16(vmem16[i]);
+		if (bytes == 1) {
+			for (i = 0; i < to_copy; i++)
+				txbuf8[i] = rgb565_to_rgb332(vmem16[i]);
+		} else {
+			for (i = 0; i < to_copy; i++)
+				put_unaligned_be16(vmem16[i], txbuf8 + i * 2);
+		}
 
 		vmem16 = vmem16 + to_copy;
 		ret = par->fbtftops.write(par, par->txbuf.buf,
-			startbyte_size + to_copy * 2);
+			startbyte_size + to_copy * bytes);
 		if (ret < 0)
 			return ret;
 		remain -= to_copy;
@@ -293,12 +1041,14 @@ static int write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 
 static struct fbtft_display display = {
 	.regwidth = 8,
+	/* slow down spi-speed for writing registers */
+	.cmd_speed_hz = 1000000,
 	.fbtftops = {
 		.init_display = init_display,
 		.set_addr_win = set_addr_win,
+		.write_frame = write_frame,
 		.write_register = write_reg8_bus8,
 		.write_vmem = write_vmem16_bus8,
-		.write = write_spi,
 	},
 };
 
@@ -215,6 +215,8 @@ static struct fbtft_display display = {
 	.gamma_num = 1,
 	.gamma_len = 1,
 	.gamma = "00",
+	.reset_assert_us = 3,
+	.reset_settle_ms = 1,
 	.fbtftops = {
 		.write_vmem = write_vmem,
 		.init_display = init_display,
@@ -184,6 +184,8 @@ static struct fbtft_display display = {
 	.gamma_num = GAMMA_NUM,
 	.gamma_len = GAMMA_LEN,
 	.gamma = DEFAULT_GAMMA,
+	.reset_assert_us = 3,
+	.reset_settle_ms = 1,
 	.fbtftops = {
 		.write_vmem = write_vmem,
 		.init_display = init_display,
@@ -4,6 +4,7 @@
 #include <linux/gpio.h>
 #include <linux/spi/spi.h>
 #include <linux/delay.h>
+#include <asm/unaligned.h>
 
 #include "fbtft.h"
 
@@ -21,6 +22,404 @@
 			"2 2 2 2 2 2 2 2 " \
 			"2 2 2 2 2 2 2" \
 
+/*
+ * Graphic acceleration
+ *
+ * The driver keeps a copy of what the panel shows. Each flush is compared
+ * against it: lines that scrolled up are copied inside GRAM, bands of solid
+ * color are drawn as filled rectangles (or cleared if black), unchanged lines
+ * are skipped and only the rest is streamed as pixels, trimmed to the columns
+ * that changed. The commands go out in one SPI message with the drawing time
+ * as delay after each one.
+ *
+ * GRAM copy isn't specified for overlapping blocks, so only moves towards the
+ * top are done, they're safe when copying from the top.
+ */
+#define SSD1331_DRAW_RECT	0x22
+#define SSD1331_COPY		0x23
+#define SSD1331_CLEAR		0x25
+#define SSD1331_FILL		0x26
+#define SSD1331_FILL_ENABLE	BIT(0)
+
+/* Drawing the full panel takes up to 3 ms, scaled by area */
+#define SSD1331_DRAW_US(area)	(50 + DIV_ROUND_UP((area) * 3000, \
+						   WIDTH * HEIGHT))
+/* Smaller blocks are cheaper as pixels */
+#define SSD1331_ACCEL_MIN_PIXELS	32
+/* Matching lines to try per sample line when looking for a move */
+#define SSD1331_MOVE_CANDIDATES		4
+
+enum ssd1331_line {
+	SSD1331_LINE_PIXELS,
+	SSD1331_LINE_SAME,
+	SSD1331_LINE_SOLID,
+	SSD1331_LINE_MOVED,
+};
+
+struct ssd1331_accel {
+	u16 *shadow;
+	u8 class[HEIGHT];
+	u16 color[HEIGHT];
+	bool valid;
+};
+
+/* The clip is packed at the start of the buffer */
+struct ssd1331_clip {
+	u16 *vmem;
+	int xs, ys, xe, ye, w;
+};
+
+static int accel_init(struct fbtft_par *par)
+{
+	struct ssd1331_accel *accel = par->extra;
+	struct device *dev = par->info->device;
+
+	if (!par->spi || par->gpio.dc == -1 || !par->txbuf.buf)
+		return 0;
+
+	/*
+	 * The shadow and the draw commands use the native 96x64 layout, a
+	 * rotated or resized framebuffer is flushed without acceleration.
+	 */
+	if (par->info->var.xres != WIDTH || par->info->var.yres != HEIGHT) {
+		dev_dbg(dev, "%ux%u framebuffer, not accelerating\n",
+			par->info->var.xres, par->info->var.yres);
+		return 0;
+	}
+
+	if (!accel) {
+		accel = devm_kzalloc(dev, sizeof(*accel), GFP_KERNEL);
+		if (!accel)
+			return -ENOMEM;
+
+		accel->shadow = devm_kcalloc(dev, WIDTH * HEIGHT, sizeof(u16),
+					     GFP_KERNEL);
+		if (!accel->shadow)
+			return -ENOMEM;
+
+		par->extra = accel;
+	}
+
+	/* GRAM content is unknown until the next full flush */
+	accel->valid = false;
+
+	return 0;
+}
+
+static u16 *clip_line(const struct ssd1331_clip *clip, int y)
+{
+	return clip->vmem + (y - clip->ys) * clip->w;
+}
+
+static u16 *shadow_line(struct ssd1331_accel *accel,
+			const struct ssd1331_clip *clip, int y)
+{
+	return accel->shadow + y * WIDTH + clip->xs;
+}
+
+static bool clip_line_equal(struct ssd1331_accel *accel,
+			    const struct ssd1331_clip *clip, int n, int o)
+{
+	return !memcmp(clip_line(clip, n), shadow_line(accel, clip, o),
+		       clip->w * sizeof(u16));
+}
+
+static bool clip_line_solid(const struct ssd1331_clip *clip, int y,
+			    u16 *color)
+{
+	u16 *line = clip_line(clip, y);
+	int x;
+
+	for (x = 1; x < clip->w; x++)
+		if (line[x] != line[0])
+			return false;
+
+	*color = line[0];
+
+	return true;
+}
+
+/* Longest run of lines that moved up by the same amount within the clip */
+static bool accel_find_move(struct ssd1331_accel *accel,
+			    const struct ssd1331_clip *clip,
+			    int *start, int *end, int *dy)
+{
+	int h = clip->ye - clip->ys + 1;
+	int samples[] = { clip->ys + h / 2, clip->ys + h / 4,
+			  clip->ys + h * 3 / 4 };
+	int i, r, s, d, lo, hi, tries, best = 0;
+	u16 color;
+
+	for (i = 0; i < ARRAY_SIZE(samples); i++) {
+		r = samples[i];
+		/* Solid lines match everywhere, leave them to the fill */
+		if (clip_line_solid(clip, r, &color))
+			continue;
+
+		for (s = r + 1, tries = 0;
+		     s < HEIGHT && tries < SSD1331_MOVE_CANDIDATES; s++) {
+			if (!clip_line_equal(accel, clip, r, s))
+				continue;
+
+			tries++;
+			d = s - r;
+			lo = r;
+			while (lo > clip->ys &&
+			       clip_line_equal(accel, clip, lo - 1, lo - 1 + d))
+				lo--;
+			hi = r + 1;
+			while (hi <= clip->ye && hi + d < HEIGHT &&
+			       clip_line_equal(accel, clip, hi, hi + d))
+				hi++;
+
+			if (hi - lo > best) {
+				best = hi - lo;
+				*start = lo;
+				*end = hi;
+				*dy = d;
+			}
+		}
+	}
+
+	return best * clip->w >= SSD1331_ACCEL_MIN_PIXELS;
+}
+
+/* Queue a command, the frame is sent when it's full */
+static int accel_add(struct fbtft_par *par, const u8 *cmd, size_t len,
+		     u16 delay_usecs)
+{
+	int ret;
+
+	ret = fbtft_frame_add_hdr(par, cmd, len, fbtft_cmd_hz(par),
+				  delay_usecs, false);
+	if (ret != -ENOSPC)
+		return ret;
+
+	gpio_set_value(par->gpio.dc, 0);
+	ret = fbtft_frame_submit(par);
+	if (ret)
+		return ret;
+
+	fbtft_frame_begin(par);
+
+	return fbtft_frame_add_hdr(par, cmd, len, fbtft_cmd_hz(par),
+				   delay_usecs, false);
+}
+
+static int accel_submit(struct fbtft_par *par)
+{
+	int ret;
+
+	gpio_set_value(par->gpio.dc, 0);
+	ret = fbtft_frame_submit(par);
+	fbtft_frame_begin(par);
+
+	return ret;
+}
+
+static int accel_fill(struct fbtft_par *par, int xs, int ys, int xe, int ye,
+		      u16 color)
+{
+	u8 c = (color >> 11) << 1;
+	u8 b = (color >> 5) & 0x3F;
+	u8 a = (color << 1) & 0x3F;
+	const u8 clear[] = { SSD1331_CLEAR, xs, ys, xe, ye };
+	const u8 rect[] = { SSD1331_DRAW_RECT, xs, ys, xe, ye,
+			    c, b, a, c, b, a };
+	u16 delay = SSD1331_DRAW_US((xe - xs + 1) * (ye - ys + 1));
+
+	if (!color)
+		return accel_add(par, clear, sizeof(clear), delay);
+
+	return accel_add(par, rect, sizeof(rect), delay);
+}
+
+/* Stream a block of the clip through txbuf */
+static int accel_write_pixels(struct fbtft_par *par,
+			      const struct ssd1331_clip *clip,
+			      int xs, int ys, int xe, int ye)
+{
+	const u8 win[] = { 0x15, xs, xe, 0x75, ys, ye };
+	size_t max = par->txbuf.len / 2, num = 0;
+	u8 *txbuf8 = par->txbuf.buf;
+	int x, y, ret;
+	u16 *line;
+
+	ret = accel_add(par, win, sizeof(win), 0);
+	if (!ret)
+		ret = accel_submit(par);
+	if (ret)
+		return ret;
+
+	gpio_set_value(par->gpio.dc, 1);
+
+	for (y = ys; y <= ye; y++) {
+		line = clip_line(clip, y) - clip->xs;
+		for (x = xs; x <= xe; x++) {
+			put_unaligned_be16(line[x], txbuf8 + num * 2);
+			if (++num < max)
+				continue;
+
+			ret = par->fbtftops.write(par, txbuf8, num * 2);
+			if (ret < 0)
+				return ret;
+			num = 0;
+		}
+	}
+
+	if (num) {
+		ret = par->fbtftops.write(par, txbuf8, num * 2);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Send the lines as pixels, only the columns that changed */
+static int accel_write_lines(struct fbtft_par *par,
+			     const struct ssd1331_clip *clip, int ys, int ye)
+{
+	struct ssd1331_accel *accel = par->extra;
+	int left = clip->w, right = -1;
+	u16 *line, *prev;
+	int x, y;
+
+	for (y = ys; y <= ye; y++) {
+		line = clip_line(clip, y);
+		prev = shadow_line(accel, clip, y);
+		for (x = 0; x < left; x++)
+			if (line[x] != prev[x])
+				left = x;
+		for (x = clip->w - 1; x > right; x--)
+			if (line[x] != prev[x])
+				right = x;
+	}
+
+	if (right < left)
+		return 0;
+
+	return accel_write_pixels(par, clip, clip->xs + left, ys,
+				  clip->xs + right, ye);
+}
+
+static int accel_flush(struct fbtft_par *par, const struct ssd1331_clip *clip)
+{
+	struct ssd1331_accel *accel = par->extra;
+	int y, run, start, end, dy;
+	u8 class;
+	int ret;
+
+	for (y = clip->ys; y <= clip->ye; y++) {
+		if (clip_line_equal(accel, clip, y, y))
+			accel->class[y] = SSD1331_LINE_SAME;
+		else if (clip_line_solid(clip, y, &accel->color[y]))
+			accel->class[y] = SSD1331_LINE_SOLID;
+		else
+			accel->class[y] = SSD1331_LINE_PIXELS;
+	}
+
+	if (accel_find_move(accel, clip, &start, &end, &dy)) {
+		const u8 copy[] = {
+			SSD1331_COPY, clip->xs, start + dy, clip->xe,
+			end - 1 + dy, clip->xs, start,
+		};
+
+		ret = accel_add(par, copy, sizeof(copy),
+				SSD1331_DRAW_US((end - start) * clip->w));
+		if (ret)
+			return ret;
+
+		for (y = start; y < end; y++)
+			accel->class[y] = SSD1331_LINE_MOVED;
+	}
+
+	for (y = clip->ys; y <= clip->ye; y += run) {
+		class = accel->class[y];
+		for (run = 1; y + run <= clip->ye &&
+		     accel->class[y + run] == class &&
+		     (class != SSD1331_LINE_SOLID ||
+		      accel->color[y + run] == accel->color[y]); run++)
+			;
+
+		/* Small fills are cheaper as pixels */
+		if (class == SSD1331_LINE_SOLID &&
+		    run * clip->w < SSD1331_ACCEL_MIN_PIXELS)
+			memset(accel->class + y, SSD1331_LINE_PIXELS, run);
+	}
+
+	/* Draw commands first, they're queued in one message */
+	for (y = clip->ys; y <= clip->ye; y += run) {
+		for (run = 1; y + run <= clip->ye &&
+		     accel->class[y + run] == accel->class[y] &&
+		     accel->color[y + run] == accel->color[y]; run++)
+			;
+
+		if (accel->class[y] != SSD1331_LINE_SOLID)
+			continue;
+
+		ret = accel_fill(par, clip->xs, y, clip->xe, y + run - 1,
+				 accel->color[y]);
+		if (ret)
+			return ret;
+	}
+
+	for (y = clip->ys; y <= clip->ye; y += run) {
+		for (run = 1; y + run <= clip->ye &&
+		     accel->class[y + run] == accel->class[y]; run++)
+			;
+
+		if (accel->class[y] != SSD1331_LINE_PIXELS)
+			continue;
+
+		ret = accel_write_lines(par, clip, y, y + run - 1);
+		if (ret)
+			return ret;
+	}
+
+	return accel_submit(par);
+}
+
+static int write_frame(struct fbtft_par *par, int xs, int ys, int xe, int ye,
+		       size_t offset, size_t len)
+{
+	struct ssd1331_accel *accel = par->extra;
+	struct ssd1331_clip clip = {
+		.vmem = par->info->screen_buffer + offset,
+		.xs = xs,
+		.ys = ys,
+		.xe = xe,
+		.ye = ye,
+		.w = xe - xs + 1,
+	};
+	int y, ret;
+
+	if (accel && accel->valid) {
+		fbtft_frame_begin(par);
+		ret = accel_flush(par, &clip);
+	} else {
+		par->fbtftops.set_addr_win(par, xs, ys, xe, ye);
+		ret = par->fbtftops.write_vmem(par, offset, len);
+	}
+
+	if (!accel)
+		return ret;
+
+	if (ret) {
+		accel->valid = false;
+		return ret;
+	}
+
+	for (y = ys; y <= ye; y++)
+		memcpy(shadow_line(accel, &clip, y), clip_line(&clip, y),
+		       clip.w * sizeof(u16));
+
+	if (!xs && !ys && xe == WIDTH - 1 && ye == HEIGHT - 1)
+		accel->valid = true;
+
+	return 0;
+}
+
 static int init_display(struct fbtft_par *par)
 {
 	par->fbtftops.reset(par);
@@ -45,9 +444,10 @@ static int init_display(struct fbtft_par *par)
 	write_reg(par, 0x81, 0x91); /* Contrast A */
 	write_reg(par, 0x82, 0x50); /* Contrast B */
 	write_reg(par, 0x83, 0x7d); /* Contrast C */
+	write_reg(par, SSD1331_FILL, SSD1331_FILL_ENABLE);
 	write_reg(par, 0xaf); /* Set Sleep Mode Display On */
 
-	return 0;
+	return accel_init(par);
 }
 
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
@@ -56,49 +456,32 @@ static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 	write_reg(par, 0x75, ys, ye);
 }
 
+/* Command arguments are commands too, so it's all sent with D/C low */
 static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 {
 	va_list args;
 	int i, ret;
 	u8 *buf = par->buf;
 
-	if (unlikely(par->debug & DEBUG_WRITE_REGISTER)) {
-		va_start(args, len);
-		for (i = 0; i < len; i++)
-			buf[i] = (u8)va_arg(args, unsigned int);
-		va_end(args);
-		fbtft_par_dbg_hex(DEBUG_WRITE_REGISTER, par, par->info->device, u8, buf, len, "%s: ", __func__);
-	}
-
 	va_start(args, len);
+	for (i = 0; i < len; i++)
+		buf[i] = (u8)va_arg(args, unsigned int);
+	va_end(args);
+
+	if (unlikely(par->debug & DEBUG_WRITE_REGISTER))
+		fbtft_par_dbg_hex(DEBUG_WRITE_REGISTER, par, par->info->device,
+				  u8, buf, len, "%s: ", __func__);
 
-	*buf = (u8)va_arg(args, unsigned int);
 	if (par->gpio.dc != -1)
 		gpio_set_value(par->gpio.dc, 0);
-	ret = par->fbtftops.write(par, par->buf, sizeof(u8));
-	if (ret < 0) {
-		va_end(args);
+
+	ret = fbtft_write_cmd_bytes(par, par->buf, len);
+	if (ret < 0)
 		dev_err(par->info->device,
 			"write() failed and returned %d\n", ret);
-		return;
-	}
-	len--;
-
-	if (len) {
-		i = len;
-		while (i--)
-			*buf++ = (u8)va_arg(args, unsigned int);
-		ret = par->fbtftops.write(par, par->buf, len * (sizeof(u8)));
-		if (ret < 0) {
-			va_end(args);
-			dev_err(par->info->device,
-				"write() failed and returned %d\n", ret);
-			return;
-		}
-	}
+
 	if (par->gpio.dc != -1)
 		gpio_set_value(par->gpio.dc, 1);
-	va_end(args);
 }
 
 /*
@@ -175,8 +558,12 @@ static struct fbtft_display display = {
 	.gamma_num = GAMMA_NUM,
 	.gamma_len = GAMMA_LEN,
 	.gamma = DEFAULT_GAMMA,
+	.reset_assert_us = 3,
+	.reset_settle_ms = 1,
+	.partial_width = true,
 	.fbtftops = {
 		.write_register = write_reg8_bus8,
+		.write_frame = write_frame,
 		.init_display = init_display,
 		.set_addr_win = set_addr_win,
 		.set_gamma = set_gamma,
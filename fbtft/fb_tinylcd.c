@@ -50,7 +50,7 @@ static int init_display(struct fbtft_par *par)
 			     0x00, 0x35, 0x33, 0x00, 0x00, 0x00);
 	write_reg(par, MIPI_DCS_SET_PIXEL_FORMAT, 0x55);
 	write_reg(par, MIPI_DCS_EXIT_SLEEP_MODE);
-	udelay(250);
+	usleep_range(250, 500);
 	write_reg(par, MIPI_DCS_SET_DISPLAY_ON);
 
 	return 0;
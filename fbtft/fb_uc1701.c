@@ -75,7 +75,7 @@ static int init_display(struct fbtft_par *par)
 
 	/* softreset of LCD */
 	write_reg(par, LCD_RESET_CMD);
-	mdelay(10);
+	tinydrm_msleep(10);
 
 	/* set startpoint */
 	write_reg(par, LCD_START_LINE);
@@ -14,6 +14,7 @@
  * GNU General Public License for more details.
  */
 
+#include <asm/unaligned.h>
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
@@ -26,7 +27,7 @@
 #define WIDTH			320
 #define HEIGHT			240
 #define FPS			5
-#define TXBUFLEN		1024
+#define TXBUFLEN		4096
 #define DEFAULT_BRIGHTNESS	50
 
 #define CMD_VERSION		0x01
@@ -65,75 +66,126 @@ static void write_reg8_bus8(struct fbtft_par *par, int len, ...)
 	}
 }
 
-static int write_vmem(struct fbtft_par *par, size_t offset, size_t len)
+/*
+ * DRAWIMAGE header: command, x, y, w, h (big endian) and the color mode.
+ * write_vmem() sends the window as few commands as the transmit buffer allows.
+ */
+#define DRAWIMAGE_HDR_LEN	10
+
+/* The firmware needs time to draw, it was 300us/700us per 320 pixel line */
+#define DRAWIMAGE_DELAY_US(pixels) \
+	DIV_ROUND_UP((pixels) * (mode == 332 ? 700 : 300), WIDTH)
+
+/*
+ * The window from set_addr_win(). Each write_vmem() call continues where the
+ * previous one stopped, the splash comes in chunks that can end mid-line.
+ */
+struct watterott_win {
+	unsigned int x, y, w, h;
+	/* Start of a line split between two calls, WIDTH is the longer side */
+	u16 line[WIDTH];
+	unsigned int line_len;
+};
+
+/* RGB332 from the high byte of RGB565, the blue bits come from the low byte */
+static u8 rgb332_lut[256];
+
+static void rgb332_lut_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++)
+		rgb332_lut[i] = (i & 0xE0) | ((i & 0x07) << 2);
+}
+
+/* Send @h full lines at the top of the window and move the window down */
+static int write_lines(struct fbtft_par *par, struct watterott_win *win,
+		       const u16 *vmem16, unsigned int h)
 {
-	unsigned int start_line, end_line;
-	u16 *vmem16 = (u16 *)(par->info->screen_buffer + offset);
-	u16 *pos = par->txbuf.buf + 1;
-	u16 *buf16 = par->txbuf.buf + 10;
-	int i, j;
-	int ret = 0;
-
-	start_line = offset / par->info->fix.line_length;
-	end_line = start_line + (len / par->info->fix.line_length) - 1;
-
-	/* Set command header. pos: x, y, w, h */
-	((u8 *)par->txbuf.buf)[0] = CMD_LCD_DRAWIMAGE;
-	pos[0] = 0;
-	pos[2] = cpu_to_be16(par->info->var.xres);
-	pos[3] = cpu_to_be16(1);
-	((u8 *)par->txbuf.buf)[9] = COLOR_RGB565;
-
-	for (i = start_line; i <= end_line; i++) {
-		pos[1] = cpu_to_be16(i);
-		for (j = 0; j < par->info->var.xres; j++)
-			buf16[j] = cpu_to_be16(*vmem16++);
-		ret = par->fbtftops.write(par,
-			par->txbuf.buf, 10 + par->info->fix.line_length);
+	u8 *txbuf8 = par->txbuf.buf;
+	u8 *buf8 = txbuf8 + DRAWIMAGE_HDR_LEN;
+	size_t bpp = mode == 332 ? 1 : 2;
+	unsigned int lines, num, i;
+	int ret;
+
+	lines = (par->txbuf.len - DRAWIMAGE_HDR_LEN) / (win->w * bpp);
+	if (!lines)
+		return -EINVAL;
+
+	txbuf8[0] = CMD_LCD_DRAWIMAGE;
+	put_unaligned_be16(win->x, txbuf8 + 1);
+	put_unaligned_be16(win->w, txbuf8 + 5);
+	txbuf8[9] = mode == 332 ? COLOR_RGB332 : COLOR_RGB565;
+
+	h = min(h, win->h);
+	while (h) {
+		lines = min(lines, h);
+		num = lines * win->w;
+
+		put_unaligned_be16(win->y, txbuf8 + 3);
+		put_unaligned_be16(lines, txbuf8 + 7);
+
+		if (mode == 332) {
+			for (i = 0; i < num; i++)
+				buf8[i] = rgb332_lut[vmem16[i] >> 8] |
+					  ((vmem16[i] >> 3) & 0x03);
+		} else {
+			for (i = 0; i < num; i++)
+				put_unaligned_be16(vmem16[i], buf8 + i * 2);
+		}
+
+		ret = par->fbtftops.write(par, txbuf8,
+					  DRAWIMAGE_HDR_LEN + num * bpp);
 		if (ret < 0)
 			return ret;
-		udelay(300);
+
+		usleep_range(DRAWIMAGE_DELAY_US(num),
+			     DRAWIMAGE_DELAY_US(num) + 100);
+
+		vmem16 += num;
+		win->y += lines;
+		win->h -= lines;
+		h -= lines;
 	}
 
 	return 0;
 }
 
-#define RGB565toRGB323(c) (((c&0xE000)>>8) | ((c&0600)>>6) | ((c&0x001C)>>2))
-#define RGB565toRGB332(c) (((c&0xE000)>>8) | ((c&0700)>>6) | ((c&0x0018)>>3))
-#define RGB565toRGB233(c) (((c&0xC000)>>8) | ((c&0700)>>5) | ((c&0x001C)>>2))
-
-static int write_vmem_8bit(struct fbtft_par *par, size_t offset, size_t len)
+static int write_vmem(struct fbtft_par *par, size_t offset, size_t len)
 {
-	unsigned int start_line, end_line;
-	u16 *vmem16 = (u16 *)(par->info->screen_buffer + offset);
-	u16 *pos = par->txbuf.buf + 1;
-	u8 *buf8 = par->txbuf.buf + 10;
-	int i, j;
-	int ret = 0;
-
-	start_line = offset / par->info->fix.line_length;
-	end_line = start_line + (len / par->info->fix.line_length) - 1;
-
-	/* Set command header. pos: x, y, w, h */
-	((u8 *)par->txbuf.buf)[0] = CMD_LCD_DRAWIMAGE;
-	pos[0] = 0;
-	pos[2] = cpu_to_be16(par->info->var.xres);
-	pos[3] = cpu_to_be16(1);
-	((u8 *)par->txbuf.buf)[9] = COLOR_RGB332;
-
-	for (i = start_line; i <= end_line; i++) {
-		pos[1] = cpu_to_be16(i);
-		for (j = 0; j < par->info->var.xres; j++) {
-			buf8[j] = RGB565toRGB332(*vmem16);
-			vmem16++;
-		}
-		ret = par->fbtftops.write(par,
-			par->txbuf.buf, 10 + par->info->var.xres);
-		if (ret < 0)
+	const u16 *vmem16 = (u16 *)(par->info->screen_buffer + offset);
+	struct watterott_win *win = par->extra;
+	size_t num = len / 2;
+	unsigned int n;
+	int ret;
+
+	if (!win || !win->w)
+		return -EINVAL;
+
+	/* Finish the line the previous call left incomplete */
+	if (win->line_len) {
+		n = min_t(size_t, win->w - win->line_len, num);
+		memcpy(win->line + win->line_len, vmem16, n * 2);
+		win->line_len += n;
+		vmem16 += n;
+		num -= n;
+		if (win->line_len < win->w)
+			return 0;
+
+		win->line_len = 0;
+		ret = write_lines(par, win, win->line, 1);
+		if (ret)
 			return ret;
-		udelay(700);
 	}
 
+	ret = write_lines(par, win, vmem16, num / win->w);
+	if (ret)
+		return ret;
+
+	/* Keep a partial line for the next call */
+	win->line_len = win->h ? num % win->w : 0;
+	memcpy(win->line, vmem16 + num - win->line_len, win->line_len * 2);
+
 	return 0;
 }
 
@@ -165,9 +217,9 @@ static int init_display(struct fbtft_par *par)
 	}
 	write_reg(par, 0x00); /* make sure mode is set */
 
-	mdelay(50);
+	tinydrm_msleep(50);
 	par->fbtftops.reset(par);
-	mdelay(1000);
+	tinydrm_msleep(1000);
 	par->spi->mode = save_mode;
 	ret = spi_setup(par->spi);
 	if (ret) {
@@ -181,13 +233,28 @@ static int init_display(struct fbtft_par *par)
 						version >> 8, version & 0xFF);
 
 	if (mode == 332)
-		par->fbtftops.write_vmem = write_vmem_8bit;
+		rgb332_lut_init();
+
+	if (!par->extra) {
+		par->extra = devm_kzalloc(par->info->device,
+					  sizeof(struct watterott_win),
+					  GFP_KERNEL);
+		if (!par->extra)
+			return -ENOMEM;
+	}
+
 	return 0;
 }
 
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 {
-	/* not used on this controller */
+	struct watterott_win *win = par->extra;
+
+	win->x = xs;
+	win->y = ys;
+	win->w = xe - xs + 1;
+	win->h = ye - ys + 1;
+	win->line_len = 0;
 }
 
 static int set_var(struct fbtft_par *par)
@@ -282,6 +349,7 @@ static struct fbtft_display display = {
 	.height = HEIGHT,
 	.fps = FPS,
 	.txbuflen = TXBUFLEN,
+	.partial_width = true,
 	.fbtftops = {
 		.write_register = write_reg8_bus8,
 		.write_vmem = write_vmem,
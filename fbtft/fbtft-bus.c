@@ -2,6 +2,8 @@
 #include <linux/errno.h>
 #include <linux/gpio.h>
 #include <linux/spi/spi.h>
+#include <asm/unaligned.h>
+#include <video/mipi_display.h>
 #include "fbtft.h"
 
 /*****************************************************************************
@@ -38,7 +40,7 @@ void func(struct fbtft_par *par, int len, ...)                                \
 	*buf = modifier((type)va_arg(args, unsigned int));                    \
 	if (par->gpio.dc != -1)                                               \
 		gpio_set_value(par->gpio.dc, 0);                              \
-	ret = par->fbtftops.write(par, par->buf, sizeof(type) + offset);      \
+	ret = fbtft_write_cmd_bytes(par, par->buf, sizeof(type) + offset);    \
 	if (ret < 0) {                                                        \
 		va_end(args);                                                 \
 		dev_err(par->info->device, "%s: write() failed and returned %d\n", __func__, ret); \
@@ -56,7 +58,7 @@ void func(struct fbtft_par *par, int len, ...)                                \
 		}                                                             \
 		if (par->gpio.dc != -1)                                       \
 			gpio_set_value(par->gpio.dc, 1);                      \
-		ret = par->fbtftops.write(par, par->buf,		      \
+		ret = fbtft_write_cmd_bytes(par, par->buf,		      \
 					  len * (sizeof(type) + offset));     \
 		if (ret < 0) {                                                \
 			va_end(args);                                         \
@@ -76,7 +78,6 @@ void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...)
 {
 	va_list args;
 	int i, ret;
-	int pad = 0;
 	u16 *buf = (u16 *)par->buf;
 
 	if (drm_debug & DRM_UT_DRIVER) {
@@ -90,15 +91,6 @@ void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...)
 	if (len <= 0)
 		return;
 
-	if (par->spi && (par->spi->bits_per_word == 8)) {
-		/* we're emulating 9-bit, pad start of buffer with no-ops
-		 * (assuming here that zero is a no-op)
-		 */
-		pad = (len % 4) ? 4 - (len % 4) : 0;
-		for (i = 0; i < pad; i++)
-			*buf++ = 0x000;
-	}
-
 	va_start(args, len);
 	*buf++ = (u8)va_arg(args, unsigned int);
 	i = len - 1;
@@ -107,7 +99,7 @@ void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...)
 		*buf++ |= 0x100; /* dc=1 */
 	}
 	va_end(args);
-	ret = par->fbtftops.write(par, par->buf, (len + pad) * sizeof(u16));
+	ret = fbtft_write_cmd_bytes(par, par->buf, len * sizeof(u16));
 	if (ret < 0) {
 		dev_err(par->info->device,
 			"write() failed and returned %d\n", ret);
@@ -116,6 +108,146 @@ void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...)
 }
 EXPORT_SYMBOL(fbtft_write_reg8_bus9);
 
+/*****************************************************************************
+ *
+ *   int (*write_cmd)(struct fbtft_par *par, u16 cmd, const u16 *params,
+ *                    size_t num);
+ *
+ *****************************************************************************/
+
+/*
+ * The parameters are copied straight from the caller's buffer, there's no
+ * argument list to walk. With a startbyte the values follow it unaligned.
+ */
+#define define_fbtft_write_cmd(func, type, modifier)                          \
+int func(struct fbtft_par *par, u16 cmd, const u16 *params, size_t num)       \
+{                                                                             \
+	size_t offset = par->startbyte ? 1 : 0;                               \
+	u8 *buf = par->buf + offset;                                          \
+	size_t i;                                                             \
+	int ret;                                                              \
+									      \
+	if (num > FBTFT_CMD_MAX_PARAMS)                                       \
+		return -EINVAL;                                               \
+									      \
+	fbtft_par_dbg_hex(DEBUG_WRITE_REGISTER, par, par->info->device, u16, (void *)params, num, "%s: cmd=0x%02X ", __func__, cmd); \
+									      \
+	if (par->startbyte)                                                   \
+		par->buf[0] = par->startbyte;                                 \
+	put_unaligned(modifier((type)cmd), (type *)buf);                      \
+	if (par->gpio.dc != -1)                                               \
+		gpio_set_value(par->gpio.dc, 0);                              \
+	ret = fbtft_write_cmd_bytes(par, par->buf, sizeof(type) + offset);    \
+	if (ret < 0)                                                          \
+		goto err;                                                     \
+									      \
+	if (!num)                                                             \
+		return 0;                                                     \
+									      \
+	if (par->startbyte)                                                   \
+		par->buf[0] = par->startbyte | 0x2;                           \
+	for (i = 0; i < num; i++)                                             \
+		put_unaligned(modifier((type)params[i]),                      \
+			      (type *)(buf + i * sizeof(type)));              \
+	if (par->gpio.dc != -1)                                               \
+		gpio_set_value(par->gpio.dc, 1);                              \
+	ret = fbtft_write_cmd_bytes(par, par->buf, num * sizeof(type) + offset);\
+	if (ret < 0)                                                          \
+		goto err;                                                     \
+									      \
+	return 0;                                                             \
+									      \
+err:                                                                          \
+	dev_err(par->info->device, "%s: write() failed and returned %d\n", __func__, ret); \
+	return ret;                                                           \
+}                                                                             \
+EXPORT_SYMBOL(func);
+
+define_fbtft_write_cmd(fbtft_write_cmd8_bus8, u8, )
+define_fbtft_write_cmd(fbtft_write_cmd16_bus8, u16, cpu_to_be16)
+define_fbtft_write_cmd(fbtft_write_cmd16_bus16, u16, )
+
+/*
+ * On a 9-bit bus the D/C bit travels with each word, so queued commands are
+ * appended to par->cmdq.buf and go out in one write (one SPI message).
+ */
+int fbtft_write_cmd8_bus9(struct fbtft_par *par, u16 cmd, const u16 *params,
+			  size_t num)
+{
+	u16 *buf;
+	size_t i;
+	int ret;
+
+	if (num > FBTFT_CMD_MAX_PARAMS || !par->cmdq.buf)
+		return -EINVAL;
+
+	fbtft_par_dbg_hex(DEBUG_WRITE_REGISTER, par, par->info->device, u16,
+			  (void *)params, num, "%s: cmd=0x%02X ", __func__, cmd);
+
+	if (par->cmdq.len + 1 + num > FBTFT_CMDQ_WORDS) {
+		ret = fbtft_cmd_queue_flush(par);
+		if (ret)
+			return ret;
+		fbtft_cmd_queue_begin(par);
+	}
+
+	buf = par->cmdq.buf + par->cmdq.len;
+	*buf++ = cmd & 0xFF;
+	for (i = 0; i < num; i++)
+		*buf++ = (params[i] & 0xFF) | 0x100; /* dc=1 */
+	par->cmdq.len += 1 + num;
+
+	if (par->cmdq.active)
+		return 0;
+
+	return fbtft_cmd_queue_flush(par);
+}
+EXPORT_SYMBOL(fbtft_write_cmd8_bus9);
+
+/**
+ * fbtft_cmd_queue_begin - Start queuing commands
+ * @par: Driver data
+ *
+ * Commands written with &fbtft_ops->write_cmd after this call are held back
+ * until fbtft_cmd_queue_flush() where the bus allows it. That's the case on
+ * a 9-bit bus. Buses that signal D/C with a gpio or a startbyte need a
+ * separate write per phase and write the commands immediately.
+ */
+void fbtft_cmd_queue_begin(struct fbtft_par *par)
+{
+	par->cmdq.active = true;
+}
+EXPORT_SYMBOL(fbtft_cmd_queue_begin);
+
+/**
+ * fbtft_cmd_queue_flush - Submit the queued commands
+ * @par: Driver data
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int fbtft_cmd_queue_flush(struct fbtft_par *par)
+{
+	unsigned int len = par->cmdq.len;
+	int ret;
+
+	par->cmdq.active = false;
+	if (!len)
+		return 0;
+
+	par->cmdq.len = 0;
+
+	ret = fbtft_write_cmd_bytes(par, par->cmdq.buf, len * sizeof(u16));
+	if (ret < 0) {
+		dev_err(par->info->device,
+			"write() failed and returned %d\n", ret);
+		return ret;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_cmd_queue_flush);
+
 /*****************************************************************************
  *
  *   int (*write_vmem)(struct fbtft_par *par);
@@ -126,7 +258,7 @@ EXPORT_SYMBOL(fbtft_write_reg8_bus9);
 int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 {
 	u16 *vmem16;
-	u16 *txbuf16 = par->txbuf.buf;
+	u8 *txbuf8 = par->txbuf.buf;
 	size_t remain;
 	size_t to_copy;
 	size_t tx_array_size;
@@ -150,8 +282,9 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 	/* buffered write */
 	tx_array_size = par->txbuf.len / 2;
 
+	/* The pixels follow the startbyte at an odd address */
 	if (par->startbyte) {
-		txbuf16 = par->txbuf.buf + 1;
+		txbuf8 = par->txbuf.buf + 1;
 		tx_array_size -= 2;
 		*(u8 *)(par->txbuf.buf) = par->startbyte | 0x2;
 		startbyte_size = 1;
@@ -163,7 +296,7 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 						to_copy, remain - to_copy);
 
 		for (i = 0; i < to_copy; i++)
-			txbuf16[i] = cpu_to_be16(vmem16[i]);
+			put_unaligned_be16(vmem16[i], txbuf8 + i * 2);
 
 		vmem16 = vmem16 + to_copy;
 		ret = par->fbtftops.write(par, par->txbuf.buf,
@@ -199,7 +332,8 @@ int fbtft_write_vmem16_bus9(struct fbtft_par *par, size_t offset, size_t len)
 	remain = len;
 	vmem8 = par->info->screen_buffer + offset;
 
-	tx_array_size = par->txbuf.len / 2;
+	/* Whole 8-word groups, the 8-bit emulation pads only the last write */
+	tx_array_size = round_down(par->txbuf.len / 2, 8);
 
 	while (remain) {
 		to_copy = min(tx_array_size, remain);
@@ -243,3 +377,193 @@ int fbtft_write_vmem16_bus16(struct fbtft_par *par, size_t offset, size_t len)
 	return par->fbtftops.write(par, vmem16, len);
 }
 EXPORT_SYMBOL(fbtft_write_vmem16_bus16);
+
+/*****************************************************************************
+ *
+ *   int (*write_frame)(struct fbtft_par *par, int xs, int ys, int xe,
+ *                      int ye, size_t offset, size_t len);
+ *
+ *****************************************************************************/
+
+/* The window and WRITE_MEMORY_START, FBTFT_FRAME_WIN_WORDS 9-bit words */
+static u16 *fbtft_frame_win9(u16 *buf, int xs, int ys, int xe, int ye)
+{
+	*buf++ = MIPI_DCS_SET_COLUMN_ADDRESS;
+	*buf++ = 0x100 | ((xs >> 8) & 0xFF);
+	*buf++ = 0x100 | (xs & 0xFF);
+	*buf++ = 0x100 | ((xe >> 8) & 0xFF);
+	*buf++ = 0x100 | (xe & 0xFF);
+	*buf++ = MIPI_DCS_SET_PAGE_ADDRESS;
+	*buf++ = 0x100 | ((ys >> 8) & 0xFF);
+	*buf++ = 0x100 | (ys & 0xFF);
+	*buf++ = 0x100 | ((ye >> 8) & 0xFF);
+	*buf++ = 0x100 | (ye & 0xFF);
+	*buf++ = MIPI_DCS_WRITE_MEMORY_START;
+
+	return buf;
+}
+
+/*
+ * 16 bit pixel over 9-bit SPI bus, the window and the pixels are built in
+ * one buffer and sent as one message, each part at its own clock.
+ */
+int fbtft_write_frame_bus9(struct fbtft_par *par, int xs, int ys, int xe,
+			   int ye, size_t offset, size_t len)
+{
+	u16 *vmem16 = par->info->screen_buffer + offset;
+	u16 *buf = par->frame.buf;
+	size_t i;
+	int ret;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
+		      __func__, offset, len);
+
+	if (FBTFT_FRAME_WIN_WORDS + len > par->frame.len / 2)
+		return -EINVAL;
+
+	buf = fbtft_frame_win9(buf, xs, ys, xe, ye);
+
+	/* dc + high byte, dc + low byte */
+	for (i = 0; i < len / 2; i++) {
+		*buf++ = 0x100 | (vmem16[i] >> 8);
+		*buf++ = 0x100 | (vmem16[i] & 0xFF);
+	}
+
+	fbtft_frame_begin(par);
+	ret = fbtft_frame_add_buf(par, par->frame.buf,
+				  FBTFT_FRAME_WIN_WORDS * 2, 0,
+				  fbtft_cmd_hz(par));
+	if (ret)
+		return ret;
+
+	ret = fbtft_frame_add_buf(par, (u16 *)par->frame.buf +
+				  FBTFT_FRAME_WIN_WORDS, len * 2, 0,
+				  fbtft_pixel_hz(par));
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+EXPORT_SYMBOL(fbtft_write_frame_bus9);
+
+/*
+ * 16 bit pixel over 9-bit SPI emulated with 8-bit words. The window and the
+ * pixels are packed straight into the bitstream in the frame buffer, there's
+ * no intermediate buffer of 9-bit words. FBTFT_FRAME_WIN_PAD no-ops in front
+ * of the window make the pixels start on a group boundary.
+ */
+int fbtft_write_frame_bus9_emulate(struct fbtft_par *par, int xs, int ys,
+				   int xe, int ye, size_t offset, size_t len)
+{
+	u16 win[FBTFT_FRAME_WIN_PAD + FBTFT_FRAME_WIN_WORDS] = { 0 };
+	u16 *vmem16 = par->info->screen_buffer + offset;
+	u8 *buf = par->frame.buf;
+	size_t win_len;
+	int ret;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
+		      __func__, offset, len);
+
+	if (ARRAY_SIZE(win) / 8 * 9 + DIV_ROUND_UP(len / 2, 4) * 9 >
+	    par->frame.len)
+		return -EINVAL;
+
+	fbtft_frame_win9(&win[FBTFT_FRAME_WIN_PAD], xs, ys, xe, ye);
+	win_len = fbtft_pack9(buf, win, ARRAY_SIZE(win));
+	buf += win_len;
+	buf += fbtft_pack9_rgb565(buf, vmem16, len / 2);
+
+	fbtft_frame_begin(par);
+	ret = fbtft_frame_add_buf(par, par->frame.buf, win_len, 8,
+				  fbtft_cmd_hz(par));
+	if (ret)
+		return ret;
+
+	ret = fbtft_frame_add_buf(par, par->frame.buf + win_len,
+				  buf - (u8 *)par->frame.buf - win_len, 8,
+				  fbtft_pixel_hz(par));
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+EXPORT_SYMBOL(fbtft_write_frame_bus9_emulate);
+
+static int fbtft_frame_add_cmd_sb(struct fbtft_par *par, u8 cmd,
+				  const u8 *params, size_t num)
+{
+	u8 buf[5] = { par->startbyte, cmd };
+	int ret;
+
+	ret = fbtft_frame_add_hdr(par, buf, 2, fbtft_cmd_hz(par), 0, true);
+	if (ret || !num)
+		return ret;
+
+	buf[0] = par->startbyte | 0x2;
+	memcpy(&buf[1], params, num);
+
+	return fbtft_frame_add_hdr(par, buf, num + 1, fbtft_cmd_hz(par), 0,
+				   true);
+}
+
+/*
+ * 16 bit pixel over 8-bit databus with a startbyte, each command and
+ * parameter phase gets its own startbyte and chip select cycle. The pixels
+ * are sent in place as 16-bit words if the controller supports it,
+ * otherwise they're byte swapped into the frame buffer.
+ */
+int fbtft_write_frame_startbyte(struct fbtft_par *par, int xs, int ys, int xe,
+				int ye, size_t offset, size_t len)
+{
+	u16 *vmem16 = par->info->screen_buffer + offset;
+	u8 sb = par->startbyte | 0x2;
+	u8 win[4];
+	size_t i;
+	int ret;
+
+	fbtft_par_dbg(DEBUG_WRITE_VMEM, par, "%s(offset=%zu, len=%zu)\n",
+		      __func__, offset, len);
+
+	fbtft_frame_begin(par);
+
+	win[0] = (xs >> 8) & 0xFF;
+	win[1] = xs & 0xFF;
+	win[2] = (xe >> 8) & 0xFF;
+	win[3] = xe & 0xFF;
+	ret = fbtft_frame_add_cmd_sb(par, MIPI_DCS_SET_COLUMN_ADDRESS, win, 4);
+	if (ret)
+		return ret;
+
+	win[0] = (ys >> 8) & 0xFF;
+	win[1] = ys & 0xFF;
+	win[2] = (ye >> 8) & 0xFF;
+	win[3] = ye & 0xFF;
+	ret = fbtft_frame_add_cmd_sb(par, MIPI_DCS_SET_PAGE_ADDRESS, win, 4);
+	if (ret)
+		return ret;
+
+	ret = fbtft_frame_add_cmd_sb(par, MIPI_DCS_WRITE_MEMORY_START, NULL, 0);
+	if (ret)
+		return ret;
+
+	ret = fbtft_frame_add_hdr(par, &sb, 1, fbtft_pixel_hz(par), 0, false);
+	if (ret)
+		return ret;
+
+	if (!par->frame.buf) {
+		ret = fbtft_frame_add_buf(par, vmem16, len, 16,
+					  fbtft_pixel_hz(par));
+	} else {
+		if (len > par->frame.len)
+			return -EINVAL;
+		for (i = 0; i < len / 2; i++)
+			((__be16 *)par->frame.buf)[i] = cpu_to_be16(vmem16[i]);
+		ret = fbtft_frame_add_buf(par, par->frame.buf, len, 8,
+					  fbtft_pixel_hz(par));
+	}
+	if (ret)
+		return ret;
+
+	return fbtft_frame_submit(par);
+}
+EXPORT_SYMBOL(fbtft_write_frame_startbyte);
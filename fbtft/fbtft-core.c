@@ -16,17 +16,25 @@
  * GNU General Public License for more details.
  */
 
+#include <asm/unaligned.h>
 #include <linux/backlight.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/gpio.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/of_gpio.h>
 #include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/spi/spi.h>
 #include <linux/string.h>
+#include <linux/workqueue.h>
+#include <drm/drm_crtc_helper.h>
 #include <video/mipi_display.h>
 
 #include "fbtft.h"
@@ -83,8 +91,10 @@ static int fbtft_request_one_gpio(struct fbtft_par *par,
 		return ret;
 	}
 
+	/* fbtft drives raw levels, flip the logical value back */
 	if (gpiod_is_active_low(desc))
-		gpiod_set_value_cansleep(desc, flags & GPIOD_OUT_LOW ? 1 : 0);
+		gpiod_set_value_cansleep(desc,
+					 !(flags & GPIOD_FLAGS_BIT_DIR_VAL));
 
 	*gpiop = desc_to_gpio(desc);
 	DRM_DEBUG_DRIVER("'%s' = GPIO%d\n", name, *gpiop);
@@ -96,8 +106,10 @@ static int fbtft_request_gpios(struct fbtft_par *par)
 {
 	int i, gpio, ret;
 
+	/* Requesting reset low would reset a controller we want to adopt */
 	ret = fbtft_request_one_gpio(par, "reset", 0, &par->gpio.reset,
-				     GPIOD_OUT_LOW);
+				     par->adopt ? GPIOD_OUT_HIGH :
+						  GPIOD_OUT_LOW);
 	if (ret)
 		return ret;
 
@@ -310,9 +322,10 @@ static void fbtft_reset(struct fbtft_par *par)
 		return;
 	fbtft_par_dbg(DEBUG_RESET, par, "%s()\n", __func__);
 	gpio_set_value_cansleep(par->gpio.reset, 0);
-	usleep_range(20, 40);
+	usleep_range(par->display.reset_assert_us,
+		     2 * par->display.reset_assert_us);
 	gpio_set_value_cansleep(par->gpio.reset, 1);
-	msleep(120);
+	tinydrm_msleep(par->display.reset_settle_ms);
 }
 
 static int fbtft_verify_gpios(struct fbtft_par *par)
@@ -336,7 +349,7 @@ static int fbtft_verify_gpios(struct fbtft_par *par)
 		return -EINVAL;
 	}
 
-	if (!par->gpio.db) {
+	if (IS_ERR_OR_NULL(par->gpio.db)) {
 		dev_err(dev, "Missing 'db' gpios.\n");
 		return -EINVAL;
 	}
@@ -347,222 +360,395 @@ static int fbtft_verify_gpios(struct fbtft_par *par)
 		return -EINVAL;
 	}
 
+	if (par->gpio.db->ndescs != par->display.buswidth) {
+		dev_err(dev, "buswidth=%u doesn't match %u 'db' gpios.\n",
+			par->display.buswidth, par->gpio.db->ndescs);
+		return -EINVAL;
+	}
+
 	return 0;
 }
 
-#ifdef CONFIG_OF
-/**
- * fbtft_init_display_dt() - Device Tree init_display() function
- * @par: Driver data
- *
- * Return: 0 if successful, negative if error
+/*
+ * The init sequence, from the Device Tree 'init' property or from
+ * par->init_sequence, is compiled once at probe into a list of commands and
+ * delays. fbtft_init_display_prog() runs the list and can be called again to
+ * re-initialize the controller, for instance on resume.
  */
-static int fbtft_init_display_dt(struct fbtft_par *par)
+static int fbtft_init_compile(struct fbtft_par *par, struct device *dev,
+			      const u32 *vals, unsigned int num_vals)
 {
-	struct device_node *node = par->info->device->of_node;
-	struct property *prop;
-	const __be32 *p;
-	u32 val;
-	int buf[64], i, j;
+	struct fbtft_init_cmd *cmds;
+	unsigned int i, j, num = 0;
+	u16 *words;
 
-	if (!node)
-		return -EINVAL;
+	cmds = devm_kcalloc(dev, num_vals, sizeof(*cmds), GFP_KERNEL);
+	words = devm_kcalloc(dev, num_vals, sizeof(*words), GFP_KERNEL);
+	if (!cmds || !words)
+		return -ENOMEM;
 
-	prop = of_find_property(node, "init", NULL);
-	p = of_prop_next_u32(prop, NULL, &val);
-	if (!p)
-		return -EINVAL;
+	for (i = 0; i < num_vals; i = j) {
+		if (vals[i] & FBTFT_OF_INIT_DELAY) {
+			cmds[num++].delay_ms = vals[i] & 0xFFFF;
+			j = i + 1;
+			continue;
+		}
 
-	par->fbtftops.reset(par);
-	if (par->gpio.cs != -1)
-		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
+		if (!(vals[i] & FBTFT_OF_INIT_CMD)) {
+			dev_err(dev, "illegal init value 0x%X\n", vals[i]);
+			return -EINVAL;
+		}
 
-	while (p) {
-		if (val & FBTFT_OF_INIT_CMD) {
-			val &= 0xFFFF;
-			i = 0;
-			while (p && !(val & 0xFFFF0000)) {
-				if (i > 63) {
-					dev_err(par->info->device,
-					"%s: Maximum register values exceeded\n",
-					__func__);
-					return -EINVAL;
-				}
-				buf[i++] = val;
-				p = of_prop_next_u32(prop, p, &val);
-			}
-			/* make debug message */
-			fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
-				"init: write_register:\n");
-			for (j = 0; j < i; j++)
-				fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
-					      "buf[%d] = %02X\n", j, buf[j]);
-
-			par->fbtftops.write_register(par, i,
-				buf[0], buf[1], buf[2], buf[3],
-				buf[4], buf[5], buf[6], buf[7],
-				buf[8], buf[9], buf[10], buf[11],
-				buf[12], buf[13], buf[14], buf[15],
-				buf[16], buf[17], buf[18], buf[19],
-				buf[20], buf[21], buf[22], buf[23],
-				buf[24], buf[25], buf[26], buf[27],
-				buf[28], buf[29], buf[30], buf[31],
-				buf[32], buf[33], buf[34], buf[35],
-				buf[36], buf[37], buf[38], buf[39],
-				buf[40], buf[41], buf[42], buf[43],
-				buf[44], buf[45], buf[46], buf[47],
-				buf[48], buf[49], buf[50], buf[51],
-				buf[52], buf[53], buf[54], buf[55],
-				buf[56], buf[57], buf[58], buf[59],
-				buf[60], buf[61], buf[62], buf[63]);
-		} else if (val & FBTFT_OF_INIT_DELAY) {
-			fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
-				"init: msleep(%u)\n", val & 0xFFFF);
-			msleep(val & 0xFFFF);
-			p = of_prop_next_u32(prop, p, &val);
-		} else {
-			dev_err(par->info->device, "illegal init value 0x%X\n",
-									val);
+		cmds[num].words = words;
+		*words++ = vals[i] & 0xFFFF;
+		for (j = i + 1; j < num_vals && !(vals[j] & 0xFFFF0000); j++)
+			*words++ = vals[j];
+
+		cmds[num].len = j - i;
+		if (cmds[num].len > 64) {
+			dev_err(dev, "%s: Maximum register values exceeded\n",
+				__func__);
 			return -EINVAL;
 		}
+		num++;
 	}
 
+	par->init.cmds = cmds;
+	par->init.num = num;
+
 	return 0;
 }
-#else
-static int fbtft_init_display_dt(struct fbtft_par *par)
+
+static int fbtft_init_compile_dt(struct fbtft_par *par, struct device *dev)
 {
-	return -EINVAL;
+	int ret, num_vals;
+	u32 *vals;
+
+	num_vals = device_property_read_u32_array(dev, "init", NULL, 0);
+	if (num_vals <= 0)
+		return -EINVAL;
+
+	vals = kcalloc(num_vals, sizeof(*vals), GFP_KERNEL);
+	if (!vals)
+		return -ENOMEM;
+
+	ret = device_property_read_u32_array(dev, "init", vals, num_vals);
+	if (!ret)
+		ret = fbtft_init_compile(par, dev, vals, num_vals);
+
+	kfree(vals);
+
+	return ret;
 }
-#endif
 
-/**
- * fbtft_init_display() - Generic init_display() function
- * @par: Driver data
- *
- * Uses par->init_sequence to do the initialization
- *
- * Return: 0 if successful, negative if error
- */
-static int fbtft_init_display(struct fbtft_par *par)
+/* Translate the -1/-2/-3 delimited init_sequence into the DT encoding */
+static int fbtft_init_compile_seq(struct fbtft_par *par, struct device *dev)
 {
-	int buf[64];
-	char msg[128];
-	char str[16];
-	int i = 0;
-	int j;
-
-	/* sanity check */
-	if (!par->init_sequence) {
-		dev_err(par->info->device,
-			"error: init_sequence is not set\n");
-		return -EINVAL;
-	}
+	const s16 *seq = par->init_sequence;
+	unsigned int i, len, num = 0;
+	u32 *vals;
+	int ret;
 
 	/* make sure stop marker exists */
-	for (i = 0; i < FBTFT_MAX_INIT_SEQUENCE; i++)
-		if (par->init_sequence[i] == -3)
+	for (len = 0; len < FBTFT_MAX_INIT_SEQUENCE; len++)
+		if (seq[len] == -3)
 			break;
-	if (i == FBTFT_MAX_INIT_SEQUENCE) {
-		dev_err(par->info->device,
-			"missing stop marker at end of init sequence\n");
+	if (len == FBTFT_MAX_INIT_SEQUENCE) {
+		dev_err(dev, "missing stop marker at end of init sequence\n");
 		return -EINVAL;
 	}
 
-	par->fbtftops.reset(par);
-	if (par->gpio.cs != -1)
-		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
+	vals = kcalloc(len, sizeof(*vals), GFP_KERNEL);
+	if (!vals)
+		return -ENOMEM;
 
-	i = 0;
-	while (i < FBTFT_MAX_INIT_SEQUENCE) {
-		if (par->init_sequence[i] == -3) {
-			/* done */
-			return 0;
-		}
-		if (par->init_sequence[i] >= 0) {
-			dev_err(par->info->device,
-				"missing delimiter at position %d\n", i);
-			return -EINVAL;
+	for (i = 0; i < len; i++) {
+		if (seq[i] >= 0) {
+			if (!num) {
+				dev_err(dev, "missing delimiter at position %u\n",
+					i);
+				ret = -EINVAL;
+				goto out_free;
+			}
+			vals[num++] = seq[i];
+			continue;
 		}
-		if (par->init_sequence[i + 1] < 0) {
-			dev_err(par->info->device,
-				"missing value after delimiter %d at position %d\n",
-				par->init_sequence[i], i);
-			return -EINVAL;
+
+		if (i + 1 == len || seq[i + 1] < 0) {
+			dev_err(dev,
+				"missing value after delimiter %d at position %u\n",
+				seq[i], i);
+			ret = -EINVAL;
+			goto out_free;
 		}
-		switch (par->init_sequence[i]) {
+
+		switch (seq[i]) {
 		case -1:
-			i++;
-			/* make debug message */
-			strcpy(msg, "");
-			j = i + 1;
-			while (par->init_sequence[j] >= 0) {
-				sprintf(str, "0x%02X ", par->init_sequence[j]);
-				strcat(msg, str);
-				j++;
-			}
-			fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
-				"init: write(0x%02X) %s\n",
-				par->init_sequence[i], msg);
-
-			/* Write */
-			j = 0;
-			while (par->init_sequence[i] >= 0) {
-				if (j > 63) {
-					dev_err(par->info->device,
-					"%s: Maximum register values exceeded\n",
-					__func__);
-					return -EINVAL;
-				}
-				buf[j++] = par->init_sequence[i++];
-			}
-			par->fbtftops.write_register(par, j,
-				buf[0], buf[1], buf[2], buf[3],
-				buf[4], buf[5], buf[6], buf[7],
-				buf[8], buf[9], buf[10], buf[11],
-				buf[12], buf[13], buf[14], buf[15],
-				buf[16], buf[17], buf[18], buf[19],
-				buf[20], buf[21], buf[22], buf[23],
-				buf[24], buf[25], buf[26], buf[27],
-				buf[28], buf[29], buf[30], buf[31],
-				buf[32], buf[33], buf[34], buf[35],
-				buf[36], buf[37], buf[38], buf[39],
-				buf[40], buf[41], buf[42], buf[43],
-				buf[44], buf[45], buf[46], buf[47],
-				buf[48], buf[49], buf[50], buf[51],
-				buf[52], buf[53], buf[54], buf[55],
-				buf[56], buf[57], buf[58], buf[59],
-				buf[60], buf[61], buf[62], buf[63]);
+			vals[num++] = seq[++i] | FBTFT_OF_INIT_CMD;
 			break;
 		case -2:
-			i++;
-			fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
-				"init: mdelay(%d)\n", par->init_sequence[i]);
-			mdelay(par->init_sequence[i++]);
+			vals[num++] = seq[++i] | FBTFT_OF_INIT_DELAY;
 			break;
 		default:
-			dev_err(par->info->device,
-				"unknown delimiter %d at position %d\n",
-				par->init_sequence[i], i);
-			return -EINVAL;
+			dev_err(dev, "unknown delimiter %d at position %u\n",
+				seq[i], i);
+			ret = -EINVAL;
+			goto out_free;
+		}
+	}
+
+	ret = fbtft_init_compile(par, dev, vals, num);
+
+out_free:
+	kfree(vals);
+
+	return ret;
+}
+
+/*
+ * Drivers with their own write_register() get the buffer expanded into its
+ * argument list.
+ */
+static int fbtft_write_cmd_compat(struct fbtft_par *par, u16 cmd,
+				  const u16 *params, size_t num)
+{
+	int buf[64] = { cmd };
+	size_t i;
+
+	if (num > FBTFT_CMD_MAX_PARAMS)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++)
+		buf[i + 1] = params[i];
+
+	par->fbtftops.write_register(par, num + 1,
+		buf[0], buf[1], buf[2], buf[3],
+		buf[4], buf[5], buf[6], buf[7],
+		buf[8], buf[9], buf[10], buf[11],
+		buf[12], buf[13], buf[14], buf[15],
+		buf[16], buf[17], buf[18], buf[19],
+		buf[20], buf[21], buf[22], buf[23],
+		buf[24], buf[25], buf[26], buf[27],
+		buf[28], buf[29], buf[30], buf[31],
+		buf[32], buf[33], buf[34], buf[35],
+		buf[36], buf[37], buf[38], buf[39],
+		buf[40], buf[41], buf[42], buf[43],
+		buf[44], buf[45], buf[46], buf[47],
+		buf[48], buf[49], buf[50], buf[51],
+		buf[52], buf[53], buf[54], buf[55],
+		buf[56], buf[57], buf[58], buf[59],
+		buf[60], buf[61], buf[62], buf[63]);
+
+	return 0;
+}
+
+/**
+ * fbtft_init_display_prog() - Run the compiled init sequence
+ * @par: Driver data
+ *
+ * The commands between two delays are queued, on a 9-bit bus they go out in
+ * one write.
+ *
+ * Return: 0 if successful, negative if error
+ */
+static int fbtft_init_display_prog(struct fbtft_par *par)
+{
+	const struct fbtft_init_cmd *cmd;
+	unsigned int i;
+	int ret;
+
+	par->fbtftops.reset(par);
+	if (par->gpio.cs != -1)
+		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
+
+	fbtft_cmd_queue_begin(par);
+
+	for (i = 0; i < par->init.num; i++) {
+		cmd = &par->init.cmds[i];
+		if (!cmd->len) {
+			ret = fbtft_cmd_queue_flush(par);
+			if (ret)
+				return ret;
+			fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
+				      "init: sleep(%u)\n", cmd->delay_ms);
+			tinydrm_msleep(cmd->delay_ms);
+			fbtft_cmd_queue_begin(par);
+			continue;
+		}
+
+		fbtft_par_dbg(DEBUG_INIT_DISPLAY, par,
+			      "init: write(0x%02X) %u values\n",
+			      cmd->words[0], cmd->len - 1);
+		ret = par->fbtftops.write_cmd(par, cmd->words[0],
+					      cmd->words + 1, cmd->len - 1);
+		if (ret) {
+			par->cmdq.active = false;
+			par->cmdq.len = 0;
+			return ret;
 		}
 	}
 
-	dev_err(par->info->device,
-		"%s: something is wrong. Shouldn't get here.\n", __func__);
-	return -EINVAL;
+	return fbtft_cmd_queue_flush(par);
 }
 
 static void fbtft_set_addr_win(struct fbtft_par *par, int xs, int ys, int xe,
 			       int ye)
 {
-	write_reg(par, MIPI_DCS_SET_COLUMN_ADDRESS,
-		  (xs >> 8) & 0xFF, xs & 0xFF, (xe >> 8) & 0xFF, xe & 0xFF);
+	fbtft_cmd_queue_begin(par);
+
+	fbtft_write_cmd(par, MIPI_DCS_SET_COLUMN_ADDRESS,
+			(xs >> 8) & 0xFF, xs & 0xFF, (xe >> 8) & 0xFF, xe & 0xFF);
 
-	write_reg(par, MIPI_DCS_SET_PAGE_ADDRESS,
-		  (ys >> 8) & 0xFF, ys & 0xFF, (ye >> 8) & 0xFF, ye & 0xFF);
+	fbtft_write_cmd(par, MIPI_DCS_SET_PAGE_ADDRESS,
+			(ys >> 8) & 0xFF, ys & 0xFF, (ye >> 8) & 0xFF, ye & 0xFF);
 
-	write_reg(par, MIPI_DCS_WRITE_MEMORY_START);
+	fbtft_write_cmd(par, MIPI_DCS_WRITE_MEMORY_START);
+
+	fbtft_cmd_queue_flush(par);
+}
+
+/*
+ * On a 9-bit bus and a startbyte bus the data/command distinction travels
+ * in the data stream, so a flush can go out as one SPI message. Drivers can
+ * provide their own &fbtft_ops->write_frame using the frame builder.
+ */
+static int fbtft_frame_setup(struct fbtft_par *par, size_t vmem_size)
+{
+	const struct fbtft_ops *ops = &par->display.fbtftops;
+	struct spi_device *spi = par->spi;
+	size_t buf_len = vmem_size;
+
+	if (!spi)
+		return 0;
+
+	if (!par->fbtftops.write_frame && !ops->set_addr_win &&
+	    !ops->write_vmem &&
+	    par->fbtftops.write == fbtft_write_spi_emulate_9 &&
+	    par->fbtftops.write_cmd == fbtft_write_cmd8_bus9) {
+		par->fbtftops.write_frame = fbtft_write_frame_bus9_emulate;
+		/* The window makes two 9 byte groups, 4 pixels make one */
+		buf_len = 2 * 9 + DIV_ROUND_UP(vmem_size / 2, 4) * 9;
+	}
+
+	if (!par->fbtftops.write_frame && !ops->set_addr_win &&
+	    !ops->write_vmem && par->fbtftops.write == fbtft_write_spi) {
+		if (par->fbtftops.write_cmd == fbtft_write_cmd8_bus9 &&
+		    spi->bits_per_word == 9) {
+			par->fbtftops.write_frame = fbtft_write_frame_bus9;
+			buf_len = (FBTFT_FRAME_WIN_WORDS + vmem_size) * 2;
+		} else if (par->fbtftops.write_cmd == fbtft_write_cmd8_bus8 &&
+			   par->startbyte && par->gpio.dc == -1) {
+			par->fbtftops.write_frame = fbtft_write_frame_startbyte;
+		}
+	}
+
+	if (!par->fbtftops.write_frame)
+		return 0;
+
+	/* 16-bit words go out MSB first, no need to byte swap the pixels */
+	if (par->display.buswidth != 9 && tinydrm_spi_bpw_supported(spi, 16))
+		buf_len = 0;
+
+	return fbtft_frame_init(par, buf_len, buf_len ? buf_len : vmem_size);
+}
+
+/*
+ * MIPI controllers on a 4-wire 8-bit bus can take 12-bit RGB444 pixels, 3
+ * bytes for 2 pixels instead of 4. 'wire-bpp = <12>' always uses it and
+ * 'wire-bpp-auto' drops to 12 bpp when flushes take longer than the frame
+ * budget (1/fps) and goes back to 16 bpp when they fit again.
+ */
+#define FBTFT_WIRE_SLOW_FLUSHES		3
+#define FBTFT_WIRE_FAST_FLUSHES		30
+
+static int fbtft_wire_setup(struct fbtft_par *par, struct device *dev)
+{
+	if (par->wire.autoswitch) {
+		par->wire.active = 16;
+	} else if (par->wire.bpp == 12) {
+		par->wire.active = 12;
+	} else if (par->wire.bpp && par->wire.bpp != 16) {
+		dev_err(dev, "wire-bpp=%u is not supported\n", par->wire.bpp);
+		return -EINVAL;
+	}
+
+	if (!par->wire.active)
+		return 0;
+
+	if (!par->spi || par->fbtftops.set_addr_win ||
+	    par->fbtftops.write_frame || par->startbyte ||
+	    par->gpio.dc == -1 || par->display.buswidth != 8 ||
+	    par->fbtftops.write_vmem != fbtft_write_vmem16_bus8) {
+		dev_warn(dev, "Reduced wire depth not supported, using 16 bpp\n");
+		par->wire.active = 0;
+		par->wire.autoswitch = false;
+	}
+
+	return 0;
+}
+
+static int fbtft_wire_write(struct fbtft_par *par,
+			    const struct drm_clip_rect *clip)
+{
+	size_t num = (clip->x2 - clip->x1) * (clip->y2 - clip->y1);
+	void *buf = par->info->screen_buffer;
+	size_t len, chunk, max_chunk;
+	unsigned int fmt;
+	int ret;
+
+	if (par->wire.programmed != par->wire.active) {
+		fmt = par->wire.active == 12 ? MIPI_DCS_PIXEL_FMT_12BIT :
+					       MIPI_DCS_PIXEL_FMT_16BIT;
+		ret = fbtft_write_cmd(par, MIPI_DCS_SET_PIXEL_FORMAT,
+				      fmt << 4 | fmt);
+		if (ret)
+			return ret;
+		par->wire.programmed = par->wire.active;
+	}
+
+	fbtft_set_addr_win(par, clip->x1, clip->y1, clip->x2 - 1, clip->y2 - 1);
+
+	if (par->wire.active == 16)
+		return par->fbtftops.write_vmem(par, 0, num * 2);
+
+	len = fbtft_pack_rgb444(buf, buf, num);
+	gpio_set_value(par->gpio.dc, 1);
+
+	/* A transfer ends on a pixel pair, 3 bytes */
+	max_chunk = tinydrm_spi_max_transfer_size(par->spi, 0);
+	max_chunk -= max_chunk % 3;
+
+	while (len) {
+		chunk = min(len, max_chunk);
+		ret = par->fbtftops.write(par, buf, chunk);
+		if (ret)
+			return ret;
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static void fbtft_wire_autoswitch(struct fbtft_par *par, unsigned int us)
+{
+	unsigned int budget = USEC_PER_SEC / par->display.fps;
+
+	if (par->wire.active == 16) {
+		par->wire.count = us > budget ? par->wire.count + 1 : 0;
+		if (par->wire.count < FBTFT_WIRE_SLOW_FLUSHES)
+			return;
+		par->wire.active = 12;
+	} else {
+		/* The same flush at 16 bpp moves 4/3 of the bytes */
+		par->wire.count = us / 3 * 4 < budget ? par->wire.count + 1 : 0;
+		if (par->wire.count < FBTFT_WIRE_FAST_FLUSHES)
+			return;
+		par->wire.active = 16;
+	}
+
+	par->wire.count = 0;
+	DRM_DEBUG_DRIVER("Switching to %u bpp on the wire\n", par->wire.active);
 }
 
 static int fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
@@ -571,12 +757,61 @@ static int fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
 	size_t offset = start_line * par->info->fix.line_length;
 	size_t len = (end_line - start_line + 1) * par->info->fix.line_length;
 
+	if (par->fbtftops.write_frame)
+		return par->fbtftops.write_frame(par, 0, start_line,
+						 par->info->var.xres - 1,
+						 end_line, offset, len);
+
 	par->fbtftops.set_addr_win(par, 0, start_line,
 				   par->info->var.xres - 1, end_line);
 
 	return par->fbtftops.write_vmem(par, offset, len);
 }
 
+static void fbtft_copy_clip(struct fbtft_par *par, struct drm_framebuffer *fb,
+			    void *vaddr, struct drm_clip_rect *clip)
+{
+	switch (fb->format->format) {
+	case DRM_FORMAT_RGB565:
+		tinydrm_memcpy(par->info->screen_buffer, vaddr, fb, clip);
+		break;
+	case DRM_FORMAT_XRGB8888:
+		tinydrm_xrgb8888_to_rgb565(par->info->screen_buffer, vaddr, fb,
+					   clip, false);
+		break;
+	}
+}
+
+/*
+ * With a TE gpio, MIPI flushes start on the TE edge and go out in bands that
+ * stay behind the panel scan. Each band is copied just before it is sent.
+ */
+static int fbtft_te_write(struct fbtft_par *par, struct drm_framebuffer *fb,
+			  void *vaddr, struct drm_clip_rect *clip)
+{
+	struct drm_clip_rect bands[TINYDRM_TE_BANDS];
+	unsigned int i, num;
+	int ret;
+
+	num = tinydrm_te_split(par->te, clip, bands);
+	tinydrm_te_wait(par->te);
+
+	for (i = 0; i < num; i++) {
+		struct drm_clip_rect *band = &bands[i];
+
+		fbtft_copy_clip(par, fb, vaddr, band);
+		tinydrm_te_wait_band(par->te, band);
+		fbtft_set_addr_win(par, band->x1, band->y1, band->x2 - 1,
+				   band->y2 - 1);
+		ret = par->fbtftops.write_vmem(par, 0, (band->x2 - band->x1) *
+					       (band->y2 - band->y1) * 2);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static int fbtft_fb_dirty(struct drm_framebuffer *fb,
 			  struct drm_file *file_priv,
 			  unsigned int flags, unsigned int color,
@@ -587,6 +822,9 @@ static int fbtft_fb_dirty(struct drm_framebuffer *fb,
 	struct tinydrm_device *tdev = fb->dev->dev_private;
 	struct fbtft_par *par = fbtft_par_from_tinydrm(tdev);
 	bool mipi = !par->fbtftops.set_addr_win;
+	bool packed = mipi || par->display.partial_width;
+	bool te_bands = par->te && mipi && !par->wire.active &&
+			!par->fbtftops.write_frame;
 	struct drm_clip_rect fullclip = {
 		.x1 = 0,
 		.x2 = fb->width,
@@ -594,26 +832,52 @@ static int fbtft_fb_dirty(struct drm_framebuffer *fb,
 		.y2 = fb->height,
 	};
 	struct drm_clip_rect clip;
+	ktime_t start;
 	int ret = 0;
 
 	mutex_lock(&tdev->dirty_lock);
 
 	/* fbdev can flush even when we're not interested */
-	if (tdev->pipe.plane.fb != fb)
+	if (!par->hw_ready || tdev->pipe.plane.fb != fb)
 		goto out_unlock;
 
+	/* The splash is up, replace all of it */
+	if (par->next_full) {
+		par->next_full = false;
+		clips = NULL;
+		num_clips = 0;
+	}
+
 	tinydrm_merge_clips(&clip, clips, num_clips, flags,
 			    fb->width, fb->height);
 
 	/*
 	 * MIPI is the default controller type supported by fbtft and it can
-	 * handle clips that are not full width.
+	 * handle clips that are not full width. Other controllers can opt in
+	 * through &fbtft_display->partial_width.
 	 */
-	if (!mipi) {
+	if (!packed) {
 		clip.x1 = 0;
 		clip.x2 = fb->width;
 	}
 
+	/* Drivers' own write_vmem converts and sends the whole frame */
+	if (!packed && !par->fbtftops.write_frame &&
+	    par->display.fbtftops.write_vmem)
+		clip = fullclip;
+
+	/* Coming back from 12 bpp, redraw everything at full depth */
+	if (par->wire.programmed && par->wire.active > par->wire.programmed) {
+		clip = fullclip;
+		tinydrm_fingerprint_reset(&par->fingerprint);
+	}
+
+	/* clip is now the region that is sent */
+	if (tinydrm_fingerprint_unchanged(&par->fingerprint, fb, &clip)) {
+		DRM_DEBUG("Skipping unchanged [FB:%d]\n", fb->base.id);
+		goto out_unlock;
+	}
+
 	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u\n", fb->base.id,
 		  clip.x1, clip.x2, clip.y1, clip.y2);
 
@@ -627,29 +891,46 @@ static int fbtft_fb_dirty(struct drm_framebuffer *fb,
 	 * will be passed straight through without being read by the CPU.
 	 *
 	 * Since MIPI controllers are the fbtft default, we can easily copy
-	 * just the clip part of the buffer.
+	 * just the clip part of the buffer. The same goes for drivers with
+	 * &fbtft_display->partial_width. TE banded flushes copy band by band.
 	 */
-	switch (fb->format->format) {
-	case DRM_FORMAT_RGB565:
-		tinydrm_memcpy(par->info->screen_buffer, cma_obj->vaddr, fb,
-			       mipi ? &clip : &fullclip);
-		break;
-	case DRM_FORMAT_XRGB8888:
-		tinydrm_xrgb8888_to_rgb565(par->info->screen_buffer,
-					   cma_obj->vaddr, fb,
-					   mipi ? &clip : &fullclip, false);
-		break;
-	}
-
-	if (mipi) {
-		fbtft_set_addr_win(par, clip.x1, clip.y1,
-				   clip.x2 - 1, clip.y2 - 1);
+	if (!te_bands)
+		fbtft_copy_clip(par, fb, cma_obj->vaddr,
+				packed ? &clip : &fullclip);
+
+	/* Flushes that can't be split still start on the TE edge */
+	if (par->te && !te_bands)
+		tinydrm_te_wait(par->te);
+
+	start = ktime_get();
+
+	if (te_bands) {
+		ret = fbtft_te_write(par, fb, cma_obj->vaddr, &clip);
+	} else if (mipi && par->wire.active) {
+		ret = fbtft_wire_write(par, &clip);
+	} else if (packed && par->fbtftops.write_frame) {
+		ret = par->fbtftops.write_frame(par, clip.x1, clip.y1,
+						clip.x2 - 1, clip.y2 - 1, 0,
+						(clip.x2 - clip.x1) *
+						(clip.y2 - clip.y1) * 2);
+	} else if (packed) {
+		if (mipi)
+			fbtft_set_addr_win(par, clip.x1, clip.y1,
+					   clip.x2 - 1, clip.y2 - 1);
+		else
+			par->fbtftops.set_addr_win(par, clip.x1, clip.y1,
+						   clip.x2 - 1, clip.y2 - 1);
 		ret = par->fbtftops.write_vmem(par, 0, (clip.x2 - clip.x1) *
 					       (clip.y2 - clip.y1) * 2);
 	} else {
 		ret = fbtft_update_display(par, clip.y1, clip.y2 - 1);
 	}
 
+	if (ret)
+		tinydrm_fingerprint_reset(&par->fingerprint);
+	else if (par->wire.autoswitch)
+		fbtft_wire_autoswitch(par, ktime_us_delta(ktime_get(), start));
+
 out_unlock:
 	mutex_unlock(&tdev->dirty_lock);
 
@@ -673,9 +954,25 @@ static void fbtft_pipe_enable(struct drm_simple_display_pipe *pipe,
 	struct fbtft_par *par = fbtft_par_from_tinydrm(tdev);
 	struct drm_framebuffer *fb = pipe->plane.fb;
 
+	bool hw_ready, splash;
+
 	DRM_DEBUG_KMS("\n");
 
-	if (fb)
+	drm_crtc_vblank_on(&pipe->crtc);
+
+	mutex_lock(&tdev->dirty_lock);
+	tinydrm_fingerprint_reset(&par->fingerprint);
+	par->enabled = true;
+	hw_ready = par->hw_ready;
+	splash = par->splash;
+	par->splash = false;
+	mutex_unlock(&tdev->dirty_lock);
+
+	/* Still initializing, the init worker takes it from here */
+	if (!hw_ready)
+		return;
+
+	if (fb && !splash)
 		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
 
 	tinydrm_enable_backlight(par->info->bl_dev);
@@ -687,6 +984,13 @@ static void fbtft_pipe_disable(struct drm_simple_display_pipe *pipe)
 	struct fbtft_par *par = fbtft_par_from_tinydrm(tdev);
 
 	DRM_DEBUG_KMS("\n");
+
+	drm_crtc_vblank_off(&pipe->crtc);
+
+	mutex_lock(&tdev->dirty_lock);
+	par->enabled = false;
+	mutex_unlock(&tdev->dirty_lock);
+
 	tinydrm_disable_backlight(par->info->bl_dev);
 }
 
@@ -698,15 +1002,93 @@ static const uint32_t fbtft_formats[] = {
 static const struct drm_simple_display_pipe_funcs fbtft_pipe_funcs = {
 	.enable = fbtft_pipe_enable,
 	.disable = fbtft_pipe_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_vblank_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int fbtft_debugfs_calibration_show(struct seq_file *m, void *arg)
+{
+	struct drm_info_node *node = m->private;
+	struct tinydrm_device *tdev = node->minor->dev->dev_private;
+	struct fbtft_par *par = fbtft_par_from_tinydrm(tdev);
+	unsigned int i;
+
+	if (!par->cal.enabled) {
+		seq_puts(m, "disabled\n");
+		return 0;
+	}
+
+	for (i = 0; i < par->cal.num; i++)
+		seq_printf(m, "%u Hz: %s\n", par->cal.hz[i],
+			   par->cal.pass[i] ? "pass" : "fail");
+
+	if (par->cal.error)
+		seq_printf(m, "error: %d\n", par->cal.error);
+	else
+		seq_printf(m, "pixel clock: %u Hz\n", par->cal.chosen_hz);
+
+	return 0;
+}
+
+static const struct drm_info_list fbtft_debugfs_list[] = {
+	{ "spi_calibration", fbtft_debugfs_calibration_show, 0 },
+};
+
+static int fbtft_debugfs_init(struct drm_minor *minor)
+{
+	struct tinydrm_device *tdev = minor->dev->dev_private;
+	struct fbtft_par *par = fbtft_par_from_tinydrm(tdev);
+	int ret;
+
+	if (par->i80) {
+		ret = tinydrm_i80_gpio_debugfs_init(par->i80,
+						    minor->debugfs_root,
+						    &tdev->dirty_lock,
+						    &par->enabled);
+		if (ret)
+			return ret;
+	}
+
+	if (par->display.buswidth == 9) {
+		ret = fbtft_pack9_debugfs_init(minor->debugfs_root);
+		if (ret)
+			return ret;
+	}
+
+	if (par->spi) {
+		ret = tinydrm_spi_clocks_debugfs_init(&par->spi->dev,
+						      minor->debugfs_root);
+		if (ret)
+			return ret;
+
+		ret = drm_debugfs_create_files(fbtft_debugfs_list,
+					       ARRAY_SIZE(fbtft_debugfs_list),
+					       minor->debugfs_root, minor);
+		if (ret)
+			return ret;
+	}
+
+	ret = tinydrm_te_debugfs_init(par->te, minor->debugfs_root);
+	if (ret)
+		return ret;
+
+	return tinydrm_fingerprint_debugfs_init(&par->fingerprint,
+						minor->debugfs_root,
+						&tdev->dirty_lock);
+}
+#else
+#define fbtft_debugfs_init	NULL
+#endif
+
 static struct drm_driver fbtft_driver = {
 	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_PRIME |
 				  DRIVER_ATOMIC,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
+	.enable_vblank		= tinydrm_vblank_enable,
+	.disable_vblank		= tinydrm_vblank_disable,
+	.debugfs_init		= fbtft_debugfs_init,
 	.date			= "20170202",
 	.major			= 1,
 	.minor			= 0,
@@ -739,6 +1121,416 @@ static void fbtft_setmode(struct drm_display_mode *mode, int width, int height)
 	*mode = setmode;
 }
 
+/*
+ * MIPI DCS read on a 4-wire SPI bus. Chip select has to stay asserted between
+ * the command and the data, so both go in one message. The data ends up at
+ * par->buf + 1.
+ */
+static int fbtft_dcs_read_buf(struct fbtft_par *par, u8 cmd, size_t len)
+{
+	struct spi_transfer tr[2] = {
+		{
+			.tx_buf = par->buf,
+			.len = 1,
+			.speed_hz = fbtft_read_hz(par),
+		}, {
+			.rx_buf = par->buf + 1,
+			.len = len,
+			.speed_hz = fbtft_read_hz(par),
+		},
+	};
+
+	if (len >= FBTFT_BUF_LEN)
+		return -EINVAL;
+
+	par->buf[0] = cmd;
+	gpio_set_value(par->gpio.dc, 0);
+
+	return spi_sync_transfer(par->spi, tr, ARRAY_SIZE(tr));
+}
+
+static int fbtft_dcs_read(struct fbtft_par *par, u8 cmd, u8 *val)
+{
+	int ret;
+
+	ret = fbtft_dcs_read_buf(par, cmd, 1);
+	if (ret)
+		return ret;
+
+	*val = par->buf[1];
+	fbtft_par_dbg(DEBUG_INIT_DISPLAY, par, "read(0x%02X) = 0x%02X\n",
+		      cmd, *val);
+
+	return 0;
+}
+
+/* Find the last value the init sequence writes to @cmd */
+static bool fbtft_init_find(struct fbtft_par *par, u16 cmd, u16 *val)
+{
+	const struct fbtft_init_cmd *init;
+	bool found = false;
+	unsigned int i;
+
+	for (i = 0; i < par->init.num; i++) {
+		init = &par->init.cmds[i];
+		if (init->len > 1 && init->words[0] == cmd) {
+			*val = init->words[1];
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * With the 'adopt-running' property the first init checks whether the
+ * bootloader left a MIPI DCS controller awake, displaying and in the pixel
+ * format and address mode of our init sequence. If so the reset and init are
+ * skipped and, like a splash, the bootloader image stays up until the first
+ * damage. Only 8-bit SPI with a D/C gpio can be read back.
+ */
+static bool fbtft_adopt(struct fbtft_par *par)
+{
+	u16 format = MIPI_DCS_PIXEL_FMT_16BIT, addr_mode;
+	u8 val;
+
+	if (!par->spi || par->gpio.dc == -1 || par->startbyte ||
+	    par->display.regwidth != 8 || par->display.buswidth != 8) {
+		DRM_DEBUG_DRIVER("Can't read the controller, initializing\n");
+		return false;
+	}
+
+	if (par->gpio.cs != -1)
+		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
+
+	/* Sleep Out, Normal Mode and Display On */
+	if (fbtft_dcs_read(par, MIPI_DCS_GET_POWER_MODE, &val) ||
+	    (val & 0x1C) != 0x1C)
+		goto out_init;
+
+	fbtft_init_find(par, MIPI_DCS_SET_PIXEL_FORMAT, &format);
+	if (fbtft_dcs_read(par, MIPI_DCS_GET_PIXEL_FORMAT, &val) ||
+	    (val & 0x07) != (format & 0x07))
+		goto out_init;
+
+	/* set_var() owns the address mode and rewriting it doesn't blank */
+	if (!par->fbtftops.set_var &&
+	    fbtft_init_find(par, MIPI_DCS_SET_ADDRESS_MODE, &addr_mode) &&
+	    (fbtft_dcs_read(par, MIPI_DCS_GET_ADDRESS_MODE, &val) ||
+	     val != (addr_mode & 0xFF)))
+		goto out_init;
+
+	DRM_DEBUG_DRIVER("Adopting the running controller\n");
+
+	return true;
+
+out_init:
+	DRM_DEBUG_DRIVER("Controller not in the expected state, initializing\n");
+
+	return false;
+}
+
+/* Clocks tried by the calibration, they're rounded down by the controller */
+static const u32 fbtft_cal_steps[] = {
+	4000000, 8000000, 12000000, 16000000, 20000000, 24000000,
+	32000000, 40000000, 48000000, 64000000, 80000000,
+};
+
+/* Pixels in the top left corner used for the test pattern */
+#define FBTFT_CAL_PIXELS	32
+#define FBTFT_CAL_TRIES		3
+
+static int fbtft_calibrate_write(struct fbtft_par *par, const u16 *pixels,
+				 u32 speed_hz)
+{
+	struct spi_transfer tr = {
+		.tx_buf = par->buf,
+		.len = FBTFT_CAL_PIXELS * 2,
+		.speed_hz = speed_hz,
+	};
+	unsigned int i;
+
+	for (i = 0; i < FBTFT_CAL_PIXELS; i++)
+		put_unaligned_be16(pixels[i], par->buf + i * 2);
+
+	fbtft_set_addr_win(par, 0, 0, FBTFT_CAL_PIXELS - 1, 0);
+	gpio_set_value(par->gpio.dc, 1);
+
+	return spi_sync_transfer(par->spi, &tr, 1);
+}
+
+/* Memory reads return a dummy byte and then 18-bit pixels in 3 bytes */
+static int fbtft_calibrate_read(struct fbtft_par *par, u16 *pixels)
+{
+	unsigned int i;
+	u8 *rx;
+	int ret;
+
+	fbtft_set_addr_win(par, 0, 0, FBTFT_CAL_PIXELS - 1, 0);
+	ret = fbtft_dcs_read_buf(par, MIPI_DCS_READ_MEMORY_START,
+				 1 + FBTFT_CAL_PIXELS * 3);
+	if (ret)
+		return ret;
+
+	rx = par->buf + 2;
+	for (i = 0; i < FBTFT_CAL_PIXELS; i++, rx += 3)
+		pixels[i] = (rx[0] >> 3) << 11 | (rx[1] >> 2) << 5 | rx[2] >> 3;
+
+	return 0;
+}
+
+static bool fbtft_calibrate_step(struct fbtft_par *par, const u16 *pattern,
+				 u32 speed_hz)
+{
+	u16 pixels[FBTFT_CAL_PIXELS];
+	unsigned int i;
+
+	for (i = 0; i < FBTFT_CAL_TRIES; i++) {
+		if (fbtft_calibrate_write(par, pattern, speed_hz) ||
+		    fbtft_calibrate_read(par, pixels) ||
+		    memcmp(pixels, pattern, sizeof(pixels)))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * With the 'spi-calibrate' property the pixel clock is measured after the
+ * first init: a test pattern is written to the top left corner at stepped
+ * clocks and read back with MIPI_DCS_READ_MEMORY_START at the read clock.
+ * The pixel clock is set one step below the highest passing clock, the lowest
+ * step if only that one passes. The original pixels are put back afterwards.
+ * Only 8-bit SPI with a D/C gpio can be read back.
+ */
+static void fbtft_calibrate(struct fbtft_par *par)
+{
+	u32 max_hz = par->spi ? par->spi->master->max_speed_hz : 0;
+	u16 saved[FBTFT_CAL_PIXELS], pattern[FBTFT_CAL_PIXELS];
+	unsigned int i, best, num = 0;
+	bool pass = true;
+
+	if (!par->spi || par->gpio.dc == -1 || par->startbyte ||
+	    par->display.regwidth != 8 || par->display.buswidth != 8 ||
+	    par->fbtftops.set_addr_win) {
+		dev_warn(par->info->device, "Can't calibrate SPI clock\n");
+		par->cal.error = -ENODEV;
+		return;
+	}
+
+	if (par->gpio.cs != -1)
+		gpio_set_value(par->gpio.cs, 0);  /* Activate chip */
+
+	if (fbtft_calibrate_read(par, saved)) {
+		par->cal.error = -EIO;
+		return;
+	}
+
+	for (i = 0; i < FBTFT_CAL_PIXELS; i++)
+		pattern[i] = (i * 0x9e37) ^ ((i & 1) ? 0xffff : 0);
+
+	for (i = 0; i < ARRAY_SIZE(fbtft_cal_steps) && pass; i++) {
+		if (max_hz && fbtft_cal_steps[i] > max_hz)
+			break;
+
+		pass = fbtft_calibrate_step(par, pattern, fbtft_cal_steps[i]);
+		par->cal.hz[num] = fbtft_cal_steps[i];
+		par->cal.pass[num++] = pass;
+		DRM_DEBUG_DRIVER("SPI calibration: %u Hz %s\n",
+				 fbtft_cal_steps[i], pass ? "pass" : "fail");
+	}
+	par->cal.num = num;
+
+	fbtft_calibrate_write(par, saved, 0);
+
+	if (!num || !par->cal.pass[0]) {
+		dev_warn(par->info->device,
+			 "SPI calibration failed, pixel clock unchanged\n");
+		par->cal.error = -EIO;
+		return;
+	}
+
+	/* Margin: one step below the highest passing clock */
+	best = pass ? num - 1 : num - 2;
+	par->cal.chosen_hz = par->cal.hz[best ? best - 1 : 0];
+
+	WRITE_ONCE(par->clocks->pixel_hz, par->cal.chosen_hz);
+	DRM_DEBUG_DRIVER("SPI pixel clock calibrated to %u Hz\n",
+			 par->cal.chosen_hz);
+}
+
+/*
+ * Initialize the controller, used on probe and resume. An adopted controller
+ * keeps the bootloader's init and gamma.
+ */
+static int fbtft_hw_init(struct fbtft_par *par, bool adopted)
+{
+	int ret;
+
+	if (!adopted) {
+		ret = par->fbtftops.init_display(par);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (par->fbtftops.set_var && !no_set_var) {
+		ret = par->fbtftops.set_var(par);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (!adopted && par->fbtftops.set_gamma && par->gamma.curves) {
+		ret = par->fbtftops.set_gamma(par, par->gamma.curves);
+		if (ret)
+			return ret;
+	}
+
+	/* Pixel format is unknown, set it on the next flush */
+	par->wire.programmed = 0;
+
+	/* Other controllers have to turn TE on in their init sequence */
+	if (par->te && !par->fbtftops.set_addr_win) {
+		ret = fbtft_write_cmd(par, MIPI_DCS_SET_TEAR_ON, 0x00);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+static int fbtft_splash_set_window(void *arg, const struct drm_clip_rect *clip)
+{
+	struct fbtft_par *par = arg;
+
+	/* Only MIPI and partial_width controllers handle narrow windows */
+	if (!par->fbtftops.set_addr_win) {
+		fbtft_set_addr_win(par, clip->x1, clip->y1, clip->x2 - 1,
+				   clip->y2 - 1);
+	} else if (!par->display.partial_width &&
+		   (clip->x1 || clip->x2 != par->info->var.xres)) {
+		return -EINVAL;
+	} else {
+		par->fbtftops.set_addr_win(par, clip->x1, clip->y1,
+					   clip->x2 - 1, clip->y2 - 1);
+	}
+
+	return 0;
+}
+
+/* The chunk is decoded into the start of screen_buffer */
+static int fbtft_splash_write(void *arg, void *buf, size_t len)
+{
+	struct fbtft_par *par = arg;
+
+	return par->fbtftops.write_vmem(par, 0, len);
+}
+
+static const struct tinydrm_splash_funcs fbtft_splash_funcs = {
+	.set_window = fbtft_splash_set_window,
+	.write = fbtft_splash_write,
+};
+
+/*
+ * Show the 'splash' firmware image right after the controller is initialized.
+ * It's decoded in transmit buffer sized chunks and stays up until the first
+ * damage, the initial full flush on enable is skipped. The first flush after
+ * the splash redraws the whole framebuffer.
+ */
+static bool fbtft_splash(struct fbtft_par *par)
+{
+	size_t vmem_size = par->info->fix.line_length * par->info->var.yres;
+	size_t len = par->txbuf.len ? min_t(size_t, par->txbuf.len, vmem_size) :
+				      vmem_size;
+	int ret;
+
+	ret = tinydrm_splash_draw(par->info->device, par->info->var.xres,
+				  par->info->var.yres,
+				  par->info->screen_buffer, len,
+				  &fbtft_splash_funcs, par);
+	if (ret && ret != -ENOENT)
+		dev_warn(par->info->device, "Failed to show splash %d\n", ret);
+
+	return !ret;
+}
+
+static void fbtft_connector_lost(struct fbtft_par *par)
+{
+	struct drm_device *drm = par->tinydrm.drm;
+
+	mutex_lock(&drm->mode_config.mutex);
+	par->tinydrm.pipe.connector->status = connector_status_disconnected;
+	mutex_unlock(&drm->mode_config.mutex);
+
+	drm_kms_helper_hotplug_event(drm);
+}
+
+/*
+ * Controller init can sleep for hundreds of milliseconds, so probe only
+ * registers the DRM device and leaves the init to a worker. Flushing is held
+ * off until the controller is ready and if the pipe was enabled in the
+ * meantime, the worker does the first flush. If the init fails, the connector
+ * is reported disconnected so userspace stops using the panel.
+ */
+static void fbtft_hw_init_work(struct work_struct *work)
+{
+	struct fbtft_par *par = container_of(work, struct fbtft_par,
+					     hw_init_work);
+	struct tinydrm_device *tdev = &par->tinydrm;
+	struct drm_framebuffer *fb = NULL;
+	bool enabled, splash, adopted;
+	int ret;
+
+	/* Keep the debugfs bus benchmark off the bus while initializing */
+	mutex_lock(&tdev->dirty_lock);
+
+	adopted = par->adopt && fbtft_adopt(par);
+	ret = fbtft_hw_init(par, adopted);
+	if (ret) {
+		mutex_unlock(&tdev->dirty_lock);
+		dev_err(par->info->device, "Failed to initialize display %d\n",
+			ret);
+		fbtft_connector_lost(par);
+		return;
+	}
+
+	if (par->cal.enabled)
+		fbtft_calibrate(par);
+
+	if (par->fbtftops.register_backlight)
+		par->fbtftops.register_backlight(par);
+
+	/* The bootloader image is kept like a splash */
+	splash = adopted || fbtft_splash(par);
+
+	par->hw_ready = true;
+	par->splash = splash;
+	par->next_full = splash;
+	enabled = par->enabled;
+	if (enabled)
+		par->splash = false;
+	mutex_unlock(&tdev->dirty_lock);
+
+	if (!enabled)
+		return;
+
+	if (splash)
+		goto out_backlight;
+
+	drm_modeset_lock_all(tdev->drm);
+	fb = tdev->pipe.plane.fb;
+	if (fb)
+		drm_framebuffer_get(fb);
+	drm_modeset_unlock_all(tdev->drm);
+
+	if (fb) {
+		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+		drm_framebuffer_put(fb);
+	}
+
+out_backlight:
+	tinydrm_enable_backlight(par->info->bl_dev);
+}
+
 int fbtft_probe_common(struct fbtft_display *display,
 			struct spi_device *sdev, struct platform_device *pdev)
 {
@@ -780,7 +1572,7 @@ int fbtft_probe_common(struct fbtft_display *display,
 	if (!par)
 		return -ENOMEM;
 
-	par->buf = devm_kzalloc(dev, 128, GFP_KERNEL);
+	par->buf = devm_kzalloc(dev, FBTFT_BUF_LEN, GFP_KERNEL);
 	if (!par->buf)
 		return -ENOMEM;
 
@@ -796,6 +1588,12 @@ int fbtft_probe_common(struct fbtft_display *display,
 	if (!display->bpp)
 		display->bpp = 16;
 
+	/* Controllers that don't say get a conservative reset */
+	if (!display->reset_assert_us && !display->reset_settle_ms) {
+		display->reset_assert_us = 20;
+		display->reset_settle_ms = 120;
+	}
+
 	if (display->bpp != 16) {
 		dev_err(dev, "Only bpp=16 is supported\n");
 		return -EINVAL;
@@ -859,6 +1657,14 @@ int fbtft_probe_common(struct fbtft_display *display,
 	par->pdata->display = *display;
 
 	spin_lock_init(&par->dirty_lock);
+	par->adopt = device_property_read_bool(dev, "adopt-running");
+	par->cal.enabled = device_property_read_bool(dev, "spi-calibrate");
+	par->wire.autoswitch = device_property_read_bool(dev, "wire-bpp-auto");
+
+	ret = fbtft_property_unsigned(dev, "wire-bpp", &par->wire.bpp);
+	if (ret)
+		return ret;
+
 	par->init_sequence = display->init_sequence;
 
 	if (display->gamma_num && display->gamma_len) {
@@ -919,12 +1725,40 @@ int fbtft_probe_common(struct fbtft_display *display,
 
 	par->fbtftops = display->fbtftops;
 
+	if (par->spi) {
+		par->clocks = devm_tinydrm_spi_clocks_init(par->spi,
+					display->cmd_speed_hz, 0,
+					display->read_speed_hz ?: 2000000);
+		if (IS_ERR(par->clocks))
+			return PTR_ERR(par->clocks);
+	}
+
 	if (!par->fbtftops.reset)
 		par->fbtftops.reset = fbtft_reset;
 
 	if (!par->fbtftops.register_backlight && display->backlight)
 		par->fbtftops.register_backlight = fbtft_register_backlight;
 
+	if (!par->fbtftops.write_cmd) {
+		if (par->fbtftops.write_register)
+			par->fbtftops.write_cmd = fbtft_write_cmd_compat;
+		else if (display->regwidth == 8 && display->buswidth == 8)
+			par->fbtftops.write_cmd = fbtft_write_cmd8_bus8;
+		else if (display->regwidth == 8 && display->buswidth == 9)
+			par->fbtftops.write_cmd = fbtft_write_cmd8_bus9;
+		else if (display->regwidth == 16 && display->buswidth == 8)
+			par->fbtftops.write_cmd = fbtft_write_cmd16_bus8;
+		else if (display->regwidth == 16 && display->buswidth == 16)
+			par->fbtftops.write_cmd = fbtft_write_cmd16_bus16;
+	}
+
+	if (par->fbtftops.write_cmd == fbtft_write_cmd8_bus9) {
+		par->cmdq.buf = devm_kcalloc(dev, FBTFT_CMDQ_WORDS,
+					     sizeof(u16), GFP_KERNEL);
+		if (!par->cmdq.buf)
+			return -ENOMEM;
+	}
+
 	if (!par->fbtftops.write_register) {
 		if (display->regwidth == 8 && display->buswidth == 8)
 			par->fbtftops.write_register = fbtft_write_reg8_bus8;
@@ -955,8 +1789,9 @@ int fbtft_probe_common(struct fbtft_display *display,
 			if (par->spi->master->bits_per_word_mask & SPI_BPW_MASK(9)) {
 				par->spi->bits_per_word = 9;
 			} else {
-				size_t sz = par->txbuf.len +
-					    (par->txbuf.len / 8) + 8;
+				size_t len = max_t(size_t, par->txbuf.len,
+						   FBTFT_CMDQ_WORDS * 2);
+				size_t sz = len + (len / 8) + 8;
 
 				dev_warn(dev, "9-bit SPI not available, emulating using 8-bit.\n");
 				par->fbtftops.write = fbtft_write_spi_emulate_9;
@@ -975,10 +1810,18 @@ int fbtft_probe_common(struct fbtft_display *display,
 
 	par->fbtftops.read = fbtft_read_spi;
 
-	if (of_find_property(dev->of_node, "init", NULL))
-		par->fbtftops.init_display = fbtft_init_display_dt;
-	else if (par->init_sequence)
-		par->fbtftops.init_display = fbtft_init_display;
+	if (device_property_present(dev, "init")) {
+		ret = fbtft_init_compile_dt(par, dev);
+		if (ret)
+			return ret;
+	} else if (par->init_sequence) {
+		ret = fbtft_init_compile_seq(par, dev);
+		if (ret)
+			return ret;
+	}
+
+	if (par->init.cmds)
+		par->fbtftops.init_display = fbtft_init_display_prog;
 
 	if (!par->fbtftops.init_display) {
 		dev_err(dev, "missing fbtftops.init_display()\n");
@@ -1039,28 +1882,47 @@ int fbtft_probe_common(struct fbtft_display *display,
 	if (ret < 0)
 		return ret;
 
-	ret = par->fbtftops.init_display(par);
-	if (ret < 0)
+	ret = fbtft_frame_setup(par, vmem_size);
+	if (ret)
 		return ret;
 
-	if (par->fbtftops.set_var && !no_set_var) {
-		ret = par->fbtftops.set_var(par);
-		if (ret < 0)
-			return ret;
-	}
+	ret = fbtft_wire_setup(par, dev);
+	if (ret)
+		return ret;
 
-	if (par->fbtftops.set_gamma && par->gamma.curves) {
-		ret = par->fbtftops.set_gamma(par, par->gamma.curves);
-		if (ret)
-			return ret;
+	par->te = devm_tinydrm_te_init(dev, display->fps);
+	if (IS_ERR(par->te))
+		return PTR_ERR(par->te);
+
+	/*
+	 * The MIPI drivers put the panel rows on the framebuffer columns at
+	 * 90 and 270 degrees and start the scan from the far end at 180 and
+	 * 270 degrees.
+	 */
+	if (par->te)
+		tinydrm_te_set_scan(par->te, rotate % 180 ?
+				    par->info->var.xres : par->info->var.yres,
+				    rotate % 180, rotate >= 180);
+
+	ret = devm_tinydrm_vblank_init(tdev, display->fps, par->te);
+	if (ret)
+		return ret;
+
+	if (par->pdev) {
+		par->i80 = tinydrm_i80_gpio_init(dev, par->gpio.wr,
+						 par->gpio.db);
+		if (IS_ERR(par->i80))
+			return PTR_ERR(par->i80);
 	}
 
-	if (par->fbtftops.register_backlight)
-		par->fbtftops.register_backlight(par);
+	INIT_WORK(&par->hw_init_work, fbtft_hw_init_work);
+	schedule_work(&par->hw_init_work);
 
 	ret = devm_tinydrm_register(tdev);
-	if (ret)
+	if (ret) {
+		cancel_work_sync(&par->hw_init_work);
 		return ret;
+	}
 
 	if (par->spi)
 		spi_set_drvdata(par->spi, par);
@@ -1087,6 +1949,8 @@ int fbtft_remove_common(struct device *dev, struct fbtft_par *par)
 {
 	DRM_DEBUG_DRIVER("\n");
 
+	cancel_work_sync(&par->hw_init_work);
+
 	if (par->fbtftops.unregister_backlight)
 		par->fbtftops.unregister_backlight(par);
 
@@ -1094,4 +1958,47 @@ int fbtft_remove_common(struct device *dev, struct fbtft_par *par)
 }
 EXPORT_SYMBOL(fbtft_remove_common);
 
+static int __maybe_unused fbtft_pm_suspend(struct device *dev)
+{
+	struct fbtft_par *par = dev_get_drvdata(dev);
+
+	return tinydrm_suspend(&par->tinydrm);
+}
+
+/*
+ * The controller may have lost power, run the init sequence again. A display
+ * that failed to initialize at probe stays disconnected and is left alone.
+ */
+static int __maybe_unused fbtft_pm_resume(struct device *dev)
+{
+	struct fbtft_par *par = dev_get_drvdata(dev);
+	struct tinydrm_device *tdev = &par->tinydrm;
+	int ret = 0;
+
+	flush_work(&par->hw_init_work);
+
+	mutex_lock(&tdev->dirty_lock);
+	if (par->hw_ready) {
+		ret = fbtft_hw_init(par, false);
+		if (ret)
+			par->hw_ready = false;
+		else
+			par->next_full = true;
+	}
+	mutex_unlock(&tdev->dirty_lock);
+
+	if (ret) {
+		dev_err(par->info->device, "Failed to initialize display %d\n",
+			ret);
+		fbtft_connector_lost(par);
+	}
+
+	return tinydrm_resume(tdev);
+}
+
+const struct dev_pm_ops fbtft_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(fbtft_pm_suspend, fbtft_pm_resume)
+};
+EXPORT_SYMBOL(fbtft_pm_ops);
+
 MODULE_LICENSE("GPL");
@@ -1,14 +1,23 @@
+#include <linux/debugfs.h>
 #include <linux/export.h>
 #include <linux/errno.h>
 #include <linux/gpio.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
 #include <linux/spi/spi.h>
+#include <asm/unaligned.h>
 #include "fbtft.h"
 
-int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len)
+static int fbtft_write_spi_hz(struct fbtft_par *par, void *buf, size_t len,
+			      u32 speed_hz)
 {
 	struct spi_transfer t = {
 		.tx_buf = buf,
 		.len = len,
+		.speed_hz = speed_hz,
 	};
 	struct spi_message m;
 
@@ -25,25 +34,155 @@ int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len)
 	spi_message_add_tail(&t, &m);
 	return spi_sync(par->spi, &m);
 }
+
+/* Pixel data and drivers' own register writes */
+int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len)
+{
+	return fbtft_write_spi_hz(par, buf, len, fbtft_pixel_hz(par));
+}
 EXPORT_SYMBOL(fbtft_write_spi);
 
+/* Pack 8 9-bit words into 9 bytes, MSB first */
+static void fbtft_pack9_group(u8 *dst, const u16 *src)
+{
+	u64 val = 0;
+	int i;
+
+	for (i = 0; i < 7; i++)
+		val = (val << 9) | (src[i] & 0x1FF);
+	val = (val << 1) | ((src[7] >> 8) & 0x1);
+
+	put_unaligned_be64(val, dst);
+	dst[8] = src[7] & 0xFF;
+}
+
 /**
- * fbtft_write_spi_emulate_9() - write SPI emulating 9-bit
- * @par: Driver data
- * @buf: Buffer to write
- * @len: Length of buffer (must be divisible by 8)
+ * fbtft_pack9() - Pack 9-bit words into an 8-bit bitstream
+ * @dst: Destination buffer, DIV_ROUND_UP(@num, 8) * 9 bytes
+ * @src: 9-bit words, bit 8 is D/C
+ * @num: Number of words
  *
- * When 9-bit SPI is not available, this function can be used to emulate that.
- * par->extra must hold a transformation buffer used for transfer.
+ * A partial last group is padded at the end with zero words. On a MIPI
+ * controller that's a NOP command, which also ends a memory write, so only
+ * the last write of a pixel run may have a partial group.
+ *
+ * Return: Number of bytes written to @dst
  */
-int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len)
+size_t fbtft_pack9(u8 *dst, const u16 *src, size_t num)
+{
+	u16 group[8] = { 0 };
+	u8 *start = dst;
+
+	for (; num >= 8; num -= 8, src += 8, dst += 9)
+		fbtft_pack9_group(dst, src);
+
+	if (num) {
+		memcpy(group, src, num * sizeof(u16));
+		fbtft_pack9_group(dst, group);
+		dst += 9;
+	}
+
+	return dst - start;
+}
+EXPORT_SYMBOL(fbtft_pack9);
+
+/* RGB565 pixel as two 9-bit words: dc + high byte, dc + low byte */
+static inline u64 fbtft_pack9_pixel(u16 pixel)
+{
+	return 0x20100 | ((pixel & 0xFF00) << 1) | (pixel & 0xFF);
+}
+
+/**
+ * fbtft_pack9_rgb565() - Pack RGB565 pixels straight into a 9-bit bitstream
+ * @dst: Destination buffer, DIV_ROUND_UP(@num, 4) * 9 bytes
+ * @src: Pixels
+ * @num: Number of pixels
+ *
+ * 4 pixels make one 8-word group, which is one 64-bit store and a byte.
+ * A partial last group is padded like fbtft_pack9() does it.
+ *
+ * Return: Number of bytes written to @dst
+ */
+size_t fbtft_pack9_rgb565(u8 *dst, const u16 *src, size_t num)
+{
+	u16 group[8] = { 0 };
+	u64 c0, c1, c2, c3;
+	u8 *start = dst;
+	size_t i;
+
+	for (; num >= 4; num -= 4, src += 4, dst += 9) {
+		c0 = fbtft_pack9_pixel(src[0]);
+		c1 = fbtft_pack9_pixel(src[1]);
+		c2 = fbtft_pack9_pixel(src[2]);
+		c3 = fbtft_pack9_pixel(src[3]);
+		put_unaligned_be64(c0 << 46 | c1 << 28 | c2 << 10 | c3 >> 8,
+				   dst);
+		dst[8] = c3 & 0xFF;
+	}
+
+	if (num) {
+		for (i = 0; i < num; i++) {
+			group[2 * i] = 0x100 | (src[i] >> 8);
+			group[2 * i + 1] = 0x100 | (src[i] & 0xFF);
+		}
+		fbtft_pack9_group(dst, group);
+		dst += 9;
+	}
+
+	return dst - start;
+}
+EXPORT_SYMBOL(fbtft_pack9_rgb565);
+
+/* RGB565 to RGB444, the top 4 bits of each component */
+static inline u32 fbtft_rgb444(u16 pixel)
+{
+	return ((pixel >> 4) & 0xF00) | ((pixel >> 3) & 0xF0) |
+	       ((pixel >> 1) & 0xF);
+}
+
+/**
+ * fbtft_pack_rgb444() - Pack RGB565 pixels as 12-bit MIPI DBI pixels
+ * @dst: Destination buffer, DIV_ROUND_UP(@num * 3, 2) bytes
+ * @src: Pixels
+ * @num: Number of pixels
+ *
+ * Two pixels make three bytes: R1G1 B1R2 G2B2. An odd last pixel is padded
+ * with a zero nibble, the controller drops it when the memory write ends.
+ * Both pixels of a pair are loaded before storing, so @dst can be @src.
+ *
+ * Return: Number of bytes written to @dst
+ */
+size_t fbtft_pack_rgb444(u8 *dst, const u16 *src, size_t num)
+{
+	u8 *start = dst;
+	u32 c0, c1;
+
+	for (; num >= 2; num -= 2, src += 2, dst += 3) {
+		c0 = fbtft_rgb444(src[0]);
+		c1 = fbtft_rgb444(src[1]);
+		dst[0] = c0 >> 4;
+		dst[1] = (c0 & 0xF) << 4 | c1 >> 8;
+		dst[2] = c1 & 0xFF;
+	}
+
+	if (num) {
+		c0 = fbtft_rgb444(src[0]);
+		dst[0] = c0 >> 4;
+		dst[1] = (c0 & 0xF) << 4;
+		dst += 2;
+	}
+
+	return dst - start;
+}
+EXPORT_SYMBOL(fbtft_pack_rgb444);
+
+static int fbtft_write_spi_emulate_9_hz(struct fbtft_par *par, void *buf,
+					size_t len, u32 speed_hz)
 {
-	u16 *src = buf;
-	u8 *dst = par->extra;
-	size_t size = len / 2;
-	size_t added = 0;
-	int bits, i, j;
-	u64 val, dc, tmp;
+	struct spi_transfer t = {
+		.tx_buf = par->extra,
+		.speed_hz = speed_hz,
+	};
 
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 		"%s(len=%d): ", __func__, len);
@@ -53,40 +192,59 @@ int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len)
 			__func__);
 		return -EINVAL;
 	}
-	if ((len % 8) != 0) {
+	if (len % 2) {
 		dev_err(par->info->device,
-			"error: len=%zu must be divisible by 8\n", len);
+			"error: len=%zu must be divisible by 2\n", len);
 		return -EINVAL;
 	}
 
-	for (i = 0; i < size; i += 8) {
-		tmp = 0;
-		bits = 63;
-		for (j = 0; j < 7; j++) {
-			dc = (*src & 0x0100) ? 1 : 0;
-			val = *src & 0x00FF;
-			tmp |= dc << bits;
-			bits -= 8;
-			tmp |= val << bits--;
-			src++;
-		}
-		tmp |= ((*src & 0x0100) ? 1 : 0);
-		*(u64 *)dst = cpu_to_be64(tmp);
-		dst += 8;
-		*dst++ = (u8)(*src++ & 0x00FF);
-		added++;
-	}
+	t.len = fbtft_pack9(par->extra, buf, len / 2);
 
-	return spi_write(par->spi, par->extra, size + added);
+	return spi_sync_transfer(par->spi, &t, 1);
+}
+
+/**
+ * fbtft_write_spi_emulate_9() - write SPI emulating 9-bit
+ * @par: Driver data
+ * @buf: Buffer to write
+ * @len: Length of buffer in bytes (a whole number of 16-bit words)
+ *
+ * When 9-bit SPI is not available, this function can be used to emulate that.
+ * par->extra must hold a transformation buffer used for transfer.
+ */
+int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len)
+{
+	return fbtft_write_spi_emulate_9_hz(par, buf, len, fbtft_pixel_hz(par));
 }
 EXPORT_SYMBOL(fbtft_write_spi_emulate_9);
 
+/**
+ * fbtft_write_cmd_bytes() - Write command or parameter bytes
+ * @par: Driver data
+ * @buf: Buffer to write
+ * @len: Length of buffer
+ *
+ * Same as &fbtft_ops->write, but at the command clock when that is one of
+ * the default SPI writes.
+ */
+int fbtft_write_cmd_bytes(struct fbtft_par *par, void *buf, size_t len)
+{
+	if (par->fbtftops.write == fbtft_write_spi)
+		return fbtft_write_spi_hz(par, buf, len, fbtft_cmd_hz(par));
+	if (par->fbtftops.write == fbtft_write_spi_emulate_9)
+		return fbtft_write_spi_emulate_9_hz(par, buf, len,
+						    fbtft_cmd_hz(par));
+
+	return par->fbtftops.write(par, buf, len);
+}
+EXPORT_SYMBOL(fbtft_write_cmd_bytes);
+
 int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len)
 {
 	int ret;
 	u8 txbuf[32] = { 0, };
 	struct spi_transfer	t = {
-			.speed_hz = 2000000,
+			.speed_hz = fbtft_read_hz(par),
 			.rx_buf		= buf,
 			.len		= len,
 		};
@@ -121,62 +279,179 @@ int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len)
 }
 EXPORT_SYMBOL(fbtft_read_spi);
 
-static void tinydrm_i80_write_value(struct gpio_descs *db,
-				    struct gpio_desc *wr, u32 value,
-				    u32 *prev_value)
+/*
+ * A frame is one SPI message carrying everything a flush needs: the window
+ * commands, the startbytes and the pixel payload. The header bytes are
+ * copied to a small DMA-safe buffer, the payload is either converted into
+ * the frame buffer or sent in place from the (aligned) video memory.
+ */
+
+/**
+ * fbtft_frame_init() - Allocate the frame builder
+ * @par: Driver data
+ * @buf_len: Size of the payload buffer, zero if the payload is sent in place
+ * @max_len: Maximum payload length
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_frame_init(struct fbtft_par *par, size_t buf_len, size_t max_len)
 {
-	int i, values[32];
+	struct fbtft_frame *frame = &par->frame;
+	struct device *dev = &par->spi->dev;
+
+	frame->max_chunk = tinydrm_spi_max_transfer_size(par->spi, 0);
+	frame->max_tr = FBTFT_FRAME_HDR_TR +
+			DIV_ROUND_UP(max_len, frame->max_chunk);
+
+	frame->tr = devm_kcalloc(dev, frame->max_tr, sizeof(*frame->tr),
+				 GFP_KERNEL);
+	frame->hdr = devm_kmalloc(dev, FBTFT_FRAME_HDR_LEN, GFP_KERNEL);
+	if (!frame->tr || !frame->hdr)
+		return -ENOMEM;
+
+	if (buf_len) {
+		frame->buf = devm_kmalloc(dev, buf_len, GFP_KERNEL);
+		if (!frame->buf)
+			return -ENOMEM;
+		frame->len = buf_len;
+	}
 
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_frame_init);
 
-if (prev_value && *prev_value == value) {
-	gpiod_set_value_cansleep(wr, 0);
-	gpiod_set_value_cansleep(wr, 0);
-	gpiod_set_value_cansleep(wr, 1);
+/**
+ * fbtft_frame_begin() - Start building a frame
+ * @par: Driver data
+ */
+void fbtft_frame_begin(struct fbtft_par *par)
+{
+	struct fbtft_frame *frame = &par->frame;
 
-} else {
-	for (i = 0; i < db->ndescs; i++, value >>= 1)
-		values[i] = value & 1;
+	spi_message_init(&frame->m);
+	memset(frame->tr, 0, frame->max_tr * sizeof(*frame->tr));
+	frame->num_tr = 0;
+	frame->hdr_len = 0;
+}
+EXPORT_SYMBOL(fbtft_frame_begin);
 
-	gpiod_set_value_cansleep(wr, 0);
-	gpiod_set_array_value_cansleep(db->ndescs, db->desc, values);
-	gpiod_set_value_cansleep(wr, 1);
+static struct spi_transfer *fbtft_frame_next(struct fbtft_frame *frame)
+{
+	struct spi_transfer *tr;
 
+	if (frame->num_tr == frame->max_tr)
+		return NULL;
 
-}
-	if (prev_value)
-		*prev_value = value;
+	tr = &frame->tr[frame->num_tr++];
+	spi_message_add_tail(tr, &frame->m);
+
+	return tr;
 }
 
-static
-void tinydrm_i80_write_buf(struct gpio_descs *db, struct gpio_desc *wr,
-			   void *buf, size_t len)
+/**
+ * fbtft_frame_add_hdr() - Add a command or startbyte transfer
+ * @par: Driver data
+ * @data: Bytes to send, copied to the header buffer
+ * @len: Number of bytes
+ * @speed_hz: Transfer speed, zero for the device default
+ * @delay_usecs: Delay after the transfer
+ * @cs_change: Deassert chip select after the transfer
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_frame_add_hdr(struct fbtft_par *par, const void *data, size_t len,
+			u32 speed_hz, u16 delay_usecs, bool cs_change)
 {
-	unsigned int width = db->ndescs;
-	size_t i;
+	struct fbtft_frame *frame = &par->frame;
+	struct spi_transfer *tr;
 
-	if (width == 8) {
-		u8 *buf8 = buf;
-		u32 prev_val = ~*buf8;
+	if (frame->hdr_len + len > FBTFT_FRAME_HDR_LEN)
+		return -ENOSPC;
 
-		for (i = 0; i < len; i++)
-			tinydrm_i80_write_value(db, wr, *buf8++, NULL);
-	} else if (width == 16) {
-		u16 *buf16 = buf;
-		u32 prev_val = ~*buf16;
+	tr = fbtft_frame_next(frame);
+	if (!tr)
+		return -ENOSPC;
 
-		for (i = 0; i < (len / 2); i++)
-			tinydrm_i80_write_value(db, wr, *buf16++, NULL);
-	} else {
-		WARN_ON_ONCE(1);
+	memcpy(frame->hdr + frame->hdr_len, data, len);
+	tr->tx_buf = frame->hdr + frame->hdr_len;
+	tr->len = len;
+	tr->bits_per_word = 8;
+	tr->speed_hz = speed_hz;
+	tr->delay_usecs = delay_usecs;
+	tr->cs_change = cs_change;
+	frame->hdr_len += len;
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_frame_add_hdr);
+
+/**
+ * fbtft_frame_add_buf() - Add payload transfers
+ * @par: Driver data
+ * @buf: DMA-safe buffer, usually &fbtft_frame->buf or the video memory
+ * @len: Buffer length in bytes
+ * @bits_per_word: Word size, zero for the device default
+ * @speed_hz: Transfer speed, usually fbtft_pixel_hz()
+ *
+ * The buffer is split in chunks that the controller can handle, chip select
+ * stays asserted between them.
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_frame_add_buf(struct fbtft_par *par, const void *buf, size_t len,
+			u8 bits_per_word, u32 speed_hz)
+{
+	struct fbtft_frame *frame = &par->frame;
+	struct spi_transfer *tr;
+	size_t chunk;
+
+	while (len) {
+		chunk = min(len, frame->max_chunk);
+		tr = fbtft_frame_next(frame);
+		if (!tr)
+			return -ENOSPC;
+
+		tr->tx_buf = buf;
+		tr->len = chunk;
+		tr->bits_per_word = bits_per_word;
+		tr->speed_hz = speed_hz;
+		buf += chunk;
+		len -= chunk;
 	}
+
+	return 0;
 }
+EXPORT_SYMBOL(fbtft_frame_add_buf);
+
+/**
+ * fbtft_frame_submit() - Send the frame as one message
+ * @par: Driver data
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_frame_submit(struct fbtft_par *par)
+{
+	struct fbtft_frame *frame = &par->frame;
+
+	if (!frame->num_tr)
+		return 0;
+
+	/* Leave chip select to the core after the last transfer */
+	frame->tr[frame->num_tr - 1].cs_change = 0;
+
+	fbtft_par_dbg(DEBUG_WRITE, par, "%s: %u transfers\n", __func__,
+		      frame->num_tr);
+
+	return spi_sync(par->spi, &frame->m);
+}
+EXPORT_SYMBOL(fbtft_frame_submit);
 
 int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
 {
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 		"%s(len=%d): ", __func__, len);
 
-	tinydrm_i80_write_buf(par->gpio.db, par->gpio.wr, buf, len);
+	tinydrm_i80_gpio_write(par->i80, buf, len);
 
 	return 0;
 }
@@ -184,52 +459,112 @@ EXPORT_SYMBOL(fbtft_write_gpio8_wr);
 
 int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
 {
-#if 0
-	u16 data;
-	int i;
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-	static u16 prev_data;
-#endif
-
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 		"%s(len=%d): ", __func__, len);
 
-	while (len) {
-		data = *(u16 *)buf;
-
-		/* Start writing by pulling down /WR */
-		gpio_set_value(par->gpio.wr, 0);
-
-		/* Set data */
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		if (data == prev_data) {
-			gpio_set_value(par->gpio.wr, 0); /* used as delay */
-		} else {
-			for (i = 0; i < 16; i++) {
-				if ((data & 1) != (prev_data & 1))
-					gpio_set_value(par->gpio.db[i],
-								data & 1);
-				data >>= 1;
-				prev_data >>= 1;
-			}
-		}
-#else
-		for (i = 0; i < 16; i++) {
-			gpio_set_value(par->gpio.db[i], data & 1);
-			data >>= 1;
-		}
-#endif
+	/* The buffer holds native endian 16-bit words */
+	if (len % 2) {
+		dev_err(par->info->device, "%s: odd length %zu\n", __func__,
+			len);
+		return -EINVAL;
+	}
 
-		/* Pullup /WR */
-		gpio_set_value(par->gpio.wr, 1);
+	tinydrm_i80_gpio_write(par->i80, buf, len);
 
-#ifndef DO_NOT_OPTIMIZE_FBTFT_WRITE_GPIO
-		prev_data = *(u16 *)buf;
-#endif
-		buf += 2;
-		len -= 2;
-	}
-#endif
 	return 0;
 }
 EXPORT_SYMBOL(fbtft_write_gpio16_wr);
+
+#ifdef CONFIG_DEBUG_FS
+
+#define FBTFT_PACK9_BENCH_PIXELS	(SZ_64K / 2)
+
+static void fbtft_pack9_bench_report(struct seq_file *m, const char *name,
+				     ktime_t start)
+{
+	s64 us = max_t(s64, ktime_us_delta(ktime_get(), start), 1);
+
+	seq_printf(m, "%s: %u bytes in %lld us, %lld kB/s\n", name, SZ_64K, us,
+		   div64_s64((s64)SZ_64K * 1000, us));
+}
+
+/*
+ * Reading the file packs 64k of RGB565 pixels into the 9-bit bitstream,
+ * first in two passes like fbtft_write_vmem16_bus9() followed by
+ * fbtft_write_spi_emulate_9() and then fused, and reports the throughput.
+ * Nothing is sent to the display.
+ */
+static int fbtft_pack9_debugfs_bench_show(struct seq_file *m, void *d)
+{
+	size_t i, num = FBTFT_PACK9_BENCH_PIXELS;
+	u16 *pixels, *words;
+	ktime_t start;
+	u8 *dst;
+	int ret = -ENOMEM;
+
+	pixels = kmalloc_array(num, sizeof(u16), GFP_KERNEL);
+	words = kmalloc_array(num * 2, sizeof(u16), GFP_KERNEL);
+	dst = kmalloc(DIV_ROUND_UP(num, 4) * 9, GFP_KERNEL);
+	if (!pixels || !words || !dst)
+		goto out_free;
+
+	for (i = 0; i < num; i++)
+		pixels[i] = i * 0x9e37;
+
+	start = ktime_get();
+	for (i = 0; i < num; i++) {
+		words[2 * i] = 0x100 | (pixels[i] >> 8);
+		words[2 * i + 1] = 0x100 | (pixels[i] & 0xFF);
+	}
+	fbtft_pack9(dst, words, num * 2);
+	fbtft_pack9_bench_report(m, "two-pass", start);
+
+	start = ktime_get();
+	fbtft_pack9_rgb565(dst, pixels, num);
+	fbtft_pack9_bench_report(m, "fused", start);
+
+	ret = 0;
+
+out_free:
+	kfree(dst);
+	kfree(words);
+	kfree(pixels);
+
+	return ret;
+}
+
+static int fbtft_pack9_debugfs_bench_open(struct inode *inode,
+					  struct file *file)
+{
+	return single_open(file, fbtft_pack9_debugfs_bench_show,
+			   inode->i_private);
+}
+
+static const struct file_operations fbtft_pack9_debugfs_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = fbtft_pack9_debugfs_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * fbtft_pack9_debugfs_init() - Create 9-bit emulation debugfs entries
+ * @parent: Parent directory
+ *
+ * Creates a 'pack9_throughput' file that runs a packing benchmark when read.
+ *
+ * Return: 0 if successful, negative if error
+ */
+int fbtft_pack9_debugfs_init(struct dentry *parent)
+{
+	struct dentry *dentry;
+
+	dentry = debugfs_create_file("pack9_throughput", S_IRUSR, parent, NULL,
+				     &fbtft_pack9_debugfs_bench_fops);
+
+	return dentry ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(fbtft_pack9_debugfs_init);
+
+#endif
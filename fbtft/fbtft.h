@@ -17,6 +17,8 @@
 
 #include "../include/drm/tinydrm/tinydrm.h"
 #include "../include/drm/tinydrm/tinydrm-helpers.h"
+#include "../include/drm/tinydrm/tinydrm-helpers2.h"
+#include "../include/drm/tinydrm/tinydrm-regmap.h"
 
 #include <linux/fb.h>
 #include <linux/spinlock.h>
@@ -30,6 +32,8 @@
 #define FBTFT_MAX_INIT_SEQUENCE      512
 #define FBTFT_GAMMA_MAX_VALUES_TOTAL 128
 
+#define FBTFT_CAL_MAX_STEPS	16
+
 #define FBTFT_OF_INIT_CMD	BIT(24)
 #define FBTFT_OF_INIT_DELAY	BIT(25)
 
@@ -46,13 +50,28 @@ struct fbtft_gpio {
 
 struct fbtft_par;
 
+/**
+ * struct fbtft_init_cmd - Compiled init sequence entry
+ * @words: Command followed by its parameters
+ * @len: Number of words, zero if this is a delay
+ * @delay_ms: Delay in milliseconds
+ */
+struct fbtft_init_cmd {
+	const u16 *words;
+	u16 len;
+	u16 delay_ms;
+};
+
 /**
  * struct fbtft_ops - FBTFT operations structure
  * @write: Writes to interface bus
  * @read: Reads from interface bus
  * @write_vmem: Writes video memory to display
  * @write_reg: Writes to controller register
+ * @write_cmd: Writes a command followed by @num parameters from a buffer
  * @set_addr_win: Set the GRAM update window
+ * @write_frame: Set the window and write video memory in one bus submission
+ *               (optional)
  * @reset: Reset the LCD controller
  * @init_display: Initializes the display
  * @blank: Blank the display (optional)
@@ -71,9 +90,13 @@ struct fbtft_ops {
 	int (*read)(struct fbtft_par *par, void *buf, size_t len);
 	int (*write_vmem)(struct fbtft_par *par, size_t offset, size_t len);
 	void (*write_register)(struct fbtft_par *par, int len, ...);
+	int (*write_cmd)(struct fbtft_par *par, u16 cmd, const u16 *params,
+			 size_t num);
 
 	void (*set_addr_win)(struct fbtft_par *par,
 		int xs, int ys, int xe, int ye);
+	int (*write_frame)(struct fbtft_par *par, int xs, int ys, int xe,
+			   int ye, size_t offset, size_t len);
 	void (*reset)(struct fbtft_par *par);
 	int (*init_display)(struct fbtft_par *par);
 	int (*blank)(struct fbtft_par *par, bool on);
@@ -102,6 +125,15 @@ struct fbtft_display {
 	char *gamma;
 	int gamma_num;
 	int gamma_len;
+	unsigned int reset_assert_us;
+	unsigned int reset_settle_ms;
+	unsigned int cmd_speed_hz;
+	unsigned int read_speed_hz;
+	/*
+	 * The window ops take clips that are not full width, the clip is
+	 * packed at the start of the buffer
+	 */
+	bool partial_width;
 };
 
 /* Needed by fb_uc1611 and fb_ssd1351 */
@@ -128,6 +160,30 @@ struct fbtft_fb_info {
 	struct fbtft_fb_fix_screeninfo fix;
 };
 
+/**
+ * struct fbtft_frame - SPI message covering one flush
+ * @m: The message
+ * @tr: Transfer array
+ * @num_tr: Number of transfers in use
+ * @max_tr: Size of @tr
+ * @max_chunk: Maximum transfer length
+ * @hdr: DMA-safe buffer for commands and startbytes
+ * @hdr_len: Bytes in use in @hdr
+ * @buf: DMA-safe payload buffer, NULL if the payload is sent in place
+ * @len: Size of @buf
+ */
+struct fbtft_frame {
+	struct spi_message m;
+	struct spi_transfer *tr;
+	unsigned int num_tr;
+	unsigned int max_tr;
+	size_t max_chunk;
+	u8 *hdr;
+	size_t hdr_len;
+	void *buf;
+	size_t len;
+};
+
 struct fbtft_par {
 	struct tinydrm_device tinydrm;
 	struct spi_device *spi;
@@ -142,9 +198,17 @@ struct fbtft_par {
 		unsigned int len;
 	} txbuf;
 	u8 *buf;
+	struct {
+		u16 *buf;
+		unsigned int len;
+		bool active;
+	} cmdq;
 	u8 startbyte;
+	struct fbtft_frame frame;
+	struct tinydrm_spi_clocks *clocks;
 	struct fbtft_ops fbtftops;
 	spinlock_t dirty_lock;
+	struct tinydrm_fingerprint fingerprint;
 	unsigned int dirty_lines_start;
 	unsigned int dirty_lines_end;
 	struct {
@@ -156,7 +220,34 @@ struct fbtft_par {
 		struct gpio_descs *db;
 		int led[16];
 	} gpio;
+	struct tinydrm_i80_gpio *i80;
+	struct tinydrm_te *te;
+	struct work_struct hw_init_work;
+	struct {
+		bool enabled;
+		int error;
+		unsigned int num;
+		u32 hz[FBTFT_CAL_MAX_STEPS];
+		bool pass[FBTFT_CAL_MAX_STEPS];
+		u32 chosen_hz;
+	} cal;
+	struct {
+		unsigned int bpp;
+		bool autoswitch;
+		unsigned int active;
+		unsigned int programmed;
+		unsigned int count;
+	} wire;
+	bool adopt;
+	bool hw_ready;
+	bool enabled;
+	bool splash;
+	bool next_full;
 	s16 *init_sequence;
+	struct {
+		struct fbtft_init_cmd *cmds;
+		unsigned int num;
+	} init;
 	struct {
 		struct mutex lock;
 		unsigned long *curves;
@@ -176,6 +267,56 @@ struct fbtft_par {
 #define write_reg(par, ...)                                              \
 	par->fbtftops.write_register(par, NUMARGS(__VA_ARGS__), __VA_ARGS__)
 
+/* Size of par->buf */
+#define FBTFT_BUF_LEN		128
+
+/* Maximum number of parameters that fit in par->buf after the startbyte */
+#define FBTFT_CMD_MAX_PARAMS	63
+
+/* Size of the 9-bit command queue in words */
+#define FBTFT_CMDQ_WORDS	256
+
+/* Size of the frame header buffer and the transfers reserved for it */
+#define FBTFT_FRAME_HDR_LEN	64
+#define FBTFT_FRAME_HDR_TR	32
+
+/* set_addr_win on a 9-bit bus: 3 commands and 8 parameters */
+#define FBTFT_FRAME_WIN_WORDS	11
+
+/* No-ops that put the window at the end of two 8-word groups */
+#define FBTFT_FRAME_WIN_PAD	5
+
+/**
+ * fbtft_write_cmd - Write command with constant parameters
+ * @par: Driver data
+ * @cmd: Command
+ * @seq: Parameters, the array size is known at compile time
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+#define fbtft_write_cmd(par, cmd, seq...)                                \
+({                                                                       \
+	const u16 _params[] = { seq };                                   \
+	(par)->fbtftops.write_cmd(par, cmd, _params, ARRAY_SIZE(_params)); \
+})
+
+/* SPI clocks per transfer class, zero is the device default */
+static inline u32 fbtft_cmd_hz(struct fbtft_par *par)
+{
+	return par->clocks ? READ_ONCE(par->clocks->cmd_hz) : 0;
+}
+
+static inline u32 fbtft_pixel_hz(struct fbtft_par *par)
+{
+	return par->clocks ? READ_ONCE(par->clocks->pixel_hz) : 0;
+}
+
+static inline u32 fbtft_read_hz(struct fbtft_par *par)
+{
+	return par->clocks ? READ_ONCE(par->clocks->read_hz) : 0;
+}
+
 /* fbtft-core.c */
 void fbtft_dbg_hex(const struct device *dev, int groupsize,
 		   void *buf, size_t len, const char *fmt, ...);
@@ -183,6 +324,8 @@ int fbtft_probe_common(struct fbtft_display *display, struct spi_device *sdev,
 		       struct platform_device *pdev);
 int fbtft_remove_common(struct device *dev, struct fbtft_par *par);
 
+extern const struct dev_pm_ops fbtft_pm_ops;
+
 #ifdef CONFIG_BACKLIGHT_CLASS_DEVICE
 void fbtft_register_backlight(struct fbtft_par *par);
 void fbtft_unregister_backlight(struct fbtft_par *par);
@@ -197,10 +340,29 @@ static inline void fbtft_unregister_backlight(struct fbtft_par *par)
 
 /* fbtft-io.c */
 int fbtft_write_spi(struct fbtft_par *par, void *buf, size_t len);
+int fbtft_write_cmd_bytes(struct fbtft_par *par, void *buf, size_t len);
+size_t fbtft_pack9(u8 *dst, const u16 *src, size_t num);
+size_t fbtft_pack9_rgb565(u8 *dst, const u16 *src, size_t num);
+size_t fbtft_pack_rgb444(u8 *dst, const u16 *src, size_t num);
 int fbtft_write_spi_emulate_9(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len);
+int fbtft_frame_init(struct fbtft_par *par, size_t buf_len, size_t max_len);
+void fbtft_frame_begin(struct fbtft_par *par);
+int fbtft_frame_add_hdr(struct fbtft_par *par, const void *data, size_t len,
+			u32 speed_hz, u16 delay_usecs, bool cs_change);
+int fbtft_frame_add_buf(struct fbtft_par *par, const void *buf, size_t len,
+			u8 bits_per_word, u32 speed_hz);
+int fbtft_frame_submit(struct fbtft_par *par);
+#ifdef CONFIG_DEBUG_FS
+int fbtft_pack9_debugfs_init(struct dentry *parent);
+#else
+static inline int fbtft_pack9_debugfs_init(struct dentry *parent)
+{
+	return 0;
+}
+#endif
 
 /* fbtft-bus.c */
 int fbtft_write_vmem16_bus16(struct fbtft_par *par, size_t offset, size_t len);
@@ -210,6 +372,22 @@ void fbtft_write_reg8_bus8(struct fbtft_par *par, int len, ...);
 void fbtft_write_reg8_bus9(struct fbtft_par *par, int len, ...);
 void fbtft_write_reg16_bus8(struct fbtft_par *par, int len, ...);
 void fbtft_write_reg16_bus16(struct fbtft_par *par, int len, ...);
+int fbtft_write_cmd8_bus8(struct fbtft_par *par, u16 cmd, const u16 *params,
+			  size_t num);
+int fbtft_write_cmd8_bus9(struct fbtft_par *par, u16 cmd, const u16 *params,
+			  size_t num);
+int fbtft_write_cmd16_bus8(struct fbtft_par *par, u16 cmd, const u16 *params,
+			   size_t num);
+int fbtft_write_cmd16_bus16(struct fbtft_par *par, u16 cmd, const u16 *params,
+			    size_t num);
+int fbtft_write_frame_bus9(struct fbtft_par *par, int xs, int ys, int xe,
+			   int ye, size_t offset, size_t len);
+int fbtft_write_frame_bus9_emulate(struct fbtft_par *par, int xs, int ys,
+				   int xe, int ye, size_t offset, size_t len);
+int fbtft_write_frame_startbyte(struct fbtft_par *par, int xs, int ys, int xe,
+				int ye, size_t offset, size_t len);
+void fbtft_cmd_queue_begin(struct fbtft_par *par);
+int fbtft_cmd_queue_flush(struct fbtft_par *par);
 
 #define FBTFT_REGISTER_DRIVER(_name, _compatible, _display)                \
 									   \
@@ -249,6 +427,8 @@ static struct spi_driver fbtft_driver_spi_driver = {                       \
 	.driver = {                                                        \
 		.name   = _name,                                           \
 		.of_match_table = of_match_ptr(dt_ids),                    \
+		.pm = &fbtft_pm_ops,                                       \
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,                   \
 	},                                                                 \
 	.probe  = fbtft_driver_probe_spi,                                  \
 	.remove = fbtft_driver_remove_spi,                                 \
@@ -259,6 +439,8 @@ static struct platform_driver fbtft_driver_platform_driver = {             \
 		.name   = _name,                                           \
 		.owner  = THIS_MODULE,                                     \
 		.of_match_table = of_match_ptr(dt_ids),                    \
+		.pm = &fbtft_pm_ops,                                       \
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,                   \
 	},                                                                 \
 	.probe  = fbtft_driver_probe_pdev,                                 \
 	.remove = fbtft_driver_remove_pdev,                                \
@@ -24,14 +24,185 @@ In file included from /home/pi/tinydrm/tinydrm/include/drm/tinydrm/tinydrm-helpe
 */
 struct drm_framebuffer;
 
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <drm/drm.h>
+#include <drm/drm_framebuffer.h>
 #include <drm/tinydrm/tinydrm-helpers.h>
 
+struct dentry;
+struct device;
+struct drm_device;
+struct drm_plane_state;
+struct drm_simple_display_pipe;
 struct gpio_desc;
+struct mipi_dbi;
+struct spi_device;
+struct tinydrm_device;
+struct tinydrm_te;
+
+#define TINYDRM_FINGERPRINT_SLOTS	8
+
+/**
+ * struct tinydrm_fingerprint - Content fingerprint of transmitted regions
+ * @clips: Regions last transmitted to the panel
+ * @hashes: Content hash of the regions in @clips
+ * @num: Number of valid entries in @clips
+ * @next: Entry to replace when the cache is full
+ * @disabled: Don't skip flushes (debugfs tunable)
+ * @hits: Number of flushes skipped because the content was unchanged
+ * @misses: Number of flushes that had to be transmitted
+ * @skipped_bytes: Number of framebuffer bytes that was not transmitted
+ * @lock: Lock that the debugfs file takes, see
+ *        tinydrm_fingerprint_debugfs_init()
+ *
+ * The caller is responsible for serializing access, usually by holding
+ * &tinydrm_device->dirty_lock.
+ */
+struct tinydrm_fingerprint {
+	struct drm_clip_rect clips[TINYDRM_FINGERPRINT_SLOTS];
+	u32 hashes[TINYDRM_FINGERPRINT_SLOTS];
+	unsigned int num;
+	unsigned int next;
+	bool disabled;
+	u64 hits;
+	u64 misses;
+	u64 skipped_bytes;
+	struct mutex *lock;
+};
 
 int tinydrm_rgb565_buf_copy(void *dst, struct drm_framebuffer *fb,
 			    struct drm_clip_rect *clip, bool swap);
 
-void tinydrm_hw_reset(struct gpio_desc *reset, unsigned int assert_ms,
+/**
+ * struct tinydrm_splash_funcs - Boot splash controller callbacks
+ * @set_window: Set the controller memory window for the image
+ * @write: Write RGB565 pixels to the window, native endian, length in bytes
+ */
+struct tinydrm_splash_funcs {
+	int (*set_window)(void *arg, const struct drm_clip_rect *clip);
+	int (*write)(void *arg, void *buf, size_t len);
+};
+
+int tinydrm_splash_draw(struct device *dev, unsigned int width,
+			unsigned int height, void *buf, size_t len,
+			const struct tinydrm_splash_funcs *funcs, void *arg);
+
+/**
+ * struct tinydrm_spi_clocks - SPI clock policy per transfer class
+ * @cmd_hz: Maximum clock for commands and their parameters
+ * @pixel_hz: Maximum clock for pixel data
+ * @read_hz: Maximum clock for reads
+ *
+ * Zero means &spi_device->max_speed_hz. The values are used as
+ * &spi_transfer->speed_hz and can be changed at runtime through debugfs, so
+ * read them once per message with READ_ONCE().
+ */
+struct tinydrm_spi_clocks {
+	u32 cmd_hz;
+	u32 pixel_hz;
+	u32 read_hz;
+};
+
+struct tinydrm_spi_clocks *
+devm_tinydrm_spi_clocks_init(struct spi_device *spi, u32 cmd_hz, u32 pixel_hz,
+			     u32 read_hz);
+struct tinydrm_spi_clocks *tinydrm_spi_clocks_get(struct device *dev);
+
+void tinydrm_msleep(unsigned int ms);
+void tinydrm_hw_reset(struct gpio_desc *reset, unsigned int assert_us,
 		      unsigned int settle_ms);
 
+/**
+ * tinydrm_fingerprint_reset - Forget all transmitted regions
+ * @fp: Fingerprint cache
+ *
+ * This should be called when the panel content is lost (reset, power off) or
+ * when a transfer has failed.
+ */
+static inline void tinydrm_fingerprint_reset(struct tinydrm_fingerprint *fp)
+{
+	fp->num = 0;
+	fp->next = 0;
+}
+
+bool tinydrm_fingerprint_unchanged(struct tinydrm_fingerprint *fp,
+				   struct drm_framebuffer *fb,
+				   struct drm_clip_rect *clip);
+
+/**
+ * struct tinydrm_mipi_flush - Flush front end for mipi-dbi drivers
+ * @fb_funcs: mipi-dbi framebuffer functions with the wrapping dirty callback
+ * @mipi_fb_funcs: The wrapped mipi-dbi framebuffer functions
+ * @mipi: MIPI DBI device
+ * @te: Tearing effect to follow, can be NULL
+ * @lock: Serializes flushes, protects @fingerprint and @next_full
+ * @fingerprint: Content of the regions last transmitted
+ * @next_full: A splash is up, the next flush redraws the whole framebuffer
+ */
+struct tinydrm_mipi_flush {
+	struct drm_framebuffer_funcs fb_funcs;
+	const struct drm_framebuffer_funcs *mipi_fb_funcs;
+	struct mipi_dbi *mipi;
+	struct tinydrm_te *te;
+	struct mutex lock;
+	struct tinydrm_fingerprint fingerprint;
+	bool next_full;
+};
+
+void tinydrm_mipi_flush_init(struct tinydrm_mipi_flush *flush,
+			     struct mipi_dbi *mipi, struct tinydrm_te *te);
+void tinydrm_mipi_flush_reset(struct tinydrm_mipi_flush *flush);
+void tinydrm_mipi_flush_splash(struct tinydrm_mipi_flush *flush);
+
+/* Maximum number of bands tinydrm_te_split() splits a clip into */
+#define TINYDRM_TE_BANDS	8
+
+struct tinydrm_te *devm_tinydrm_te_init(struct device *dev, unsigned int fps);
+void tinydrm_te_set_scan(struct tinydrm_te *te, unsigned int lines,
+			 bool columns, bool reverse);
+int tinydrm_te_wait(struct tinydrm_te *te);
+ktime_t tinydrm_te_timestamp(struct tinydrm_te *te);
+ktime_t tinydrm_te_edge(struct tinydrm_te *te);
+unsigned int tinydrm_te_period_us(struct tinydrm_te *te);
+unsigned int tinydrm_te_split(struct tinydrm_te *te,
+			      const struct drm_clip_rect *clip,
+			      struct drm_clip_rect *bands);
+void tinydrm_te_wait_band(struct tinydrm_te *te,
+			  const struct drm_clip_rect *band);
+
+int devm_tinydrm_vblank_init(struct tinydrm_device *tdev, unsigned int fps,
+			     struct tinydrm_te *te);
+int tinydrm_vblank_enable(struct drm_device *drm, unsigned int pipe);
+void tinydrm_vblank_disable(struct drm_device *drm, unsigned int pipe);
+void tinydrm_vblank_pipe_event(struct drm_simple_display_pipe *pipe);
+void tinydrm_vblank_pipe_update(struct drm_simple_display_pipe *pipe,
+				struct drm_plane_state *old_state);
+
+#ifdef CONFIG_DEBUG_FS
+int tinydrm_fingerprint_debugfs_init(struct tinydrm_fingerprint *fp,
+				     struct dentry *parent, struct mutex *lock);
+int tinydrm_spi_clocks_debugfs_init(struct device *dev, struct dentry *parent);
+int tinydrm_te_debugfs_init(struct tinydrm_te *te, struct dentry *parent);
+#else
+static inline int
+tinydrm_fingerprint_debugfs_init(struct tinydrm_fingerprint *fp,
+				 struct dentry *parent, struct mutex *lock)
+{
+	return 0;
+}
+
+static inline int tinydrm_spi_clocks_debugfs_init(struct device *dev,
+						  struct dentry *parent)
+{
+	return 0;
+}
+
+static inline int tinydrm_te_debugfs_init(struct tinydrm_te *te,
+					  struct dentry *parent)
+{
+	return 0;
+}
+#endif
+
 #endif /* __LINUX_TINYDRM_HELPERS_ADD_H */
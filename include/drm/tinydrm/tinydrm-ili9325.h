@@ -10,18 +10,34 @@
 #ifndef __LINUX_TINYDRM_ILI9325_H
 #define __LINUX_TINYDRM_ILI9325_H
 
+#include <linux/regmap.h>
 #include <drm/tinydrm/tinydrm.h>
 #include <drm/tinydrm/tinydrm-helpers2.h>
 
+struct tinydrm_regmap_raw;
+
 /**
  * struct tinydrm_ili9325 - tinydrm ILI9325 device
  * @tinydrm: Base &tinydrm_device
  * @reg: Register map (optional)
+ * @raw: Raw bus access of @reg, NULL if the bus has none
  * @enabled: Pipeline is enabled
+ * @initialized: Controller is initialized and the register cache matches it
+ * @blanked: Display is turned off with the controller kept powered
+ * @adopt: Try to take over the controller in probe
+ * @splash: Show the boot splash after the first initialization
+ * @next_full: A splash or the adopted bootloader image is up, the next flush
+ *             redraws the whole framebuffer
  * @tx_buf: Transmit buffer
  * @swap_bytes: Swap pixel data bytes
  * @always_tx_buf:
+ * @fingerprint: Content of the regions last transmitted
+ * @flushes: Number of flushes sent to the panel
+ * @copied_bytes: Pixel bytes sent through @tx_buf
+ * @direct_bytes: Pixel bytes sent straight from the framebuffer
  * @rotation: Rotation in degrees Counter Clock Wise
+ * @width: Panel width in GRAM columns, unrotated
+ * @height: Panel height in GRAM rows, unrotated
  * @reset: Optional reset gpio
  * @backlight: Optional backlight device
  * @regulator: Optional regulator
@@ -29,11 +45,23 @@
 struct tinydrm_ili9325 {
 	struct tinydrm_device tinydrm;
 	struct regmap *reg;
+	struct tinydrm_regmap_raw *raw;
 	bool enabled;
+	bool initialized;
+	bool blanked;
+	bool adopt;
+	bool splash;
+	bool next_full;
 	void *tx_buf;
 	bool swap_bytes;
 	bool always_tx_buf;
+	struct tinydrm_fingerprint fingerprint;
+	u64 flushes;
+	u64 copied_bytes;
+	u64 direct_bytes;
 	unsigned int rotation;
+	unsigned int width;
+	unsigned int height;
 	struct gpio_desc *reset;
 	struct backlight_device *backlight;
 	struct regulator *regulator;
@@ -53,9 +81,26 @@ int tinydrm_ili9325_init(struct device *dev, struct tinydrm_ili9325 *cntrl,
 
 static inline void tinydrm_ili9325_reset(struct tinydrm_ili9325 *controller)
 {
-	tinydrm_hw_reset(controller->reset, 1, 10);
+	tinydrm_hw_reset(controller->reset, 1000, 10);
+	/* The controller is back at its reset values, don't trust the cache */
+	if (controller->reg)
+		regcache_mark_dirty(controller->reg);
 }
 
+void tinydrm_ili9325_pipe_update(struct drm_simple_display_pipe *pipe,
+				 struct drm_plane_state *old_state);
+void tinydrm_ili9325_display_off(struct tinydrm_ili9325 *ili9325);
+void tinydrm_ili9325_power_down(struct tinydrm_ili9325 *ili9325);
+bool tinydrm_ili9325_display_on(struct tinydrm_ili9325 *ili9325);
+bool tinydrm_ili9325_adopt(struct tinydrm_ili9325 *ili9325,
+			   unsigned int entry_mode);
+bool tinydrm_ili9325_splash(struct tinydrm_ili9325 *ili9325);
+
+struct regmap *tinydrm_ili9325_i80_init(struct device *dev,
+					struct gpio_desc *cs,
+					struct gpio_desc *idx,
+					struct gpio_desc *wr,
+					struct gpio_descs *db);
 struct regmap *tinydrm_ili9325_spi_init(struct spi_device *spi,
 					unsigned int id);
 
@@ -16,10 +16,84 @@
 struct gpio_descs;
 struct gpio_desc;
 struct dentry;
+struct kvec;
+struct mutex;
 struct regmap;
+struct regmap_config;
+struct reg_sequence;
+struct tinydrm_i80_gpio;
+struct tinydrm_regmap_raw;
+
+/**
+ * struct tinydrm_regmap_raw_funcs - Raw bus access
+ * @write: Write the @num_seq registers in @seq, then latch register @regnr
+ *         and write the @num buffers in @vec to it, see
+ *         tinydrm_regmap_raw_writev(). With @async the bus can keep using
+ *         the buffers after it returns, see
+ *         tinydrm_regmap_raw_writev_async().
+ * @sync: Wait for the writes issued so far to complete (optional), see
+ *        tinydrm_regmap_raw_sync().
+ */
+struct tinydrm_regmap_raw_funcs {
+	int (*write)(void *context, const struct reg_sequence *seq,
+		     unsigned int num_seq, unsigned int regnr,
+		     const struct kvec *vec, unsigned int num, bool async);
+	void (*sync)(void *context);
+};
 
 bool tinydrm_regmap_raw_swap_bytes(struct regmap *reg);
+int devm_tinydrm_regmap_raw_init(struct regmap *reg,
+				 const struct tinydrm_regmap_raw_funcs *funcs,
+				 void *context);
+struct tinydrm_regmap_raw *tinydrm_regmap_raw_get(struct regmap *reg);
+int tinydrm_regmap_raw_writev(struct regmap *reg,
+			      struct tinydrm_regmap_raw *raw,
+			      const struct reg_sequence *seq,
+			      unsigned int num_seq, unsigned int regnr,
+			      const struct kvec *vec, unsigned int num);
+int tinydrm_regmap_raw_writev_async(struct regmap *reg,
+				    struct tinydrm_regmap_raw *raw,
+				    const struct reg_sequence *seq,
+				    unsigned int num_seq, unsigned int regnr,
+				    const struct kvec *vec, unsigned int num);
+void tinydrm_regmap_raw_sync(struct tinydrm_regmap_raw *raw);
+
+struct tinydrm_i80_gpio *tinydrm_i80_gpio_init(struct device *dev,
+					       struct gpio_desc *wr,
+					       struct gpio_descs *db);
+void tinydrm_i80_gpio_write(struct tinydrm_i80_gpio *i80, const void *buf,
+			    size_t len);
+
+#ifdef CONFIG_DEBUG_FS
+int tinydrm_i80_gpio_debugfs_init(struct tinydrm_i80_gpio *i80,
+				  struct dentry *parent, struct mutex *lock,
+				  const bool *enabled);
+int tinydrm_i80_debugfs_init(struct regmap *reg, struct dentry *parent,
+			     struct mutex *lock, const bool *enabled);
+#else
+static inline int tinydrm_i80_gpio_debugfs_init(struct tinydrm_i80_gpio *i80,
+						struct dentry *parent,
+						struct mutex *lock,
+						const bool *enabled)
+{
+	return 0;
+}
+
+static inline int tinydrm_i80_debugfs_init(struct regmap *reg,
+					   struct dentry *parent,
+					   struct mutex *lock,
+					   const bool *enabled)
+{
+	return 0;
+}
+#endif
 
+struct regmap *tinydrm_i80_init_config(struct device *dev,
+				       const struct regmap_config *config,
+				       struct gpio_desc *cs,
+				       struct gpio_desc *idx,
+				       struct gpio_desc *wr,
+				       struct gpio_descs *db);
 struct regmap *tinydrm_i80_init(struct device *dev, unsigned int reg_width,
 				struct gpio_desc *cs, struct gpio_desc *idx,
 				struct gpio_desc *wr, struct gpio_descs *db);
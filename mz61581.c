@@ -16,22 +16,37 @@
 #include <linux/spi/spi.h>
 
 #include <drm/tinydrm/mipi-dbi.h>
-#include <drm/tinydrm/tinydrm-helpers.h>
+#include <drm/tinydrm/tinydrm-helpers2.h>
 
 #include <video/mipi_display.h>
 
+/*
+ * R61581 minimums: a 1 ms reset pulse, then 10 ms before commands are
+ * accepted. Reading is not supported, so a running controller can't be
+ * verified and adopted, it's always reset.
+ */
+#define MZ61581_RESET_US	1000
+#define MZ61581_RESET_MS	10
+
+struct mz61581 {
+	struct mipi_dbi mipi;
+	struct tinydrm_mipi_flush flush;
+};
+
+static inline struct mz61581 *
+mz61581_from_tinydrm(struct tinydrm_device *tdev)
+{
+	return container_of(tdev, struct mz61581, mipi.tinydrm);
+}
+
 /* Renesas R61581 controller with a CPLD SPI conversion in front */
-static void mz61581_enable(struct drm_simple_display_pipe *pipe,
-			   struct drm_crtc_state *crtc_state)
+static void mz61581_hw_init(struct mz61581 *priv)
 {
-	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
-	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
-	struct drm_framebuffer *fb = pipe->plane.fb;
+	struct mipi_dbi *mipi = &priv->mipi;
+	struct drm_mode_config *mode_config = &mipi->tinydrm.drm->mode_config;
 	u8 addr_mode;
 
-	DRM_DEBUG_KMS("\n");
-
-	mipi_dbi_hw_reset(mipi);
+	tinydrm_hw_reset(mipi->reset, MZ61581_RESET_US, MZ61581_RESET_MS);
 
 	mipi_dbi_command(mipi, 0xb0, 0x00);
 	mipi_dbi_command(mipi, MIPI_DCS_EXIT_SLEEP_MODE);
@@ -77,12 +92,40 @@ static void mz61581_enable(struct drm_simple_display_pipe *pipe,
 	addr_mode |= BGR;
 	mipi_dbi_command(mipi, MIPI_DCS_SET_ADDRESS_MODE, addr_mode);
 
+	/* The scan runs along the panel rows, MV puts them on the columns */
+	if (priv->flush.te)
+		tinydrm_te_set_scan(priv->flush.te,
+				    addr_mode & MV ? mode_config->min_width :
+						     mode_config->min_height,
+				    addr_mode & MV, addr_mode & MY);
+
 	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_ON);
+}
+
+static void mz61581_enable(struct drm_simple_display_pipe *pipe,
+			   struct drm_crtc_state *crtc_state)
+{
+	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
+	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
+	struct mz61581 *priv = mz61581_from_tinydrm(tdev);
+	struct drm_framebuffer *fb = pipe->plane.fb;
+	bool splash = priv->flush.next_full;
+
+	DRM_DEBUG_KMS("\n");
+
+	/* Disable leaves the controller running, the splash is still up */
+	if (!splash) {
+		mz61581_hw_init(priv);
+		/* The panel content was lost on reset */
+		tinydrm_mipi_flush_reset(&priv->flush);
+	}
 
 	mipi->enabled = true;
-	fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	if (!splash)
+		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
 
 	tinydrm_enable_backlight(mipi->backlight);
+	drm_crtc_vblank_on(&pipe->crtc);
 }
 
 static void mz61581_disable(struct drm_simple_display_pipe *pipe)
@@ -92,6 +135,7 @@ static void mz61581_disable(struct drm_simple_display_pipe *pipe)
 
 	DRM_DEBUG_KMS("\n");
 
+	drm_crtc_vblank_off(&pipe->crtc);
 	mipi->enabled = false;
 	tinydrm_disable_backlight(mipi->backlight);
 }
@@ -99,7 +143,7 @@ static void mz61581_disable(struct drm_simple_display_pipe *pipe)
 static const struct drm_simple_display_pipe_funcs mz61581_funcs = {
 	.enable = mz61581_enable,
 	.disable = mz61581_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_vblank_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
@@ -107,12 +151,37 @@ static const struct drm_display_mode mz61581_mode = {
 	TINYDRM_MODE(480, 320, 73, 49),
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int mz61581_debugfs_init(struct drm_minor *minor)
+{
+	struct tinydrm_device *tdev = minor->dev->dev_private;
+	struct mz61581 *priv = mz61581_from_tinydrm(tdev);
+	int ret;
+
+	ret = mipi_dbi_debugfs_init(minor);
+	if (ret)
+		return ret;
+
+	ret = tinydrm_te_debugfs_init(priv->flush.te, minor->debugfs_root);
+	if (ret)
+		return ret;
+
+	return tinydrm_fingerprint_debugfs_init(&priv->flush.fingerprint,
+						minor->debugfs_root,
+						&priv->flush.lock);
+}
+#else
+#define mz61581_debugfs_init	NULL
+#endif
+
 static struct drm_driver mz61581_driver = {
 	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_PRIME |
 				  DRIVER_ATOMIC,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
-	.debugfs_init		= mipi_dbi_debugfs_init,
+	.enable_vblank		= tinydrm_vblank_enable,
+	.disable_vblank		= tinydrm_vblank_disable,
+	.debugfs_init		= mz61581_debugfs_init,
 	.name			= "mz61581",
 	.desc			= "Tontec mz61581",
 	.date			= "20170316",
@@ -136,15 +205,19 @@ static int mz61581_probe(struct spi_device *spi)
 {
 	struct device *dev = &spi->dev;
 	struct tinydrm_device *tdev;
+	struct tinydrm_te *te;
+	struct mz61581 *priv;
 	struct mipi_dbi *mipi;
 	struct gpio_desc *dc;
 	u32 rotation = 0;
 	int ret;
 
-	mipi = devm_kzalloc(dev, sizeof(*mipi), GFP_KERNEL);
-	if (!mipi)
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
 		return -ENOMEM;
 
+	mipi = &priv->mipi;
+
 	mipi->reset = devm_gpiod_get_optional(dev, "reset", GPIOD_OUT_HIGH);
 	if (IS_ERR(mipi->reset)) {
 		dev_err(dev, "Failed to get gpio 'reset'\n");
@@ -161,6 +234,10 @@ static int mz61581_probe(struct spi_device *spi)
 	if (IS_ERR(mipi->backlight))
 		return PTR_ERR(mipi->backlight);
 
+	te = devm_tinydrm_te_init(dev, 0);
+	if (IS_ERR(te))
+		return PTR_ERR(te);
+
 	device_property_read_u32(dev, "rotation", &rotation);
 
 	ret = mipi_dbi_spi_init(spi, mipi, dc, &mz61581_funcs,
@@ -173,6 +250,21 @@ static int mz61581_probe(struct spi_device *spi)
 
 	tdev = &mipi->tinydrm;
 
+	ret = devm_tinydrm_vblank_init(tdev, 0, te);
+	if (ret)
+		return ret;
+
+	tinydrm_mipi_flush_init(&priv->flush, mipi, te);
+
+	/*
+	 * With a 'splash' property the controller is brought up in probe and
+	 * the image is put in GRAM before the DRM device is registered.
+	 */
+	if (device_property_present(dev, "splash")) {
+		mz61581_hw_init(priv);
+		tinydrm_mipi_flush_splash(&priv->flush);
+	}
+
 	ret = devm_tinydrm_register(tdev);
 	if (ret)
 		return ret;
@@ -199,6 +291,7 @@ static struct spi_driver mz61581_spi_driver = {
 		.name = "mz61581",
 		.owner = THIS_MODULE,
 		.of_match_table = mz61581_of_match,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.id_table = mz61581_id,
 	.probe = mz61581_probe,
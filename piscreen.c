@@ -17,10 +17,32 @@
 #include <linux/spi/spi.h>
 
 #include <drm/tinydrm/mipi-dbi.h>
-#include <drm/tinydrm/tinydrm-helpers.h>
+#include <drm/tinydrm/tinydrm-helpers2.h>
 
 #include <video/mipi_display.h>
 
+/*
+ * ILI9486 and ILI9488 minimums: a 10 us reset pulse, then 120 ms before
+ * Sleep Out is accepted.
+ */
+#define PISCREEN_RESET_US	10
+#define PISCREEN_RESET_MS	120
+
+/* Default clock for commands and configuration data */
+#define PISCREEN_CMD_HZ		10000000
+
+struct piscreen {
+	struct mipi_dbi mipi;
+	struct tinydrm_mipi_flush flush;
+	struct tinydrm_spi_clocks *clocks;
+};
+
+static inline struct piscreen *
+piscreen_from_tinydrm(struct tinydrm_device *tdev)
+{
+	return container_of(tdev, struct piscreen, mipi.tinydrm);
+}
+
 /*
  * The PiScreen has a SPI to 16-bit parallel bus converter in front of the
  * display controller. This means that 8-bit values has to be transferred
@@ -28,9 +50,11 @@
  */
 static int piscreen_command(struct mipi_dbi *mipi, u8 cmd, u8 *par, size_t num)
 {
+	struct piscreen *priv = container_of(mipi, struct piscreen, mipi);
+	u32 cmd_hz = READ_ONCE(priv->clocks->cmd_hz);
+	u32 speed_hz = READ_ONCE(priv->clocks->pixel_hz);
 	struct spi_device *spi = mipi->spi;
 	void *data = par;
-	u32 speed_hz = 0;
 	int i, ret;
 	u16 *buf;
 
@@ -51,7 +75,7 @@ static int piscreen_command(struct mipi_dbi *mipi, u8 cmd, u8 *par, size_t num)
 	 */
 	buf[0] = cpu_to_be16(cmd);
 	gpiod_set_value_cansleep(mipi->dc, 0);
-	ret = tinydrm_spi_transfer(spi, 10000000, NULL, 8, buf, 2);
+	ret = tinydrm_spi_transfer(spi, cmd_hz, NULL, 8, buf, 2);
 	if (ret || !num)
 		goto free;
 
@@ -63,7 +87,7 @@ static int piscreen_command(struct mipi_dbi *mipi, u8 cmd, u8 *par, size_t num)
 		for (i = 0; i < num; i++)
 			buf[i] = cpu_to_be16(par[i]);
 		num *= 2;
-		speed_hz = 10000000; /* slow down config */
+		speed_hz = cmd_hz; /* slow down config */
 		data = buf;
 	}
 
@@ -76,17 +100,13 @@ free:
 }
 
 /* ILI9486 controller */
-static void piscreen_enable(struct drm_simple_display_pipe *pipe,
-			   struct drm_crtc_state *crtc_state)
+static void piscreen_hw_init(struct piscreen *priv)
 {
-	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
-	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
-	struct drm_framebuffer *fb = pipe->plane.fb;
+	struct mipi_dbi *mipi = &priv->mipi;
+	struct drm_mode_config *mode_config = &mipi->tinydrm.drm->mode_config;
 	u8 addr_mode;
 
-	DRM_DEBUG_KMS("\n");
-
-	mipi_dbi_hw_reset(mipi);
+	tinydrm_hw_reset(mipi->reset, PISCREEN_RESET_US, PISCREEN_RESET_MS);
 
 	mipi_dbi_command(mipi, 0xb0, 0x00);
 	mipi_dbi_command(mipi, MIPI_DCS_EXIT_SLEEP_MODE);
@@ -127,12 +147,51 @@ static void piscreen_enable(struct drm_simple_display_pipe *pipe,
 	addr_mode |= BGR;
 	mipi_dbi_command(mipi, MIPI_DCS_SET_ADDRESS_MODE, addr_mode);
 
+	/*
+	 * TE pulses at the start of each frame. The scan runs along the panel
+	 * rows, MV puts them on the columns.
+	 */
+	if (priv->flush.te) {
+		tinydrm_te_set_scan(priv->flush.te,
+				    addr_mode & MV ? mode_config->min_width :
+						     mode_config->min_height,
+				    addr_mode & MV, addr_mode & MY);
+		mipi_dbi_command(mipi, MIPI_DCS_SET_TEAR_ON, 0x00);
+	}
+
 	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_ON);
+}
+
+static void piscreen_enable_common(struct drm_simple_display_pipe *pipe,
+				   void (*hw_init)(struct piscreen *priv))
+{
+	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
+	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
+	struct piscreen *priv = piscreen_from_tinydrm(tdev);
+	struct drm_framebuffer *fb = pipe->plane.fb;
+	bool splash = priv->flush.next_full;
+
+	DRM_DEBUG_KMS("\n");
+
+	/* Disable leaves the controller running, the splash is still up */
+	if (!splash) {
+		hw_init(priv);
+		/* Reset has cleared GRAM */
+		tinydrm_mipi_flush_reset(&priv->flush);
+	}
 
 	mipi->enabled = true;
-	fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	if (!splash)
+		fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
 
 	tinydrm_enable_backlight(mipi->backlight);
+	drm_crtc_vblank_on(&pipe->crtc);
+}
+
+static void piscreen_enable(struct drm_simple_display_pipe *pipe,
+			    struct drm_crtc_state *crtc_state)
+{
+	piscreen_enable_common(pipe, piscreen_hw_init);
 }
 
 static void piscreen_disable(struct drm_simple_display_pipe *pipe)
@@ -142,6 +201,7 @@ static void piscreen_disable(struct drm_simple_display_pipe *pipe)
 
 	DRM_DEBUG_KMS("\n");
 
+	drm_crtc_vblank_off(&pipe->crtc);
 	mipi->enabled = false;
 	tinydrm_disable_backlight(mipi->backlight);
 }
@@ -149,22 +209,18 @@ static void piscreen_disable(struct drm_simple_display_pipe *pipe)
 static const struct drm_simple_display_pipe_funcs piscreen_funcs = {
 	.enable = piscreen_enable,
 	.disable = piscreen_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_vblank_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
 /* ILI9488 controller */
-static void piscreen2_enable(struct drm_simple_display_pipe *pipe,
-			   struct drm_crtc_state *crtc_state)
+static void piscreen2_hw_init(struct piscreen *priv)
 {
-	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
-	struct mipi_dbi *mipi = mipi_dbi_from_tinydrm(tdev);
-	struct drm_framebuffer *fb = pipe->plane.fb;
+	struct mipi_dbi *mipi = &priv->mipi;
+	struct drm_mode_config *mode_config = &mipi->tinydrm.drm->mode_config;
 	u8 addr_mode;
 
-	DRM_DEBUG_KMS("\n");
-
-	mipi_dbi_hw_reset(mipi);
+	tinydrm_hw_reset(mipi->reset, PISCREEN_RESET_US, PISCREEN_RESET_MS);
 
 	mipi_dbi_command(mipi, 0xb0, 0x00);
 	mipi_dbi_command(mipi, MIPI_DCS_EXIT_SLEEP_MODE);
@@ -201,18 +257,31 @@ static void piscreen2_enable(struct drm_simple_display_pipe *pipe,
 	addr_mode |= BGR;
 	mipi_dbi_command(mipi, MIPI_DCS_SET_ADDRESS_MODE, addr_mode);
 
-	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_ON);
+	/*
+	 * TE pulses at the start of each frame. The scan runs along the panel
+	 * rows, MV puts them on the columns.
+	 */
+	if (priv->flush.te) {
+		tinydrm_te_set_scan(priv->flush.te,
+				    addr_mode & MV ? mode_config->min_width :
+						     mode_config->min_height,
+				    addr_mode & MV, addr_mode & MY);
+		mipi_dbi_command(mipi, MIPI_DCS_SET_TEAR_ON, 0x00);
+	}
 
-	mipi->enabled = true;
-	fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	mipi_dbi_command(mipi, MIPI_DCS_SET_DISPLAY_ON);
+}
 
-	tinydrm_enable_backlight(mipi->backlight);
+static void piscreen2_enable(struct drm_simple_display_pipe *pipe,
+			     struct drm_crtc_state *crtc_state)
+{
+	piscreen_enable_common(pipe, piscreen2_hw_init);
 }
 
 static const struct drm_simple_display_pipe_funcs piscreen2_funcs = {
 	.enable = piscreen2_enable,
 	.disable = piscreen_disable,
-	.update = tinydrm_display_pipe_update,
+	.update = tinydrm_vblank_pipe_update,
 	.prepare_fb = tinydrm_display_pipe_prepare_fb,
 };
 
@@ -220,12 +289,42 @@ static const struct drm_display_mode piscreen_mode = {
 	TINYDRM_MODE(480, 320, 73, 49),
 };
 
+#ifdef CONFIG_DEBUG_FS
+static int piscreen_debugfs_init(struct drm_minor *minor)
+{
+	struct tinydrm_device *tdev = minor->dev->dev_private;
+	struct piscreen *priv = piscreen_from_tinydrm(tdev);
+	int ret;
+
+	ret = tinydrm_spi_clocks_debugfs_init(&priv->mipi.spi->dev,
+					      minor->debugfs_root);
+	if (ret)
+		return ret;
+
+	ret = mipi_dbi_debugfs_init(minor);
+	if (ret)
+		return ret;
+
+	ret = tinydrm_te_debugfs_init(priv->flush.te, minor->debugfs_root);
+	if (ret)
+		return ret;
+
+	return tinydrm_fingerprint_debugfs_init(&priv->flush.fingerprint,
+						minor->debugfs_root,
+						&priv->flush.lock);
+}
+#else
+#define piscreen_debugfs_init	NULL
+#endif
+
 static struct drm_driver piscreen_driver = {
 	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_PRIME |
 				  DRIVER_ATOMIC,
 	TINYDRM_GEM_DRIVER_OPS,
 	.lastclose		= tinydrm_lastclose,
-	.debugfs_init		= mipi_dbi_debugfs_init,
+	.enable_vblank		= tinydrm_vblank_enable,
+	.disable_vblank		= tinydrm_vblank_disable,
+	.debugfs_init		= piscreen_debugfs_init,
 	.name			= "piscreen",
 	.desc			= "Ozzmaker PiScreen",
 	.date			= "20170317",
@@ -246,6 +345,8 @@ static int piscreen_probe(struct spi_device *spi)
 	const struct of_device_id *match;
 	struct device *dev = &spi->dev;
 	struct tinydrm_device *tdev;
+	struct tinydrm_te *te;
+	struct piscreen *priv;
 	struct mipi_dbi *mipi;
 	struct gpio_desc *dc;
 	u32 rotation = 0;
@@ -257,10 +358,16 @@ static int piscreen_probe(struct spi_device *spi)
 
 	funcs = match->data;
 
-	mipi = devm_kzalloc(dev, sizeof(*mipi), GFP_KERNEL);
-	if (!mipi)
+	priv = devm_kzalloc(dev, sizeof(*priv), GFP_KERNEL);
+	if (!priv)
 		return -ENOMEM;
 
+	mipi = &priv->mipi;
+
+	priv->clocks = devm_tinydrm_spi_clocks_init(spi, PISCREEN_CMD_HZ, 0, 0);
+	if (IS_ERR(priv->clocks))
+		return PTR_ERR(priv->clocks);
+
 	mipi->reset = devm_gpiod_get_optional(dev, "reset", GPIOD_OUT_HIGH);
 	if (IS_ERR(mipi->reset)) {
 		dev_err(dev, "Failed to get gpio 'reset'\n");
@@ -277,6 +384,10 @@ static int piscreen_probe(struct spi_device *spi)
 	if (IS_ERR(mipi->backlight))
 		return PTR_ERR(mipi->backlight);
 
+	te = devm_tinydrm_te_init(dev, 0);
+	if (IS_ERR(te))
+		return PTR_ERR(te);
+
 	device_property_read_u32(dev, "rotation", &rotation);
 
 	ret = mipi_dbi_spi_init(spi, mipi, dc, funcs, &piscreen_driver,
@@ -289,6 +400,24 @@ static int piscreen_probe(struct spi_device *spi)
 
 	tdev = &mipi->tinydrm;
 
+	ret = devm_tinydrm_vblank_init(tdev, 0, te);
+	if (ret)
+		return ret;
+
+	tinydrm_mipi_flush_init(&priv->flush, mipi, te);
+
+	/*
+	 * With a 'splash' property the controller is brought up in probe and
+	 * the image is put in GRAM before the DRM device is registered.
+	 */
+	if (device_property_present(dev, "splash")) {
+		if (funcs == &piscreen2_funcs)
+			piscreen2_hw_init(priv);
+		else
+			piscreen_hw_init(priv);
+		tinydrm_mipi_flush_splash(&priv->flush);
+	}
+
 	ret = devm_tinydrm_register(tdev);
 	if (ret)
 		return ret;
@@ -315,6 +444,7 @@ static struct spi_driver piscreen_spi_driver = {
 		.name = "piscreen",
 		.owner = THIS_MODULE,
 		.of_match_table = piscreen_of_match,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = piscreen_probe,
 	.shutdown = piscreen_shutdown,
@@ -7,7 +7,6 @@
  * (at your option) any later version.
  */
 
-#include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/gpio/consumer.h>
 #include <linux/property.h>
@@ -30,81 +29,226 @@
  */
 
 /*
- * tinydrm_fbtft_dt_init - Initialize from device property
- * @dev: Device
- * @reg: Register map
+ * The 'init' property is compiled into a list of steps the first time it's
+ * used. The list is kept as a device resource so re-initializing the
+ * controller on enable or resume doesn't parse the property again.
  *
- * If the 'init' property exists, apply the register settings.
- *
- * Returns:
- * Zero on success, -ENOENT if the property doesn't exist, negative error code
- * on other failures.
+ * A step is one of:
+ * - A run of single value register writes, sent with regmap_multi_reg_write()
+ * - A command with several values, sent with regmap_bulk_write(). On a MIPI
+ *   DCS bus this is the command followed by its parameters. The parameters
+ *   aren't registers, so the write bypasses the register cache.
+ * - A delay
  */
-int tinydrm_fbtft_init(struct device *dev, struct regmap *reg)
+struct tinydrm_fbtft_init_step {
+	const struct reg_sequence *regs;
+	unsigned int num_regs;
+	unsigned int cmd;
+	const void *params;
+	unsigned int num_params;
+	unsigned int delay_ms;
+};
+
+struct tinydrm_fbtft_init_prog {
+	struct tinydrm_fbtft_init_step *steps;
+	unsigned int num_steps;
+};
+
+static void tinydrm_fbtft_init_release(struct device *dev, void *res)
 {
-	u32 *vals, regvals[64], *regnr = NULL;
-	int ret, num_vals, i, j;
-	void *buf;
+}
 
-	if (!device_property_present(dev, "init"))
-		return -ENOENT;
+static int tinydrm_fbtft_init_put(void *params, unsigned int idx, u32 val,
+				  int val_bytes)
+{
+	switch (val_bytes) {
+	case 1:
+		((u8 *)params)[idx] = val;
+		break;
+	case 2:
+		((u16 *)params)[idx] = val;
+		break;
+	case 4:
+		((u32 *)params)[idx] = val;
+		break;
+	default:
+		return -EINVAL;
+	}
 
-	DRM_DEBUG_DRIVER("\n");
+	return 0;
+}
+
+static struct tinydrm_fbtft_init_prog *
+tinydrm_fbtft_init_compile(struct device *dev, struct regmap *reg)
+{
+	struct tinydrm_fbtft_init_step *step, *prev = NULL;
+	struct tinydrm_fbtft_init_prog *prog;
+	unsigned int i, j, num, nregs = 0;
+	int ret, num_vals, val_bytes;
+	struct reg_sequence *regs;
+	u8 *params;
+	u32 *vals;
+
+	val_bytes = regmap_get_val_bytes(reg);
+	if (val_bytes < 0)
+		return ERR_PTR(val_bytes);
 
 	num_vals = device_property_read_u32_array(dev, "init", NULL, 0);
 	if (num_vals <= 0)
-		return num_vals;
+		return ERR_PTR(num_vals ? num_vals : -EINVAL);
 
-	buf = kcalloc(num_vals, sizeof(u32), GFP_KERNEL);
-	if (!buf)
-		return -ENOMEM;
+	vals = kcalloc(num_vals, sizeof(u32), GFP_KERNEL);
+	if (!vals)
+		return ERR_PTR(-ENOMEM);
 
-	vals = buf;
 	ret = device_property_read_u32_array(dev, "init", vals, num_vals);
 	if (ret < 0)
 		goto err_free;
 
-	for (i = 0; i < num_vals; i++) {
+	/* The value count is an upper bound for all three arrays */
+	prog = devres_alloc(tinydrm_fbtft_init_release, sizeof(*prog) +
+			    num_vals * (sizeof(*step) + sizeof(*regs) +
+					val_bytes), GFP_KERNEL);
+	if (!prog) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	prog->steps = (void *)(prog + 1);
+	regs = (void *)(prog->steps + num_vals);
+	params = (u8 *)(regs + num_vals);
+
+	for (i = 0; i < num_vals; i = j) {
 		if (vals[i] & FBTFT_INIT_DELAY) {
-			vals[i] &= 0xffff;
-			DRM_DEBUG_DRIVER("init: msleep(%u)\n", vals[i]);
-			msleep(vals[i]);
-		} else if (vals[i] & FBTFT_INIT_CMD) {
-			vals[i] &= 0xffff;
-			regnr = &vals[i];
-			j = 0;
-		} else if (!regnr) {
+			step = &prog->steps[prog->num_steps++];
+			step->delay_ms = vals[i] & 0xffff;
+			prev = step;
+			j = i + 1;
+			continue;
+		}
+
+		if (!(vals[i] & FBTFT_INIT_CMD)) {
 			dev_err(dev, "init: illegal value 0x%X\n", vals[i]);
 			ret = -EINVAL;
-			goto err_free;
-		} else {
-			if (j > 63) {
-				dev_err(dev, "init: Maximum register values exceeded\n");
-				ret = -EINVAL;
-				goto err_free;
-			}
-			regvals[j++] = vals[i];
+			goto err_devres;
 		}
 
-		/* write values if this is the last entry or regvalue */
-		if (regnr &&
-		    (i == (num_vals - 1) || vals[i + 1] & 0xffff0000)) {
-			/* FIXME support mipi dcs */
-			if (WARN_ON_ONCE(j != 1))
-				return -EINVAL;
+		/* The values run up to the next command or delay */
+		for (j = i + 1; j < num_vals && !(vals[j] & 0xffff0000); j++)
+			;
+		num = j - i - 1;
 
-			ret = regmap_write(reg, *regnr, regvals[0]);
-			if (ret)
-				goto err_free;
+		if (!num) {
+			dev_err(dev, "init: register 0x%X has no value\n",
+				vals[i] & 0xffff);
+			ret = -EINVAL;
+			goto err_devres;
+		}
 
-			regnr = NULL;
+		if (num == 1) {
+			if (!prev || !prev->num_regs) {
+				prev = &prog->steps[prog->num_steps++];
+				prev->regs = &regs[nregs];
+			}
+			regs[nregs].reg = vals[i] & 0xffff;
+			regs[nregs++].def = vals[i + 1];
+			prev->num_regs++;
+			continue;
+		}
+
+		step = &prog->steps[prog->num_steps++];
+		step->cmd = vals[i] & 0xffff;
+		step->params = params;
+		step->num_params = num;
+		for (num = 0; num < step->num_params; num++) {
+			ret = tinydrm_fbtft_init_put(params, num,
+						     vals[i + 1 + num],
+						     val_bytes);
+			if (ret)
+				goto err_devres;
 		}
+		params += num * val_bytes;
+		prev = step;
 	}
 
+	kfree(vals);
+
+	DRM_DEBUG_DRIVER("init: %d values compiled to %u steps\n", num_vals,
+			 prog->num_steps);
+
+	return prog;
+
+err_devres:
+	devres_free(prog);
 err_free:
-	kfree(buf);
+	kfree(vals);
 
-	return ret;
+	return ERR_PTR(ret);
+}
+
+static int tinydrm_fbtft_init_run(struct regmap *reg,
+				  const struct tinydrm_fbtft_init_prog *prog)
+{
+	const struct tinydrm_fbtft_init_step *step;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < prog->num_steps; i++) {
+		step = &prog->steps[i];
+		if (step->num_regs) {
+			ret = regmap_multi_reg_write(reg, step->regs,
+						     step->num_regs);
+		} else if (step->num_params) {
+			/* Don't cache the parameters as registers cmd + 1.. */
+			regcache_cache_bypass(reg, true);
+			ret = regmap_bulk_write(reg, step->cmd, step->params,
+						step->num_params);
+			regcache_cache_bypass(reg, false);
+		} else {
+			DRM_DEBUG_DRIVER("init: sleep(%u)\n", step->delay_ms);
+			tinydrm_msleep(step->delay_ms);
+		}
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/*
+ * tinydrm_fbtft_init - Initialize from device property
+ * @dev: Device
+ * @reg: Register map
+ *
+ * If the 'init' property exists, apply the register settings.
+ * The property is only parsed on the first call, the compiled result is
+ * reused on later calls, for instance when resuming.
+ *
+ * Commands with several values are written with regmap_bulk_write() bypassing
+ * the register cache, so regcache_sync() doesn't replay their parameters as
+ * writes to the registers following the command.
+ *
+ * Returns:
+ * Zero on success, -ENOENT if the property doesn't exist, negative error code
+ * on other failures.
+ */
+int tinydrm_fbtft_init(struct device *dev, struct regmap *reg)
+{
+	struct tinydrm_fbtft_init_prog *prog;
+
+	prog = devres_find(dev, tinydrm_fbtft_init_release, NULL, NULL);
+	if (!prog) {
+		if (!device_property_present(dev, "init"))
+			return -ENOENT;
+
+		prog = tinydrm_fbtft_init_compile(dev, reg);
+		if (IS_ERR(prog))
+			return PTR_ERR(prog);
+
+		devres_add(dev, prog);
+	}
+
+	return tinydrm_fbtft_init_run(reg, prog);
 }
 EXPORT_SYMBOL(tinydrm_fbtft_init);
 
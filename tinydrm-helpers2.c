@@ -7,14 +7,26 @@
  * (at your option) any later version.
  */
 
+#include <linux/debugfs.h>
+#include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dma-buf.h>
+#include <linux/firmware.h>
 #include <linux/gpio/consumer.h>
+#include <linux/jhash.h>
+#include <linux/mutex.h>
+#include <linux/property.h>
+#include <linux/seq_file.h>
+#include <linux/spi/spi.h>
+#include <asm/unaligned.h>
 
 #include <drm/drm_gem_cma_helper.h>
 #include <drm/drm_fb_cma_helper.h>
+#include <drm/tinydrm/mipi-dbi.h>
 #include <drm/tinydrm/tinydrm-helpers2.h>
 
+#include <video/mipi_display.h>
+
 /*
 
 	This should be added to tinydrm-helpers.c
@@ -72,29 +84,752 @@ int tinydrm_rgb565_buf_copy(void *dst, struct drm_framebuffer *fb,
 }
 EXPORT_SYMBOL(tinydrm_rgb565_buf_copy);
 
+/**
+ * tinydrm_msleep - Sleep for a controller delay
+ * @ms: Time in milliseconds
+ *
+ * msleep() is jiffy based and oversleeps short delays by up to two jiffies,
+ * so delays shorter than 20 ms use usleep_range() instead.
+ */
+void tinydrm_msleep(unsigned int ms)
+{
+	if (!ms)
+		return;
+
+	if (ms < 20)
+		usleep_range(ms * 1000, ms * 1000 + 500);
+	else
+		msleep(ms);
+}
+EXPORT_SYMBOL(tinydrm_msleep);
+
+static void tinydrm_spi_clocks_release(struct device *dev, void *res)
+{
+}
+
+/**
+ * devm_tinydrm_spi_clocks_init - Set up the SPI clock policy for a device
+ * @spi: SPI device
+ * @cmd_hz: Driver default for commands
+ * @pixel_hz: Driver default for pixel data
+ * @read_hz: Driver default for reads
+ *
+ * The defaults can be overridden from the 'spi-cmd-max-frequency',
+ * 'spi-pixel-max-frequency' and 'spi-read-max-frequency' device properties.
+ * They are not capped by 'spi-max-frequency', that one stays the clock for
+ * transfers that don't set one.
+ *
+ * Returns:
+ * &tinydrm_spi_clocks on success or ERR_PTR on failure.
+ */
+struct tinydrm_spi_clocks *
+devm_tinydrm_spi_clocks_init(struct spi_device *spi, u32 cmd_hz, u32 pixel_hz,
+			     u32 read_hz)
+{
+	struct device *dev = &spi->dev;
+	struct tinydrm_spi_clocks *clocks;
+
+	clocks = devres_alloc(tinydrm_spi_clocks_release, sizeof(*clocks),
+			      GFP_KERNEL);
+	if (!clocks)
+		return ERR_PTR(-ENOMEM);
+
+	clocks->cmd_hz = cmd_hz;
+	clocks->pixel_hz = pixel_hz;
+	clocks->read_hz = read_hz;
+
+	device_property_read_u32(dev, "spi-cmd-max-frequency",
+				 &clocks->cmd_hz);
+	device_property_read_u32(dev, "spi-pixel-max-frequency",
+				 &clocks->pixel_hz);
+	device_property_read_u32(dev, "spi-read-max-frequency",
+				 &clocks->read_hz);
+
+	devres_add(dev, clocks);
+
+	dev_dbg(dev, "SPI clocks: cmd=%u pixel=%u read=%u Hz\n",
+		clocks->cmd_hz, clocks->pixel_hz, clocks->read_hz);
+
+	return clocks;
+}
+EXPORT_SYMBOL(devm_tinydrm_spi_clocks_init);
+
+/**
+ * tinydrm_spi_clocks_get - Get the SPI clock policy of a device
+ * @dev: Device
+ *
+ * Returns:
+ * &tinydrm_spi_clocks or NULL if devm_tinydrm_spi_clocks_init() hasn't been
+ * called for @dev.
+ */
+struct tinydrm_spi_clocks *tinydrm_spi_clocks_get(struct device *dev)
+{
+	return devres_find(dev, tinydrm_spi_clocks_release, NULL, NULL);
+}
+EXPORT_SYMBOL(tinydrm_spi_clocks_get);
+
 /**
  * tinydrm_hw_reset - Hardware reset of controller
  * @reset: GPIO connected to reset pin. Can be NULL.
- * @assert_ms: Time in milliseconds to assert reset. Can be zero.
+ * @assert_us: Time in microseconds to assert reset. Can be zero.
  * @settle_ms: Time in milliseconds to wait for controller to become ready.
  *             Can be zero.
  *
- * Reset controller by pulling down the reset gpio for @assert_ms then pull up
- * and wait for @settle_ms.
+ * Reset controller by pulling down the reset gpio for @assert_us then pull up
+ * and wait for @settle_ms. Pass the minimums from the controller datasheet,
+ * reset pulses are in the microsecond range for most controllers.
  */
-void tinydrm_hw_reset(struct gpio_desc *reset, unsigned int assert_ms,
+void tinydrm_hw_reset(struct gpio_desc *reset, unsigned int assert_us,
 		      unsigned int settle_ms)
 {
 	if (IS_ERR_OR_NULL(reset))
 		return;
 
 	gpiod_set_value_cansleep(reset, 0);
-	if (assert_ms)
-		msleep(assert_ms);
+	if (assert_us)
+		usleep_range(assert_us, 2 * assert_us);
 	gpiod_set_value_cansleep(reset, 1);
-	if (settle_ms)
-		msleep(settle_ms);
+	tinydrm_msleep(settle_ms);
 }
 EXPORT_SYMBOL(tinydrm_hw_reset);
 
+/*
+ * Boot splash image layout, all values little endian:
+ *
+ *   struct tinydrm_splash_header
+ *   pixel data
+ *
+ * Raw images are width * height RGB565 pixels. RLE images are records that
+ * start with a 16-bit word: if bit 15 is set the following pixel is repeated
+ * (word & 0x7fff) + 1 times, otherwise (word + 1) pixels follow.
+ */
+#define TINYDRM_SPLASH_MAGIC	0x4c505354 /* "TSPL" */
+#define TINYDRM_SPLASH_RAW	0
+#define TINYDRM_SPLASH_RLE	1
+
+struct tinydrm_splash_header {
+	__le32 magic;
+	__le16 x;
+	__le16 y;
+	__le16 width;
+	__le16 height;
+	__le16 format;
+	__le16 reserved;
+} __packed;
+
+struct tinydrm_splash_stream {
+	const struct tinydrm_splash_funcs *funcs;
+	void *arg;
+	u16 *buf;
+	size_t max;
+	size_t num;
+};
+
+static int tinydrm_splash_put(struct tinydrm_splash_stream *stream, u16 pixel,
+			      unsigned int count)
+{
+	int ret;
+
+	while (count--) {
+		stream->buf[stream->num++] = pixel;
+		if (stream->num == stream->max) {
+			ret = stream->funcs->write(stream->arg, stream->buf,
+						   stream->num * 2);
+			if (ret)
+				return ret;
+			stream->num = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int tinydrm_splash_decode(struct tinydrm_splash_stream *stream,
+				 const u8 *src, const u8 *end,
+				 unsigned int format, size_t remain)
+{
+	unsigned int count, word;
+	bool run;
+	int ret;
+
+	while (remain) {
+		if (format == TINYDRM_SPLASH_RAW) {
+			count = 1;
+			run = false;
+		} else {
+			if (end - src < 2)
+				return -EINVAL;
+			word = get_unaligned_le16(src);
+			src += 2;
+			count = (word & 0x7fff) + 1;
+			run = word & 0x8000;
+		}
+
+		if (count > remain || end - src < (run ? 2 : 2 * count))
+			return -EINVAL;
+		remain -= count;
+
+		if (run) {
+			ret = tinydrm_splash_put(stream,
+						 get_unaligned_le16(src), count);
+			if (ret)
+				return ret;
+			src += 2;
+			continue;
+		}
+
+		for (; count; count--, src += 2) {
+			ret = tinydrm_splash_put(stream,
+						 get_unaligned_le16(src), 1);
+			if (ret)
+				return ret;
+		}
+	}
+
+	if (!stream->num)
+		return 0;
+
+	return stream->funcs->write(stream->arg, stream->buf, stream->num * 2);
+}
+
+/**
+ * tinydrm_splash_draw - Stream a boot splash image to the controller
+ * @dev: Device
+ * @width: Display width
+ * @height: Display height
+ * @buf: Buffer the image is decoded into chunk by chunk
+ * @len: Size of @buf in bytes
+ * @funcs: Controller callbacks
+ * @arg: Argument passed to the callbacks
+ *
+ * Loads the firmware file named by the 'splash' device property and writes
+ * it straight to the controller memory without a framebuffer. The image is
+ * decoded into @buf and passed to &tinydrm_splash_funcs->write as native
+ * endian RGB565 each time the buffer is full.
+ *
+ * Returns:
+ * Zero on success, -ENOENT if there's no 'splash' property, negative error
+ * code on other failures.
+ */
+int tinydrm_splash_draw(struct device *dev, unsigned int width,
+			unsigned int height, void *buf, size_t len,
+			const struct tinydrm_splash_funcs *funcs, void *arg)
+{
+	struct tinydrm_splash_stream stream = {
+		.funcs = funcs,
+		.arg = arg,
+		.buf = buf,
+		.max = len / 2,
+	};
+	const struct tinydrm_splash_header *hdr;
+	unsigned int format, w, h;
+	struct drm_clip_rect clip;
+	const struct firmware *fw;
+	const char *name;
+	int ret;
+
+	if (device_property_read_string(dev, "splash", &name))
+		return -ENOENT;
+
+	if (!stream.max)
+		return -EINVAL;
+
+	ret = request_firmware(&fw, name, dev);
+	if (ret)
+		return ret;
+
+	hdr = (const struct tinydrm_splash_header *)fw->data;
+	if (fw->size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != TINYDRM_SPLASH_MAGIC) {
+		dev_err(dev, "%s: Not a splash image\n", name);
+		ret = -EINVAL;
+		goto out_release;
+	}
+
+	clip.x1 = le16_to_cpu(hdr->x);
+	clip.y1 = le16_to_cpu(hdr->y);
+	w = le16_to_cpu(hdr->width);
+	h = le16_to_cpu(hdr->height);
+	format = le16_to_cpu(hdr->format);
+	clip.x2 = clip.x1 + w;
+	clip.y2 = clip.y1 + h;
+
+	if (!w || !h || clip.x2 > width || clip.y2 > height ||
+	    format > TINYDRM_SPLASH_RLE) {
+		dev_err(dev, "%s: Unsupported %ux%u+%u+%u format %u\n", name,
+			w, h, clip.x1, clip.y1, format);
+		ret = -EINVAL;
+		goto out_release;
+	}
+
+	ret = funcs->set_window(arg, &clip);
+	if (ret)
+		goto out_release;
+
+	ret = tinydrm_splash_decode(&stream, fw->data + sizeof(*hdr),
+				    fw->data + fw->size, format, w * h);
+	if (ret == -EINVAL)
+		dev_err(dev, "%s: Truncated or corrupt image\n", name);
+	else if (!ret)
+		DRM_DEBUG_DRIVER("Splash %s %ux%u+%u+%u\n", name, w, h,
+				 clip.x1, clip.y1);
+
+out_release:
+	release_firmware(fw);
+
+	return ret;
+}
+EXPORT_SYMBOL(tinydrm_splash_draw);
+
+static bool tinydrm_clip_equal(const struct drm_clip_rect *a,
+			       const struct drm_clip_rect *b)
+{
+	return a->x1 == b->x1 && a->x2 == b->x2 &&
+	       a->y1 == b->y1 && a->y2 == b->y2;
+}
+
+static bool tinydrm_clip_overlap(const struct drm_clip_rect *a,
+				 const struct drm_clip_rect *b)
+{
+	return a->x1 < b->x2 && b->x1 < a->x2 &&
+	       a->y1 < b->y2 && b->y1 < a->y2;
+}
+
+static int tinydrm_fingerprint_hash(struct drm_framebuffer *fb,
+				    struct drm_clip_rect *clip, u32 *hash)
+{
+	struct drm_gem_cma_object *cma_obj = drm_fb_cma_get_gem_obj(fb, 0);
+	struct dma_buf_attachment *import_attach = cma_obj->base.import_attach;
+	unsigned int cpp = fb->format->cpp[0];
+	size_t len = (clip->x2 - clip->x1) * cpp;
+	void *src = cma_obj->vaddr;
+	unsigned int y;
+	int ret = 0;
+
+	if (import_attach) {
+		ret = dma_buf_begin_cpu_access(import_attach->dmabuf,
+					       DMA_FROM_DEVICE);
+		if (ret)
+			return ret;
+	}
+
+	/* The format is part of the seed, the same bytes can look different */
+	*hash = fb->format->format;
+	src += clip->y1 * fb->pitches[0] + clip->x1 * cpp;
+	for (y = clip->y1; y < clip->y2; y++) {
+		*hash = jhash(src, len, *hash);
+		src += fb->pitches[0];
+	}
+
+	if (import_attach)
+		ret = dma_buf_end_cpu_access(import_attach->dmabuf,
+					     DMA_FROM_DEVICE);
+
+	return ret;
+}
+
+/**
+ * tinydrm_fingerprint_unchanged - Check if a flush can be skipped
+ * @fp: Fingerprint cache
+ * @fb: DRM framebuffer
+ * @clip: Region about to be transmitted
+ *
+ * Hash the content of @clip and compare it against the region with the same
+ * coordinates that was last transmitted. If they match, the panel already
+ * shows this content and the flush can be dropped before any command or
+ * pixel traffic. Otherwise @clip is recorded as transmitted and all cached
+ * regions it overlaps are forgotten.
+ *
+ * If the transfer fails after this function returns false, the caller must
+ * call tinydrm_fingerprint_reset().
+ *
+ * Returns:
+ * True if the content of @clip is unchanged, false if it has to be sent.
+ */
+bool tinydrm_fingerprint_unchanged(struct tinydrm_fingerprint *fp,
+				   struct drm_framebuffer *fb,
+				   struct drm_clip_rect *clip)
+{
+	unsigned int i, num = 0;
+	u32 hash;
+
+	if (fp->disabled || tinydrm_fingerprint_hash(fb, clip, &hash)) {
+		tinydrm_fingerprint_reset(fp);
+		fp->misses++;
+		return false;
+	}
+
+	for (i = 0; i < fp->num; i++) {
+		if (!tinydrm_clip_equal(&fp->clips[i], clip))
+			continue;
+
+		if (fp->hashes[i] == hash) {
+			fp->hits++;
+			fp->skipped_bytes += (clip->x2 - clip->x1) *
+					     (clip->y2 - clip->y1) *
+					     fb->format->cpp[0];
+			return true;
+		}
+	}
+
+	/* Drop the regions that this transfer will overwrite */
+	for (i = 0; i < fp->num; i++) {
+		if (tinydrm_clip_overlap(&fp->clips[i], clip))
+			continue;
+		fp->clips[num] = fp->clips[i];
+		fp->hashes[num++] = fp->hashes[i];
+	}
+	fp->num = num;
+
+	if (fp->num < TINYDRM_FINGERPRINT_SLOTS) {
+		i = fp->num++;
+	} else {
+		i = fp->next;
+		fp->next = (fp->next + 1) % TINYDRM_FINGERPRINT_SLOTS;
+	}
+	fp->clips[i] = *clip;
+	fp->hashes[i] = hash;
+	fp->misses++;
+
+	return false;
+}
+EXPORT_SYMBOL(tinydrm_fingerprint_unchanged);
+
+#if IS_ENABLED(CONFIG_TINYDRM_MIPI_DBI)
+
+static int tinydrm_mipi_set_window(struct mipi_dbi *mipi,
+				   const struct drm_clip_rect *clip)
+{
+	unsigned int xe = clip->x2 - 1, ye = clip->y2 - 1;
+	int ret;
+
+	ret = mipi_dbi_command(mipi, MIPI_DCS_SET_COLUMN_ADDRESS,
+			       (clip->x1 >> 8) & 0xff, clip->x1 & 0xff,
+			       (xe >> 8) & 0xff, xe & 0xff);
+	if (ret)
+		return ret;
+
+	return mipi_dbi_command(mipi, MIPI_DCS_SET_PAGE_ADDRESS,
+				(clip->y1 >> 8) & 0xff, clip->y1 & 0xff,
+				(ye >> 8) & 0xff, ye & 0xff);
+}
+
+/*
+ * With a TE gpio the flush is done here instead of in mipi-dbi. It starts on
+ * the TE edge and goes out in bands that stay behind the panel scan.
+ */
+static int tinydrm_mipi_te_flush(struct tinydrm_mipi_flush *flush,
+				 struct drm_framebuffer *fb,
+				 struct drm_clip_rect *clip)
+{
+	struct drm_clip_rect bands[TINYDRM_TE_BANDS];
+	struct mipi_dbi *mipi = flush->mipi;
+	unsigned int i, num;
+	int ret;
+
+	num = tinydrm_te_split(flush->te, clip, bands);
+	tinydrm_te_wait(flush->te);
+
+	for (i = 0; i < num; i++) {
+		struct drm_clip_rect *band = &bands[i];
+
+		ret = tinydrm_rgb565_buf_copy(mipi->tx_buf, fb, band,
+					      mipi->swap_bytes);
+		if (ret)
+			return ret;
+
+		tinydrm_te_wait_band(flush->te, band);
+
+		ret = tinydrm_mipi_set_window(mipi, band);
+		if (ret)
+			return ret;
+
+		ret = mipi_dbi_command_buf(mipi, MIPI_DCS_WRITE_MEMORY_START,
+					   (u8 *)mipi->tx_buf,
+					   (band->x2 - band->x1) *
+					   (band->y2 - band->y1) * 2);
+		if (ret)
+			return ret;
+	}
+
+	DRM_DEBUG("Flushed [FB:%d] in %u bands, frame at %lld us\n",
+		  fb->base.id, num,
+		  ktime_to_us(tinydrm_te_timestamp(flush->te)));
+
+	return 0;
+}
+
+/*
+ * fbdev emulation and naive clients keep flushing a static screen. Drop
+ * flushes of content the panel already shows before mipi-dbi sends any
+ * commands. The lock keeps the fingerprint in step with what is sent.
+ */
+static int tinydrm_mipi_flush_dirty(struct drm_framebuffer *fb,
+				    struct drm_file *file_priv,
+				    unsigned int flags, unsigned int color,
+				    struct drm_clip_rect *clips,
+				    unsigned int num_clips)
+{
+	struct tinydrm_mipi_flush *flush = container_of(fb->funcs,
+					struct tinydrm_mipi_flush, fb_funcs);
+	struct tinydrm_device *tdev = &flush->mipi->tinydrm;
+	struct drm_clip_rect clip;
+	bool active;
+	int ret = 0;
+
+	mutex_lock(&flush->lock);
+
+	/* mipi-dbi takes care of the cases where we're not interested */
+	active = flush->mipi->enabled && tdev->pipe.plane.fb == fb;
+	if (active) {
+		/* The splash is up, replace all of it */
+		if (flush->next_full) {
+			flush->next_full = false;
+			clips = NULL;
+			num_clips = 0;
+		}
+		tinydrm_merge_clips(&clip, clips, num_clips, flags,
+				    fb->width, fb->height);
+		if (tinydrm_fingerprint_unchanged(&flush->fingerprint, fb,
+						  &clip)) {
+			DRM_DEBUG("Skipping unchanged [FB:%d]\n", fb->base.id);
+			goto out_unlock;
+		}
+	}
+
+	if (active && flush->te)
+		ret = tinydrm_mipi_te_flush(flush, fb, &clip);
+	else
+		ret = flush->mipi_fb_funcs->dirty(fb, file_priv, flags, color,
+						  clips, num_clips);
+	if (ret)
+		tinydrm_fingerprint_reset(&flush->fingerprint);
+
+out_unlock:
+	mutex_unlock(&flush->lock);
+
+	return ret;
+}
+
+/**
+ * tinydrm_mipi_flush_init - Put fingerprinting and TE in front of mipi-dbi
+ * @flush: Flush state to initialize
+ * @mipi: MIPI DBI device
+ * @te: Tearing effect to follow, can be NULL
+ *
+ * Wraps the mipi-dbi framebuffer dirty callback. Flushes of unchanged content
+ * are skipped, the first flush after tinydrm_mipi_flush_splash() redraws the
+ * whole framebuffer and with @te the flush is synchronized to the panel scan.
+ * Call this after mipi_dbi_init() and before devm_tinydrm_register().
+ */
+void tinydrm_mipi_flush_init(struct tinydrm_mipi_flush *flush,
+			     struct mipi_dbi *mipi, struct tinydrm_te *te)
+{
+	struct tinydrm_device *tdev = &mipi->tinydrm;
+
+	mutex_init(&flush->lock);
+	flush->mipi = mipi;
+	flush->te = te;
+	flush->mipi_fb_funcs = tdev->fb_funcs;
+	flush->fb_funcs = *tdev->fb_funcs;
+	flush->fb_funcs.dirty = tinydrm_mipi_flush_dirty;
+	tdev->fb_funcs = &flush->fb_funcs;
+}
+EXPORT_SYMBOL(tinydrm_mipi_flush_init);
+
+/**
+ * tinydrm_mipi_flush_reset - Forget what the panel shows
+ * @flush: Flush state
+ *
+ * Drivers call this after a controller reset has cleared GRAM.
+ */
+void tinydrm_mipi_flush_reset(struct tinydrm_mipi_flush *flush)
+{
+	mutex_lock(&flush->lock);
+	tinydrm_fingerprint_reset(&flush->fingerprint);
+	mutex_unlock(&flush->lock);
+}
+EXPORT_SYMBOL(tinydrm_mipi_flush_reset);
+
+static int tinydrm_mipi_splash_set_window(void *arg,
+					  const struct drm_clip_rect *clip)
+{
+	return tinydrm_mipi_set_window(arg, clip);
+}
+
+/* tx_buf holds a full frame, so the image goes out in one write */
+static int tinydrm_mipi_splash_write(void *arg, void *buf, size_t len)
+{
+	struct mipi_dbi *mipi = arg;
+	u16 *pixels = buf;
+	size_t i;
+
+	if (mipi->swap_bytes)
+		for (i = 0; i < len / 2; i++)
+			swab16s(&pixels[i]);
+
+	return mipi_dbi_command_buf(mipi, MIPI_DCS_WRITE_MEMORY_START, buf,
+				    len);
+}
+
+static const struct tinydrm_splash_funcs tinydrm_mipi_splash_funcs = {
+	.set_window = tinydrm_mipi_splash_set_window,
+	.write = tinydrm_mipi_splash_write,
+};
+
+/**
+ * tinydrm_mipi_flush_splash - Show the boot splash on a mipi-dbi panel
+ * @flush: Flush state
+ *
+ * Writes the 'splash' firmware image to GRAM through &mipi_dbi->tx_buf. The
+ * controller has to be initialized. The image stays up until the first
+ * damage, which then redraws the whole framebuffer, so the driver should skip
+ * the reset and the initial flush on the first enable if
+ * &tinydrm_mipi_flush->next_full is set.
+ */
+void tinydrm_mipi_flush_splash(struct tinydrm_mipi_flush *flush)
+{
+	struct mipi_dbi *mipi = flush->mipi;
+	struct drm_device *drm = mipi->tinydrm.drm;
+	unsigned int width = drm->mode_config.min_width;
+	unsigned int height = drm->mode_config.min_height;
+	int ret;
+
+	ret = tinydrm_splash_draw(drm->dev, width, height, mipi->tx_buf,
+				  width * height * 2,
+				  &tinydrm_mipi_splash_funcs, mipi);
+	if (ret)
+		dev_warn(drm->dev, "Failed to show splash %d\n", ret);
+	else
+		flush->next_full = true;
+}
+EXPORT_SYMBOL(tinydrm_mipi_flush_splash);
+
+#endif
+
+#ifdef CONFIG_DEBUG_FS
+
+static int tinydrm_fingerprint_debugfs_show(struct seq_file *m, void *d)
+{
+	struct tinydrm_fingerprint *fp = m->private;
+	int ret;
+
+	ret = mutex_lock_interruptible(fp->lock);
+	if (ret)
+		return ret;
+
+	seq_printf(m, "enabled: %u\n", !fp->disabled);
+	seq_printf(m, "hits: %llu\n", fp->hits);
+	seq_printf(m, "misses: %llu\n", fp->misses);
+	seq_printf(m, "skipped_bytes: %llu\n", fp->skipped_bytes);
+	seq_printf(m, "regions: %u\n", fp->num);
+
+	mutex_unlock(fp->lock);
+
+	return 0;
+}
+
+static int tinydrm_fingerprint_debugfs_open(struct inode *inode,
+					    struct file *file)
+{
+	return single_open(file, tinydrm_fingerprint_debugfs_show,
+			   inode->i_private);
+}
+
+/* Write 0 to disable, 1 to enable. Counters are reset on write. */
+static ssize_t tinydrm_fingerprint_debugfs_write(struct file *file,
+						 const char __user *user_buf,
+						 size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct tinydrm_fingerprint *fp = m->private;
+	bool enable;
+	int ret;
+
+	ret = kstrtobool_from_user(user_buf, count, &enable);
+	if (ret)
+		return ret;
+
+	ret = mutex_lock_interruptible(fp->lock);
+	if (ret)
+		return ret;
+
+	fp->disabled = !enable;
+	fp->hits = 0;
+	fp->misses = 0;
+	fp->skipped_bytes = 0;
+
+	mutex_unlock(fp->lock);
+
+	return count;
+}
+
+static const struct file_operations tinydrm_fingerprint_debugfs_fops = {
+	.owner = THIS_MODULE,
+	.open = tinydrm_fingerprint_debugfs_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+	.write = tinydrm_fingerprint_debugfs_write,
+};
+
+/**
+ * tinydrm_fingerprint_debugfs_init - Create fingerprint debugfs entry
+ * @fp: Fingerprint cache
+ * @parent: Parent directory
+ * @lock: Lock that serializes the flushes using @fp
+ *
+ * Creates a 'fingerprint' file that shows the skip counters. Writing a
+ * boolean to it enables/disables skipping and resets the counters.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_fingerprint_debugfs_init(struct tinydrm_fingerprint *fp,
+				     struct dentry *parent, struct mutex *lock)
+{
+	struct dentry *dentry;
+
+	fp->lock = lock;
+
+	dentry = debugfs_create_file("fingerprint", S_IRUGO | S_IWUSR, parent,
+				     fp, &tinydrm_fingerprint_debugfs_fops);
+
+	return dentry ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(tinydrm_fingerprint_debugfs_init);
+
+/**
+ * tinydrm_spi_clocks_debugfs_init - Create SPI clock debugfs entries
+ * @dev: Device with a clock policy
+ * @parent: Parent directory
+ *
+ * Creates 'spi_cmd_hz', 'spi_pixel_hz' and 'spi_read_hz' files that can be
+ * written to change the clocks at runtime. Nothing is created if @dev has no
+ * clock policy.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_spi_clocks_debugfs_init(struct device *dev, struct dentry *parent)
+{
+	struct tinydrm_spi_clocks *clocks = tinydrm_spi_clocks_get(dev);
+
+	if (!clocks)
+		return 0;
+
+	if (!debugfs_create_u32("spi_cmd_hz", S_IRUGO | S_IWUSR, parent,
+				&clocks->cmd_hz) ||
+	    !debugfs_create_u32("spi_pixel_hz", S_IRUGO | S_IWUSR, parent,
+				&clocks->pixel_hz) ||
+	    !debugfs_create_u32("spi_read_hz", S_IRUGO | S_IWUSR, parent,
+				&clocks->read_hz))
+		return -ENOMEM;
+
+	return 0;
+}
+EXPORT_SYMBOL(tinydrm_spi_clocks_debugfs_init);
+
+#endif
+
 MODULE_LICENSE("GPL");
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017 Noralf Trønnes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/gpio/consumer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+
+#include <drm/drmP.h>
+#include <drm/tinydrm/tinydrm-regmap.h>
+
+/**
+ * DOC: overview
+ *
+ * Bit-banged I80 write-only parallel bus.
+ *
+ * If none of the data and write latch gpios can sleep, the bus is driven
+ * through gpiod_set_raw_array_value() with the write latch as the last
+ * element of the array. The line values for each byte value are precomputed
+ * with the active-low flags folded in, so writing a word is two table copies
+ * and two gpiolib calls: one that sets the data bus and pulls down /WR, and
+ * one that pulls /WR back up. If a word is the same as the previous one, only
+ * /WR is toggled.
+ *
+ * Other setups fall back to the sleeping gpiod array API.
+ */
+
+/* Data lines and the write latch */
+#define TINYDRM_I80_MAX_DESCS	17
+
+/* Impossible bus value, the bus is at most 16 bits wide */
+#define TINYDRM_I80_NO_VALUE	U32_MAX
+
+struct tinydrm_i80_gpio {
+	struct gpio_desc *wr;
+	struct gpio_descs *db;
+	u32 prev;
+
+	/* fast path */
+	bool fast;
+	int wr_low;
+	struct gpio_desc *descs[TINYDRM_I80_MAX_DESCS];
+	int lut[2][256][8];
+
+	/* benchmark, see tinydrm_i80_gpio_debugfs_init() */
+	struct mutex *lock;
+	const bool *enabled;
+};
+
+static void tinydrm_i80_gpio_init_fast(struct tinydrm_i80_gpio *i80)
+{
+	struct gpio_descs *db = i80->db;
+	unsigned int i, val;
+
+	if (gpiod_cansleep(i80->wr))
+		return;
+
+	for (i = 0; i < db->ndescs; i++)
+		if (gpiod_cansleep(db->desc[i]))
+			return;
+
+	for (i = 0; i < db->ndescs; i++) {
+		bool active_low = gpiod_is_active_low(db->desc[i]);
+
+		i80->descs[i] = db->desc[i];
+		for (val = 0; val < 256; val++)
+			i80->lut[i / 8][val][i % 8] =
+				!!(val & BIT(i % 8)) != active_low;
+	}
+
+	/* /WR goes low in the same call that sets the data bus */
+	i80->descs[db->ndescs] = i80->wr;
+	i80->wr_low = gpiod_is_active_low(i80->wr);
+	i80->fast = true;
+}
+
+/**
+ * tinydrm_i80_gpio_init - Initialize a bit-banged I80 bus
+ * @dev: Device
+ * @wr: Write latch gpio
+ * @db: Databus gpio array (8 or 16 gpios)
+ *
+ * Returns:
+ * &tinydrm_i80_gpio on success or ERR_PTR on failure.
+ */
+struct tinydrm_i80_gpio *tinydrm_i80_gpio_init(struct device *dev,
+					       struct gpio_desc *wr,
+					       struct gpio_descs *db)
+{
+	struct tinydrm_i80_gpio *i80;
+
+	if (!wr || IS_ERR_OR_NULL(db) || (db->ndescs != 8 && db->ndescs != 16))
+		return ERR_PTR(-EINVAL);
+
+	i80 = devm_kzalloc(dev, sizeof(*i80), GFP_KERNEL);
+	if (!i80)
+		return ERR_PTR(-ENOMEM);
+
+	i80->wr = wr;
+	i80->db = db;
+	i80->prev = TINYDRM_I80_NO_VALUE;
+
+	tinydrm_i80_gpio_init_fast(i80);
+
+	DRM_DEV_DEBUG_DRIVER(dev, "%u-bit bus, %s path\n", db->ndescs,
+			     i80->fast ? "fast" : "slow");
+
+	return i80;
+}
+EXPORT_SYMBOL(tinydrm_i80_gpio_init);
+
+static inline void
+tinydrm_i80_gpio_write_fast(struct tinydrm_i80_gpio *i80, u32 value)
+{
+	unsigned int num = i80->db->ndescs;
+	int values[TINYDRM_I80_MAX_DESCS];
+
+	if (value == i80->prev) {
+		gpiod_set_raw_value(i80->wr, i80->wr_low);
+		gpiod_set_raw_value(i80->wr, !i80->wr_low);
+		return;
+	}
+
+	memcpy(values, i80->lut[0][value & 0xff], sizeof(i80->lut[0][0]));
+	if (num == 16)
+		memcpy(values + 8, i80->lut[1][(value >> 8) & 0xff],
+		       sizeof(i80->lut[1][0]));
+	values[num] = i80->wr_low;
+
+	gpiod_set_raw_array_value(num + 1, i80->descs, values);
+	gpiod_set_raw_value(i80->wr, !i80->wr_low);
+	i80->prev = value;
+}
+
+static inline void
+tinydrm_i80_gpio_write_slow(struct tinydrm_i80_gpio *i80, u32 value)
+{
+	struct gpio_descs *db = i80->db;
+	int i, values[16];
+
+	gpiod_set_value_cansleep(i80->wr, 0);
+	if (value != i80->prev) {
+		for (i = 0; i < db->ndescs; i++)
+			values[i] = (value >> i) & 1;
+		gpiod_set_array_value_cansleep(db->ndescs, db->desc, values);
+		i80->prev = value;
+	}
+	gpiod_set_value_cansleep(i80->wr, 1);
+}
+
+static inline void
+tinydrm_i80_gpio_write_value(struct tinydrm_i80_gpio *i80, u32 value)
+{
+	if (i80->fast)
+		tinydrm_i80_gpio_write_fast(i80, value);
+	else
+		tinydrm_i80_gpio_write_slow(i80, value);
+}
+
+/**
+ * tinydrm_i80_gpio_write - Write buffer to the I80 bus
+ * @i80: I80 bus
+ * @buf: Buffer, 16-bit words in native endian if the bus is 16 bits wide
+ * @len: Buffer length in bytes
+ *
+ * The caller is responsible for chip select and the index/data gpio.
+ */
+void tinydrm_i80_gpio_write(struct tinydrm_i80_gpio *i80, const void *buf,
+			    size_t len)
+{
+	size_t i;
+
+	if (i80->db->ndescs == 8) {
+		const u8 *buf8 = buf;
+
+		for (i = 0; i < len; i++)
+			tinydrm_i80_gpio_write_value(i80, buf8[i]);
+	} else {
+		const u16 *buf16 = buf;
+
+		for (i = 0; i < len / 2; i++)
+			tinydrm_i80_gpio_write_value(i80, buf16[i]);
+	}
+}
+EXPORT_SYMBOL(tinydrm_i80_gpio_write);
+
+#ifdef CONFIG_DEBUG_FS
+
+#define TINYDRM_I80_BENCH_LEN	SZ_64K
+
+static void tinydrm_i80_gpio_bench(struct seq_file *m, const char *name,
+				   const void *buf, size_t len)
+{
+	struct tinydrm_i80_gpio *i80 = m->private;
+	ktime_t start;
+	s64 us;
+
+	start = ktime_get();
+	tinydrm_i80_gpio_write(i80, buf, len);
+	us = max_t(s64, ktime_us_delta(ktime_get(), start), 1);
+
+	seq_printf(m, "%s: %zu bytes in %lld us, %lld kB/s\n", name, len, us,
+		   div64_s64((s64)len * 1000, us));
+}
+
+/*
+ * Reading the file clocks out a 64k mixed pattern and a 64k solid fill and
+ * reports the throughput. This disturbs the panel, so it holds the bus owner's
+ * lock and refuses to run while the display pipe is enabled.
+ */
+static int tinydrm_i80_gpio_debugfs_bench_show(struct seq_file *m, void *d)
+{
+	struct tinydrm_i80_gpio *i80 = m->private;
+	int i, ret = 0;
+	u16 *buf;
+
+	buf = kmalloc(TINYDRM_I80_BENCH_LEN, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	ret = mutex_lock_interruptible(i80->lock);
+	if (ret)
+		goto out_free;
+
+	if (*i80->enabled) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	seq_printf(m, "%u-bit bus, %s path\n", i80->db->ndescs,
+		   i80->fast ? "fast" : "slow");
+
+	for (i = 0; i < TINYDRM_I80_BENCH_LEN / 2; i++)
+		buf[i] = i * 0x9e37;
+	tinydrm_i80_gpio_bench(m, "mixed", buf, TINYDRM_I80_BENCH_LEN);
+
+	memset(buf, 0, TINYDRM_I80_BENCH_LEN);
+	tinydrm_i80_gpio_bench(m, "solid", buf, TINYDRM_I80_BENCH_LEN);
+
+out_unlock:
+	mutex_unlock(i80->lock);
+out_free:
+	kfree(buf);
+
+	return ret;
+}
+
+static int tinydrm_i80_gpio_debugfs_bench_open(struct inode *inode,
+					       struct file *file)
+{
+	return single_open(file, tinydrm_i80_gpio_debugfs_bench_show,
+			   inode->i_private);
+}
+
+static const struct file_operations tinydrm_i80_gpio_debugfs_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = tinydrm_i80_gpio_debugfs_bench_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * tinydrm_i80_gpio_debugfs_init - Create I80 bus debugfs entries
+ * @i80: I80 bus
+ * @parent: Parent directory
+ * @lock: Lock that serializes writes to the bus
+ * @enabled: Display pipe state, protected by @lock
+ *
+ * Creates an 'i80_throughput' file that runs a write benchmark when read. The
+ * benchmark holds @lock and fails with -EBUSY while *@enabled is true.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_i80_gpio_debugfs_init(struct tinydrm_i80_gpio *i80,
+				  struct dentry *parent, struct mutex *lock,
+				  const bool *enabled)
+{
+	struct dentry *dentry;
+
+	i80->lock = lock;
+	i80->enabled = enabled;
+
+	dentry = debugfs_create_file("i80_throughput", S_IRUSR, parent, i80,
+				     &tinydrm_i80_gpio_debugfs_bench_fops);
+
+	return dentry ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(tinydrm_i80_gpio_debugfs_init);
+
+#endif
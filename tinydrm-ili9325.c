@@ -7,8 +7,11 @@
  * (at your option) any later version.
  */
 
+#include <linux/property.h>
 #include <linux/regmap.h>
+#include <linux/seq_file.h>
 #include <linux/spi/spi.h>
+#include <linux/uio.h>
 #include <asm/unaligned.h>
 
 #include <drm/drm_gem_cma_helper.h>
@@ -16,6 +19,65 @@
 #include <drm/tinydrm/tinydrm-ili9325.h>
 #include <drm/tinydrm/tinydrm-regmap.h>
 
+#define ILI9325_WINDOW_REGS	6
+
+/*
+ * Fill in the register writes that restrict GRAM writes to the window
+ * covering @clip and put the address counter in its first corner. The entry
+ * mode set for the rotation decides which corner that is and the direction
+ * the counter moves in.
+ */
+static void tinydrm_ili9325_get_window(struct tinydrm_ili9325 *ili9325,
+				       struct drm_clip_rect *clip,
+				       struct reg_sequence *seq)
+{
+	unsigned int width = ili9325->width, height = ili9325->height;
+	u16 hsa, hea, vsa, vea, ac_low, ac_high;
+
+	switch (ili9325->rotation) {
+	case 0:
+	default:
+		hsa = clip->x1;
+		hea = clip->x2 - 1;
+		vsa = clip->y1;
+		vea = clip->y2 - 1;
+		ac_low = hsa;
+		ac_high = vsa;
+		break;
+	case 180:
+		hsa = width - clip->x2;
+		hea = width - 1 - clip->x1;
+		vsa = height - clip->y2;
+		vea = height - 1 - clip->y1;
+		ac_low = hea;
+		ac_high = vea;
+		break;
+	case 270:
+		hsa = width - clip->y2;
+		hea = width - 1 - clip->y1;
+		vsa = clip->x1;
+		vea = clip->x2 - 1;
+		ac_low = hea;
+		ac_high = vsa;
+		break;
+	case 90:
+		hsa = clip->y1;
+		hea = clip->y2 - 1;
+		vsa = height - clip->x2;
+		vea = height - 1 - clip->x1;
+		ac_low = hsa;
+		ac_high = vea;
+		break;
+	}
+
+	seq[0] = (struct reg_sequence){ 0x0050, hsa };
+	seq[1] = (struct reg_sequence){ 0x0051, hea };
+	seq[2] = (struct reg_sequence){ 0x0052, vsa };
+	seq[3] = (struct reg_sequence){ 0x0053, vea };
+	seq[4] = (struct reg_sequence){ 0x0020, ac_low };
+	seq[5] = (struct reg_sequence){ 0x0021, ac_high };
+}
+
 static int tinydrm_ili9325_fb_dirty(struct drm_framebuffer *fb,
 			     struct drm_file *file_priv,
 			     unsigned int flags, unsigned int color,
@@ -26,11 +88,12 @@ static int tinydrm_ili9325_fb_dirty(struct drm_framebuffer *fb,
 	struct tinydrm_device *tdev = fb->dev->dev_private;
 	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
 	struct regmap *reg = ili9325->reg;
-	bool swap = ili9325->swap_bytes;
+	bool direct, swap = ili9325->swap_bytes;
+	struct reg_sequence seq[ILI9325_WINDOW_REGS];
 	struct drm_clip_rect clip;
-	u16 ac_low, ac_high;
+	struct kvec vec;
 	int ret = 0;
-	bool full;
+	size_t len;
 	void *tr;
 
 	mutex_lock(&tdev->dirty_lock);
@@ -42,59 +105,71 @@ static int tinydrm_ili9325_fb_dirty(struct drm_framebuffer *fb,
 	if (tdev->pipe.plane.fb != fb)
 		goto out_unlock;
 
-	full = tinydrm_merge_clips(&clip, clips, num_clips, flags,
-				   fb->width, fb->height);
+	/* The splash is up, replace all of it */
+	if (ili9325->next_full) {
+		ili9325->next_full = false;
+		clips = NULL;
+		num_clips = 0;
+	}
+
+	tinydrm_merge_clips(&clip, clips, num_clips, flags, fb->width,
+			    fb->height);
 
-	clip.x1 = 0;
-	clip.x2 = fb->width;
+	if (tinydrm_fingerprint_unchanged(&ili9325->fingerprint, fb, &clip)) {
+		DRM_DEBUG("Skipping unchanged [FB:%d]\n", fb->base.id);
+		goto out_unlock;
+	}
 
-	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u, swap=%u\n",
-		  fb->base.id, clip.x1, clip.x2, clip.y1, clip.y2, swap);
+	len = (clip.x2 - clip.x1) * (clip.y2 - clip.y1) * 2;
 
-	if (ili9325->always_tx_buf || swap || !full ||
-	    fb->format->format == DRM_FORMAT_XRGB8888) {
+	/*
+	 * A band of full lines is contiguous in the framebuffer and can be
+	 * sent in place if the pixels are already in bus format.
+	 */
+	direct = !ili9325->always_tx_buf && !swap &&
+		 fb->format->format == DRM_FORMAT_RGB565 &&
+		 clip.x1 == 0 && clip.x2 == fb->width &&
+		 fb->pitches[0] == fb->width * 2;
+
+	DRM_DEBUG("Flushing [FB:%d] x1=%u, x2=%u, y1=%u, y2=%u, swap=%u, %s %zu bytes\n",
+		  fb->base.id, clip.x1, clip.x2, clip.y1, clip.y2, swap,
+		  direct ? "passing" : "copying", len);
+
+	if (direct) {
+		tr = cma_obj->vaddr + fb->offsets[0] + clip.y1 * fb->pitches[0];
+		ili9325->direct_bytes += len;
+	} else {
+		/* The previous flush can still be sending from tx_buf */
+		tinydrm_regmap_raw_sync(ili9325->raw);
 		tr = ili9325->tx_buf;
 		ret = tinydrm_rgb565_buf_copy(tr, fb, &clip, swap);
 		if (ret)
 			goto out_unlock;
-	} else {
-		tr = cma_obj->vaddr;
+		ili9325->copied_bytes += len;
 	}
+	ili9325->flushes++;
 
 	/*
-	 * FIXME
-	 * This should support clips that are not full width,
-	 * and it looks like only 240x320 panels are supported.
+	 * Window, address counter and pixels go out in one bus transaction.
+	 * tx_buf is ours and can be sent without the bus taking a copy, the
+	 * framebuffer can change under the transfer.
 	 */
-#define WIDTH 240
-#define HEIGHT 320
-
-	switch (ili9325->rotation) {
-	case 0:
-		ac_low = 0;
-		ac_high = clip.y1;
-		break;
-	case 180:
-		ac_low = WIDTH - 1 - 0;
-		ac_high = HEIGHT - 1 - clip.y1;
-		break;
-	case 270:
-		ac_low = WIDTH - 1 - clip.y1;
-		ac_high = 0;
-		break;
-	case 90:
-		ac_low = clip.y1;
-		ac_high = HEIGHT - 1 - 0;
-		break;
-	};
-
-	regmap_write(reg, 0x0020, ac_low);
-	regmap_write(reg, 0x0021, ac_high);
-
-	ret = regmap_raw_write(reg, 0x0022, tr,
-			       (clip.x2 - clip.x1) * (clip.y2 - clip.y1) * 2);
+	tinydrm_ili9325_get_window(ili9325, &clip, seq);
+	vec.iov_base = tr;
+	vec.iov_len = len;
+	if (direct)
+		ret = tinydrm_regmap_raw_writev(reg, ili9325->raw, seq,
+						ARRAY_SIZE(seq), 0x0022,
+						&vec, 1);
+	else
+		ret = tinydrm_regmap_raw_writev_async(reg, ili9325->raw, seq,
+						      ARRAY_SIZE(seq), 0x0022,
+						      &vec, 1);
 
 out_unlock:
+	if (ret)
+		tinydrm_fingerprint_reset(&ili9325->fingerprint);
+
 	mutex_unlock(&tdev->dirty_lock);
 
 	if (ret)
@@ -110,6 +185,37 @@ static const struct drm_framebuffer_funcs tinydrm_ili9325_fb_funcs = {
 	.dirty		= tinydrm_ili9325_fb_dirty,
 };
 
+/**
+ * tinydrm_ili9325_pipe_update - Display pipe update helper
+ * @pipe: Simple display pipe
+ * @old_state: Old plane state
+ *
+ * Flushes the new framebuffer and arms the page-flip event for the next
+ * emulated vblank, see tinydrm_vblank_pipe_update(). The I80 bus returns from
+ * the flush before the writer thread has clocked out the frame, so this waits
+ * for it before the event is armed. Drivers set up the vblank emulation with
+ * devm_tinydrm_vblank_init().
+ */
+void tinydrm_ili9325_pipe_update(struct drm_simple_display_pipe *pipe,
+				 struct drm_plane_state *old_state)
+{
+	struct tinydrm_device *tdev = pipe_to_tinydrm(pipe);
+	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
+	struct drm_framebuffer *fb = pipe->plane.state->fb;
+
+	if (fb && (fb != old_state->fb)) {
+		pipe->plane.fb = fb;
+		if (fb->funcs->dirty)
+			fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	}
+
+	if (pipe->crtc.state->event)
+		tinydrm_regmap_raw_sync(ili9325->raw);
+
+	tinydrm_vblank_pipe_event(pipe);
+}
+EXPORT_SYMBOL(tinydrm_ili9325_pipe_update);
+
 static const uint32_t tinydrm_ili9325_formats[] = {
 	DRM_FORMAT_RGB565,
 	DRM_FORMAT_XRGB8888,
@@ -148,7 +254,12 @@ int tinydrm_ili9325_init(struct device *dev, struct tinydrm_ili9325 *ili9325,
 
 	ili9325->swap_bytes = tinydrm_regmap_raw_swap_bytes(reg);
 	ili9325->rotation = rotation;
+	ili9325->width = mode->hdisplay;
+	ili9325->height = mode->vdisplay;
 	ili9325->reg = reg;
+	ili9325->raw = tinydrm_regmap_raw_get(reg);
+	ili9325->adopt = device_property_read_bool(dev, "adopt-running");
+	ili9325->splash = device_property_present(dev, "splash");
 
 	ili9325->tx_buf = devm_kmalloc(dev, bufsize, GFP_KERNEL);
 	if (!ili9325->tx_buf)
@@ -178,55 +289,478 @@ int tinydrm_ili9325_init(struct device *dev, struct tinydrm_ili9325 *ili9325,
 }
 EXPORT_SYMBOL(tinydrm_ili9325_init);
 
+/*
+ * The address counter moves with every GRAM access and the window is written
+ * together with the pixel data, bypassing the cache.
+ */
+static bool tinydrm_ili9325_volatile_reg(struct device *dev, unsigned int reg)
+{
+	switch (reg) {
+	case 0x0000: /* Driver code read, start oscillation */
+	case 0x0020 ... 0x0022: /* Address counter, GRAM */
+	case 0x0050 ... 0x0053: /* Window */
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * The bus can't always read, so the cache starts out zeroed instead of
+ * reading back the defaults. regcache_sync() skips registers that are zero.
+ */
+static const u16 tinydrm_ili9325_reg_defaults_raw[0x100];
+
+static void tinydrm_ili9325_regmap_config(struct regmap_config *config)
+{
+	config->reg_bits = 16;
+	config->val_bits = 16;
+	config->max_register = 0xff;
+	config->volatile_reg = tinydrm_ili9325_volatile_reg;
+	config->reg_defaults_raw = tinydrm_ili9325_reg_defaults_raw;
+	config->num_reg_defaults_raw =
+		ARRAY_SIZE(tinydrm_ili9325_reg_defaults_raw);
+	config->cache_type = REGCACHE_FLAT;
+}
+
+/**
+ * tinydrm_ili9325_display_off - Turn off the display keeping its state
+ * @ili9325: tinydrm ILI9325 device
+ *
+ * Turns off the display without touching the rest of the controller
+ * configuration. The controller stays powered, so tinydrm_ili9325_display_on()
+ * only has to turn the display back on.
+ */
+void tinydrm_ili9325_display_off(struct tinydrm_ili9325 *ili9325)
+{
+	struct regmap *reg = ili9325->reg;
+
+	/* Leave the display on value in the cache */
+	regcache_cache_bypass(reg, true);
+	regmap_write(reg, 0x0007, 0x0000);
+	regcache_cache_bypass(reg, false);
+
+	ili9325->blanked = ili9325->initialized;
+}
+EXPORT_SYMBOL(tinydrm_ili9325_display_off);
+
+/**
+ * tinydrm_ili9325_power_down - Note that the controller can lose power
+ * @ili9325: tinydrm ILI9325 device
+ *
+ * Called on suspend after the pipeline is disabled. Register writes only go to
+ * the cache until tinydrm_ili9325_display_on() is called, which then has to
+ * verify that the controller kept its configuration.
+ */
+void tinydrm_ili9325_power_down(struct tinydrm_ili9325 *ili9325)
+{
+	ili9325->blanked = false;
+	regcache_cache_only(ili9325->reg, true);
+}
+EXPORT_SYMBOL(tinydrm_ili9325_power_down);
+
+/**
+ * tinydrm_ili9325_display_on - Restore the controller and turn on the display
+ * @ili9325: tinydrm ILI9325 device
+ *
+ * Turns the display back on, skipping the reset and power on sequence.
+ * After a plain tinydrm_ili9325_display_off() the controller kept its
+ * configuration and the register cache is trusted. After
+ * tinydrm_ili9325_power_down() this is checked by reading back a register
+ * before the cache is written out, so buses that can't read, like I80, get
+ * the full initialization in that case.
+ *
+ * Returns:
+ * True if the display is on, false if the controller needs a full reset and
+ * initialization.
+ */
+bool tinydrm_ili9325_display_on(struct tinydrm_ili9325 *ili9325)
+{
+	struct regmap *reg = ili9325->reg;
+	bool blanked = ili9325->blanked;
+	unsigned int cached, val;
+	int ret;
+
+	regcache_cache_only(reg, false);
+	ili9325->blanked = false;
+
+	if (!ili9325->initialized)
+		return false;
+
+	if (blanked)
+		goto display_on;
+
+	/* Power control is zero after reset */
+	regmap_read(reg, 0x0010, &cached);
+	regcache_cache_bypass(reg, true);
+	ret = regmap_read(reg, 0x0010, &val);
+	regcache_cache_bypass(reg, false);
+	if (ret) {
+		DRM_DEBUG_DRIVER("Can't verify the configuration\n");
+		goto err_reinit;
+	}
+
+	if (val != cached) {
+		DRM_DEBUG_DRIVER("Controller lost its configuration\n");
+		goto err_reinit;
+	}
+
+	ret = regcache_sync(reg);
+	if (ret)
+		goto err_reinit;
+
+display_on:
+	/* The cache holds the display on value display_off left behind */
+	regmap_read(reg, 0x0007, &val);
+	regcache_cache_bypass(reg, true);
+	ret = regmap_write(reg, 0x0007, val);
+	regcache_cache_bypass(reg, false);
+	if (ret)
+		goto err_reinit;
+
+	return true;
+
+err_reinit:
+	ili9325->initialized = false;
+
+	return false;
+}
+EXPORT_SYMBOL(tinydrm_ili9325_display_on);
+
+/**
+ * tinydrm_ili9325_adopt - Take over a controller set up by the bootloader
+ * @ili9325: tinydrm ILI9325 device
+ * @entry_mode: Entry Mode register (R03h) value the driver would set
+ *
+ * If the device has the 'adopt-running' property, this checks on the first
+ * call whether the controller has its power circuits running, the display on
+ * and the expected GRAM direction and color order. The caller can then skip
+ * reset and initialization, keeping the splash the bootloader put on the
+ * panel. Like after tinydrm_ili9325_splash(), &tinydrm_ili9325->next_full is
+ * set and the caller should skip the initial flush. The register cache doesn't
+ * know the adopted configuration, so the next enable after a blank does the
+ * full reset and initialization.
+ *
+ * This needs a bus that can read, it always fails on I80.
+ *
+ * Returns:
+ * True if the running controller was adopted.
+ */
+bool tinydrm_ili9325_adopt(struct tinydrm_ili9325 *ili9325,
+			   unsigned int entry_mode)
+{
+	struct regmap *reg = ili9325->reg;
+	unsigned int ctrl, power, entry;
+	int ret;
+
+	if (!ili9325->adopt)
+		return false;
+
+	ili9325->adopt = false;
+
+	regcache_cache_bypass(reg, true);
+	ret = regmap_read(reg, 0x0007, &ctrl);
+	if (!ret)
+		ret = regmap_read(reg, 0x0010, &power);
+	if (!ret)
+		ret = regmap_read(reg, 0x0003, &entry);
+	regcache_cache_bypass(reg, false);
+	if (ret) {
+		DRM_DEBUG_DRIVER("Can't read the controller, initializing\n");
+		return false;
+	}
+
+	/*
+	 * R07: Display on (GON, DTE, D1:0, BASEE)
+	 * R10: Not in sleep or standby, amplifiers on (AP)
+	 * R03: 16-bit single transfer (TRI, DFM), BGR, ID and AM
+	 */
+	if ((ctrl & 0x0133) != 0x0133 || (power & 0x0003) ||
+	    !(power & 0x0070) || (entry & 0xD038) != (entry_mode & 0xD038)) {
+		DRM_DEBUG_DRIVER("Not adopting R07=%04x R10=%04x R03=%04x\n",
+				 ctrl, power, entry);
+		return false;
+	}
+
+	DRM_DEBUG_DRIVER("Adopting the running controller\n");
+	ili9325->next_full = true;
+
+	return true;
+}
+EXPORT_SYMBOL(tinydrm_ili9325_adopt);
+
+static int tinydrm_ili9325_splash_set_window(void *arg,
+					     const struct drm_clip_rect *clip)
+{
+	struct tinydrm_ili9325 *ili9325 = arg;
+	struct reg_sequence seq[ILI9325_WINDOW_REGS];
+	struct drm_clip_rect window = *clip;
+
+	/* The window registers are volatile and go straight to the bus */
+	tinydrm_ili9325_get_window(ili9325, &window, seq);
+
+	return regmap_multi_reg_write(ili9325->reg, seq, ARRAY_SIZE(seq));
+}
+
+static int tinydrm_ili9325_splash_write(void *arg, void *buf, size_t len)
+{
+	struct tinydrm_ili9325 *ili9325 = arg;
+	struct kvec vec = {
+		.iov_base = buf,
+		.iov_len = len,
+	};
+	u16 *pixels = buf;
+	size_t i;
+
+	if (ili9325->swap_bytes)
+		for (i = 0; i < len / 2; i++)
+			swab16s(&pixels[i]);
+
+	return tinydrm_regmap_raw_writev(ili9325->reg, ili9325->raw, NULL, 0,
+					 0x0022, &vec, 1);
+}
+
+static const struct tinydrm_splash_funcs tinydrm_ili9325_splash_funcs = {
+	.set_window = tinydrm_ili9325_splash_set_window,
+	.write = tinydrm_ili9325_splash_write,
+};
+
+/**
+ * tinydrm_ili9325_splash - Show the boot splash
+ * @ili9325: tinydrm ILI9325 device
+ *
+ * Writes the image from the 'splash' firmware file to GRAM, decoded through
+ * &tinydrm_ili9325->tx_buf. This is only done on the first call, which should
+ * be right after the first controller initialization in probe. If the splash
+ * was shown, &tinydrm_ili9325->next_full is set. The caller should then skip
+ * the initial flush, so the splash stays up until there's something to show,
+ * and that flush redraws the whole framebuffer.
+ *
+ * Returns:
+ * True if the splash was shown.
+ */
+bool tinydrm_ili9325_splash(struct tinydrm_ili9325 *ili9325)
+{
+	struct drm_device *drm = ili9325->tinydrm.drm;
+	int ret;
+
+	if (!ili9325->splash)
+		return false;
+
+	ili9325->splash = false;
+
+	ret = tinydrm_splash_draw(drm->dev, drm->mode_config.min_width,
+				  drm->mode_config.min_height, ili9325->tx_buf,
+				  ili9325->width * ili9325->height * 2,
+				  &tinydrm_ili9325_splash_funcs, ili9325);
+	if (ret) {
+		dev_warn(drm->dev, "Failed to show splash %d\n", ret);
+		return false;
+	}
+
+	ili9325->next_full = true;
+
+	return true;
+}
+EXPORT_SYMBOL(tinydrm_ili9325_splash);
+
+/**
+ * tinydrm_ili9325_i80_init - Initialize an I80 bus regmap for ILI9325
+ * @dev: Device
+ * @cs: Chip Select gpio (optional)
+ * @idx: Index gpio
+ * @wr: Write latch gpio
+ * @db: Databus gpio array
+ *
+ * Same as tinydrm_i80_init() with 16-bit registers and a register cache.
+ *
+ * Returns:
+ * &regmap on success or ERR_PTR on failure.
+ */
+struct regmap *tinydrm_ili9325_i80_init(struct device *dev,
+					struct gpio_desc *cs,
+					struct gpio_desc *idx,
+					struct gpio_desc *wr,
+					struct gpio_descs *db)
+{
+	struct regmap_config config = {};
+
+	tinydrm_ili9325_regmap_config(&config);
+
+	return tinydrm_i80_init_config(dev, &config, cs, idx, wr, db);
+}
+EXPORT_SYMBOL(tinydrm_ili9325_i80_init);
+
 #if IS_ENABLED(CONFIG_SPI)
 
+/* Startbyte: | 0 | 1 | 1 | 1 | 0 | ID | RS | RW | */
+#define ILI9325_SB_INDEX	0
+#define ILI9325_SB_WRITE	1
+#define ILI9325_SB_READ		2
+
 struct tinydrm_ili9325_spi {
 	struct spi_device *spi;
 	struct regmap *reg;
 	unsigned int bpw;
 	unsigned int id;
+	size_t max_chunk;
+	struct tinydrm_spi_clocks *clocks;
+	/* DMA-safe, written once at init */
+	u8 *startbyte;
+	/* DMA-safe, protected by the regmap lock */
+	u8 *rx_buf;
+
+	/* Reused by every tinydrm_ili9325_spi_submit(), protected by @lock */
+	struct mutex lock;
+	struct spi_transfer *tr;
+	unsigned int max_tr;
+	/* DMA-safe */
+	u8 *words;
 };
 
-/* Startbyte: | 0 | 1 | 1 | 1 | 0 | ID | RS | RW | */
 static u8 tinydrm_ili9325_spi_get_startbyte(bool id, bool rs, bool read)
 {
 	return 0x70 | (id << 2) | (rs << 1) | read;
 }
 
+/* Queue a startbyte followed by @len bytes, chip select toggles afterwards */
+static struct spi_transfer *
+tinydrm_ili9325_spi_add(struct tinydrm_ili9325_spi *spih,
+			struct spi_message *m, struct spi_transfer *tr,
+			unsigned int sb, const void *buf, size_t len,
+			u32 speed_hz)
+{
+	tr->tx_buf = &spih->startbyte[sb];
+	tr->len = 1;
+	tr->bits_per_word = 8;
+	tr->speed_hz = speed_hz;
+	spi_message_add_tail(tr++, m);
+
+	tr->tx_buf = buf;
+	tr->len = len;
+	tr->bits_per_word = spih->bpw;
+	tr->speed_hz = speed_hz;
+	tr->cs_change = 1;
+	spi_message_add_tail(tr++, m);
+
+	return tr;
+}
+
+/* Same word format as the regmap core uses for this bus */
+static void tinydrm_ili9325_spi_put(struct tinydrm_ili9325_spi *spih,
+				    unsigned int val, u8 *dst)
+{
+	if (spih->bpw == 16)
+		put_unaligned((u16)val, (u16 *)dst);
+	else
+		put_unaligned_be16(val, dst);
+}
+
+/*
+ * Build one message out of the register writes in @seq followed by the
+ * buffers in @vec written to the register @reg (bus formatted), and send it.
+ * The transfer array grows to the largest flush seen and is kept.
+ */
+static int tinydrm_ili9325_spi_submit(struct tinydrm_ili9325_spi *spih,
+				      const struct reg_sequence *seq,
+				      unsigned int num_seq, const void *reg,
+				      const struct kvec *vec, unsigned int num)
+{
+	u32 cmd_hz = READ_ONCE(spih->clocks->cmd_hz);
+	u32 pixel_hz = READ_ONCE(spih->clocks->pixel_hz);
+	unsigned int i, ntr = 2 + 4 * num_seq;
+	size_t offset, chunk;
+	struct spi_transfer *tr;
+	struct spi_message m;
+	u8 *words;
+	int ret;
+
+	if (WARN_ON_ONCE(num_seq > ILI9325_WINDOW_REGS))
+		return -EINVAL;
+
+	for (i = 0; i < num; i++)
+		ntr += 2 * DIV_ROUND_UP(vec[i].iov_len, spih->max_chunk);
+
+	mutex_lock(&spih->lock);
+
+	if (ntr > spih->max_tr) {
+		kfree(spih->tr);
+		spih->max_tr = 0;
+		spih->tr = kmalloc_array(ntr, sizeof(*tr), GFP_KERNEL);
+		if (!spih->tr) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		spih->max_tr = ntr;
+	}
+	memset(spih->tr, 0, ntr * sizeof(*tr));
+
+	spi_message_init(&m);
+	tr = spih->tr;
+	words = spih->words;
+
+	for (i = 0; i < num_seq; i++, words += 4) {
+		tinydrm_ili9325_spi_put(spih, seq[i].reg, words);
+		tinydrm_ili9325_spi_put(spih, seq[i].def, words + 2);
+		tr = tinydrm_ili9325_spi_add(spih, &m, tr,
+					     ILI9325_SB_INDEX, words, 2,
+					     cmd_hz);
+		tr = tinydrm_ili9325_spi_add(spih, &m, tr,
+					     ILI9325_SB_WRITE, words + 2, 2,
+					     cmd_hz);
+	}
+
+	memcpy(words, reg, 2);
+	tr = tinydrm_ili9325_spi_add(spih, &m, tr, ILI9325_SB_INDEX,
+				     words, 2, cmd_hz);
+
+	for (i = 0; i < num; i++) {
+		for (offset = 0; offset < vec[i].iov_len; offset += chunk) {
+			chunk = min(vec[i].iov_len - offset, spih->max_chunk);
+			tr = tinydrm_ili9325_spi_add(spih, &m, tr,
+					ILI9325_SB_WRITE,
+					vec[i].iov_base + offset, chunk,
+					pixel_hz);
+		}
+	}
+	/* Leave chip select to the core after the last transfer */
+	(tr - 1)->cs_change = 0;
+
+	ret = spi_sync(spih->spi, &m);
+
+out_unlock:
+	mutex_unlock(&spih->lock);
+
+	return ret;
+}
+
 static int tinydrm_ili9325_spi_gather_write(void *context, const void *reg,
 					    size_t reg_len, const void *val,
 					    size_t val_len)
 {
 	struct tinydrm_ili9325_spi *spih = context;
-	/* For reliability only run pixel data above spec */
-	u32 norm_speed_hz = min_t(u32, 10000000, spih->spi->max_speed_hz);
-	struct spi_transfer header = {
-		.speed_hz = norm_speed_hz,
-		.bits_per_word = 8,
-		.len = 1,
-	};
-	u8 *startbyte;
-	int ret;
-
-	startbyte = kmalloc(1, GFP_KERNEL);
-	if (!startbyte)
-		return -ENOMEM;
+	u32 cmd_hz = READ_ONCE(spih->clocks->cmd_hz);
+	struct spi_transfer tr[4] = {};
+	struct spi_message m;
+	struct kvec vec;
 
-	header.tx_buf = startbyte;
-	*startbyte = tinydrm_ili9325_spi_get_startbyte(spih->id, 0, false);
-	ret = tinydrm_spi_transfer(spih->spi, norm_speed_hz, &header,
-				   spih->bpw, reg, reg_len);
-	if (ret)
-		goto err_free;
+	/* Pixel data */
+	if (val_len > 64) {
+		vec.iov_base = (void *)val;
+		vec.iov_len = val_len;
 
-	*startbyte = tinydrm_ili9325_spi_get_startbyte(spih->id, 1, false);
-	ret = tinydrm_spi_transfer(spih->spi, val_len > 64 ? 0 : norm_speed_hz,
-				   &header, spih->bpw, val, val_len);
+		return tinydrm_ili9325_spi_submit(spih, NULL, 0, reg, &vec, 1);
+	}
 
-err_free:
-	kfree(startbyte);
+	/* reg and val are in the regmap work buffer, which is DMA-safe */
+	spi_message_init(&m);
+	tinydrm_ili9325_spi_add(spih, &m, &tr[0], ILI9325_SB_INDEX, reg,
+				reg_len, cmd_hz);
+	tinydrm_ili9325_spi_add(spih, &m, &tr[2], ILI9325_SB_WRITE, val,
+				val_len, cmd_hz);
+	tr[3].cs_change = 0;
 
-	return ret;
+	return spi_sync(spih->spi, &m);
 }
 
 static int tinydrm_ili9325_spi_write(void *context, const void *data,
@@ -244,61 +778,41 @@ static int tinydrm_ili9325_spi_read(void *context, const void *reg,
 {
 	struct tinydrm_ili9325_spi *spih = context;
 	struct spi_device *spi = spih->spi;
-	u32 speed_hz = min_t(u32, 5000000, spi->max_speed_hz / 2);
-	struct spi_transfer header = {
-		.speed_hz = speed_hz,
-		.bits_per_word = 8,
-		.len = 1,
-	};
-	struct spi_transfer trrx = {
-		.speed_hz = speed_hz,
-		.bits_per_word = 8,
-		.len = 3, /* including dummy byte */
-	};
+	u32 speed_hz = READ_ONCE(spih->clocks->read_hz);
+	struct spi_transfer tr[4] = {};
 	struct spi_message m;
-	u8 *startbyte;
 	int ret;
 
 	if (WARN_ON_ONCE(val_len != 2))
 		return -EINVAL;
 
-	startbyte = kmalloc(1, GFP_KERNEL);
-	if (!startbyte)
-		return -ENOMEM;
+	spi_message_init(&m);
+	tinydrm_ili9325_spi_add(spih, &m, &tr[0], ILI9325_SB_INDEX, reg,
+				reg_len, speed_hz);
 
-	trrx.rx_buf = kzalloc(trrx.len, GFP_KERNEL);
-	if (!trrx.rx_buf) {
-		ret = -ENOMEM;
-		goto err_free;
-	}
+	tr[2].tx_buf = &spih->startbyte[ILI9325_SB_READ];
+	tr[2].len = 1;
+	tr[2].bits_per_word = 8;
+	tr[2].speed_hz = speed_hz;
+	spi_message_add_tail(&tr[2], &m);
 
-	header.tx_buf = startbyte;
-	*startbyte = tinydrm_ili9325_spi_get_startbyte(spih->id, 0, false);
-	ret = tinydrm_spi_transfer(spi, speed_hz, &header, spih->bpw,
-				   reg, reg_len);
-	if (ret)
-		goto err_free;
+	tr[3].rx_buf = spih->rx_buf;
+	tr[3].len = 3; /* including dummy byte */
+	tr[3].bits_per_word = 8;
+	tr[3].speed_hz = speed_hz;
+	spi_message_add_tail(&tr[3], &m);
 
-	//tinydrm_ili9325_spi_set_header(spih, headerbuf, 1, true);
-	*startbyte = tinydrm_ili9325_spi_get_startbyte(spih->id, 1, true);
-	spi_message_init(&m);
-	spi_message_add_tail(&header, &m);
-	spi_message_add_tail(&trrx, &m);
 	ret = spi_sync(spi, &m);
 	if (ret)
-		goto err_free;
+		return ret;
 
 	/* throw away dummy byte */
 	if (tinydrm_regmap_raw_swap_bytes(spih->reg))
-		*((u16 *)val) = get_unaligned_le16(trrx.rx_buf + 1);
+		*((u16 *)val) = get_unaligned_le16(spih->rx_buf + 1);
 	else
-		*((u16 *)val) = get_unaligned_be16(trrx.rx_buf + 1);
+		*((u16 *)val) = get_unaligned_be16(spih->rx_buf + 1);
 
-err_free:
-	kfree(startbyte);
-	kfree(trrx.rx_buf);
-
-	return ret;
+	return 0;
 }
 
 static const struct regmap_bus tinydrm_ili9325_spi_bus = {
@@ -309,25 +823,78 @@ static const struct regmap_bus tinydrm_ili9325_spi_bus = {
 	.val_format_endian_default = REGMAP_ENDIAN_NATIVE,
 };
 
+/* The message is sent with spi_sync(), so there's no need for a sync op */
+static int tinydrm_ili9325_spi_raw_write(void *context,
+					 const struct reg_sequence *seq,
+					 unsigned int num_seq,
+					 unsigned int regnr,
+					 const struct kvec *vec,
+					 unsigned int num, bool async)
+{
+	struct tinydrm_ili9325_spi *spih = context;
+	u8 reg[2];
+
+	tinydrm_ili9325_spi_put(spih, regnr, reg);
+
+	return tinydrm_ili9325_spi_submit(spih, seq, num_seq, reg, vec, num);
+}
+
+static const struct tinydrm_regmap_raw_funcs tinydrm_ili9325_spi_raw_funcs = {
+	.write = tinydrm_ili9325_spi_raw_write,
+};
+
+static void tinydrm_ili9325_spi_fini(void *data)
+{
+	struct tinydrm_ili9325_spi *spih = data;
+
+	kfree(spih->tr);
+}
+
 struct regmap *tinydrm_ili9325_spi_init(struct spi_device *spi,
 					unsigned int id)
 {
 	struct tinydrm_ili9325_spi *spih;
 	struct device *dev = &spi->dev;
-	struct regmap_config config = {
-		.reg_bits = 16,
-		.val_bits = 16,
-		.max_register = 0xff,
-		.cache_type = REGCACHE_NONE,
-	};
+	struct regmap_config config = {};
+	int ret;
 
 	spih = devm_kzalloc(dev, sizeof(*spih), GFP_KERNEL);
 	if (!spih)
 		return ERR_PTR(-ENOMEM);
 
+	spih->startbyte = devm_kmalloc(dev, 3, GFP_KERNEL);
+	spih->rx_buf = devm_kmalloc(dev, 3, GFP_KERNEL);
+	/* A register and value word per write plus the latched register */
+	spih->words = devm_kmalloc(dev, (ILI9325_WINDOW_REGS + 1) * 4,
+				   GFP_KERNEL);
+	if (!spih->startbyte || !spih->rx_buf || !spih->words)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_init(&spih->lock);
+	ret = devm_add_action(dev, tinydrm_ili9325_spi_fini, spih);
+	if (ret)
+		return ERR_PTR(ret);
+
+	tinydrm_ili9325_regmap_config(&config);
+
 	spih->spi = spi;
 	spih->bpw = 16;
 	spih->id = id;
+	spih->max_chunk = tinydrm_spi_max_transfer_size(spi, 0);
+
+	/* For reliability only run pixel data above spec */
+	spih->clocks = devm_tinydrm_spi_clocks_init(spi,
+				min_t(u32, 10000000, spi->max_speed_hz), 0,
+				min_t(u32, 5000000, spi->max_speed_hz / 2));
+	if (IS_ERR(spih->clocks))
+		return ERR_CAST(spih->clocks);
+
+	spih->startbyte[ILI9325_SB_INDEX] =
+		tinydrm_ili9325_spi_get_startbyte(id, 0, false);
+	spih->startbyte[ILI9325_SB_WRITE] =
+		tinydrm_ili9325_spi_get_startbyte(id, 1, false);
+	spih->startbyte[ILI9325_SB_READ] =
+		tinydrm_ili9325_spi_get_startbyte(id, 1, true);
 
 	if (!tinydrm_spi_bpw_supported(spi, 16)) {
 		config.reg_format_endian = REGMAP_ENDIAN_BIG,
@@ -337,6 +904,13 @@ struct regmap *tinydrm_ili9325_spi_init(struct spi_device *spi,
 
 	spih->reg = devm_regmap_init(dev, &tinydrm_ili9325_spi_bus, spih,
 				     &config);
+	if (IS_ERR(spih->reg))
+		return spih->reg;
+
+	ret = devm_tinydrm_regmap_raw_init(spih->reg,
+					   &tinydrm_ili9325_spi_raw_funcs, spih);
+	if (ret)
+		return ERR_PTR(ret);
 
 	return spih->reg;
 }
@@ -346,8 +920,25 @@ EXPORT_SYMBOL(tinydrm_ili9325_spi_init);
 
 #ifdef CONFIG_DEBUG_FS
 
+static int tinydrm_ili9325_debugfs_flush_stats_show(struct seq_file *m,
+						    void *arg)
+{
+	struct drm_info_node *node = m->private;
+	struct tinydrm_device *tdev = node->minor->dev->dev_private;
+	struct tinydrm_ili9325 *ili9325 = tinydrm_to_ili9325(tdev);
+
+	mutex_lock(&tdev->dirty_lock);
+	seq_printf(m, "flushes: %llu\n", ili9325->flushes);
+	seq_printf(m, "copied_bytes: %llu\n", ili9325->copied_bytes);
+	seq_printf(m, "direct_bytes: %llu\n", ili9325->direct_bytes);
+	mutex_unlock(&tdev->dirty_lock);
+
+	return 0;
+}
+
 static const struct drm_info_list ili9325_debugfs_list[] = {
 	{ "fb",   drm_fb_cma_debugfs_show, 0 },
+	{ "flush_stats", tinydrm_ili9325_debugfs_flush_stats_show, 0 },
 };
 
 /**
@@ -369,6 +960,22 @@ int tinydrm_ili9325_debugfs_init(struct drm_minor *minor)
 	if (ret)
 		return ret;
 
+	ret = tinydrm_spi_clocks_debugfs_init(regmap_get_device(ili9325->reg),
+					      minor->debugfs_root);
+	if (ret)
+		return ret;
+
+	ret = tinydrm_fingerprint_debugfs_init(&ili9325->fingerprint,
+					       minor->debugfs_root,
+					       &tdev->dirty_lock);
+	if (ret)
+		return ret;
+
+	ret = tinydrm_i80_debugfs_init(ili9325->reg, minor->debugfs_root,
+				       &tdev->dirty_lock, &ili9325->enabled);
+	if (ret)
+		return ret;
+
 	return drm_debugfs_create_files(ili9325_debugfs_list,
 					ARRAY_SIZE(ili9325_debugfs_list),
 					minor->debugfs_root, minor);
@@ -10,7 +10,13 @@
 #include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/gpio/consumer.h>
+#include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/property.h>
 #include <linux/regmap.h>
+#include <linux/uio.h>
+#include <linux/wait.h>
+#include <asm/unaligned.h>
 
 #include <drm/drmP.h>
 #include <drm/tinydrm/tinydrm-helpers.h>
@@ -50,68 +56,389 @@ bool tinydrm_regmap_raw_swap_bytes(struct regmap *reg)
 }
 EXPORT_SYMBOL(tinydrm_regmap_raw_swap_bytes);
 
-struct tinydrm_regmap_i80 {
-	struct device *dev;
+struct tinydrm_regmap_raw {
 	struct regmap *reg;
-	struct gpio_desc *cs;
-	struct gpio_desc *idx;
-	struct gpio_desc *wr;
-	struct gpio_descs *db;
+	const struct tinydrm_regmap_raw_funcs *funcs;
+	void *context;
 };
 
-static void tinydrm_i80_write_value(struct gpio_desc *wr,
-				    struct gpio_descs *db, u32 value)
+static void tinydrm_regmap_raw_release(struct device *dev, void *res)
 {
-	int i, values[32];
+}
 
-	for (i = 0; i < db->ndescs; i++, value >>= 1)
-		values[i] = value & 1;
+static int tinydrm_regmap_raw_match(struct device *dev, void *res, void *data)
+{
+	struct tinydrm_regmap_raw *raw = res;
 
-	gpiod_set_value_cansleep(wr, 0);
-	gpiod_set_array_value_cansleep(db->ndescs, db->desc, values);
-	gpiod_set_value_cansleep(wr, 1);
+	return raw->reg == data;
 }
 
-static void tinydrm_i80_write_buf(struct gpio_desc *wr, struct gpio_descs *db,
-				  const void *buf, size_t len)
+/**
+ * devm_tinydrm_regmap_raw_init - Register raw bus access for a regmap
+ * @reg: Regmap
+ * @funcs: Raw bus callbacks
+ * @context: Bus context passed to the callbacks
+ *
+ * Buses use this to let tinydrm_regmap_raw_writev() bypass @reg, drivers look
+ * it up with tinydrm_regmap_raw_get().
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int devm_tinydrm_regmap_raw_init(struct regmap *reg,
+				 const struct tinydrm_regmap_raw_funcs *funcs,
+				 void *context)
 {
-	unsigned int width = db->ndescs;
-	size_t i;
+	struct tinydrm_regmap_raw *raw;
 
-	if (width == 8) {
-		const u8 *buf8 = buf;
+	raw = devres_alloc(tinydrm_regmap_raw_release, sizeof(*raw),
+			   GFP_KERNEL);
+	if (!raw)
+		return -ENOMEM;
 
-		for (i = 0; i < len; i++)
-			tinydrm_i80_write_value(wr, db, *buf8++);
-	} else if (width == 16) {
-		const u16 *buf16 = buf;
+	raw->reg = reg;
+	raw->funcs = funcs;
+	raw->context = context;
+	devres_add(regmap_get_device(reg), raw);
 
-		for (i = 0; i < (len / 2); i++)
-			tinydrm_i80_write_value(wr, db, *buf16++);
-	} else {
-		WARN_ON_ONCE(1);
-	}
+	return 0;
 }
+EXPORT_SYMBOL(devm_tinydrm_regmap_raw_init);
 
-static int tinydrm_regmap_i80_gather_write(void *context, const void *reg,
-					   size_t reg_len, const void *val,
-					   size_t val_len)
+/**
+ * tinydrm_regmap_raw_get - Look up the raw bus access of a regmap
+ * @reg: Regmap
+ *
+ * Drivers call this once at init and pass the result to
+ * tinydrm_regmap_raw_writev().
+ *
+ * Returns:
+ * The raw bus access registered with devm_tinydrm_regmap_raw_init() or NULL
+ * if the bus has none.
+ */
+struct tinydrm_regmap_raw *tinydrm_regmap_raw_get(struct regmap *reg)
 {
-	struct tinydrm_regmap_i80 *i80 = context;
+	return devres_find(regmap_get_device(reg), tinydrm_regmap_raw_release,
+			   tinydrm_regmap_raw_match, reg);
+}
+EXPORT_SYMBOL(tinydrm_regmap_raw_get);
+
+static int __tinydrm_regmap_raw_writev(struct regmap *reg,
+				       struct tinydrm_regmap_raw *raw,
+				       const struct reg_sequence *seq,
+				       unsigned int num_seq, unsigned int regnr,
+				       const struct kvec *vec, unsigned int num,
+				       bool async)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (raw)
+		return raw->funcs->write(raw->context, seq, num_seq, regnr, vec,
+					 num, async);
+
+	if (num_seq)
+		ret = regmap_multi_reg_write(reg, seq, num_seq);
+
+	for (i = 0; i < num && !ret; i++)
+		ret = regmap_raw_write(reg, regnr, vec[i].iov_base,
+				       vec[i].iov_len);
+
+	return ret;
+}
+
+/**
+ * tinydrm_regmap_raw_writev - Write buffers straight to the bus
+ * @reg: Regmap
+ * @raw: Raw bus access from tinydrm_regmap_raw_get(), can be NULL
+ * @seq: Register writes to do first (optional)
+ * @num_seq: Number of register writes in @seq
+ * @regnr: Register to write to
+ * @vec: Buffers
+ * @num: Number of buffers
+ *
+ * This latches @regnr and streams the buffers in @vec to it without going
+ * through the regmap core: no copy, no formatting and no regmap lock. It's
+ * meant for pixel data, the buffers have the same layout as for
+ * regmap_raw_write(). The register writes in @seq go out in the same bus
+ * transaction, this is meant for the window and address counter registers
+ * that precede the pixels, they bypass the register cache and should be
+ * volatile. Other register traffic should still go through regmap, the bus
+ * keeps the two in order. Delays in @seq are not supported.
+ *
+ * The buffers can be reused when the function returns, but the transfer might
+ * still be in progress, use tinydrm_regmap_raw_sync() to wait for it. Without
+ * @raw this falls back to regmap_raw_write().
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_regmap_raw_writev(struct regmap *reg,
+			      struct tinydrm_regmap_raw *raw,
+			      const struct reg_sequence *seq,
+			      unsigned int num_seq, unsigned int regnr,
+			      const struct kvec *vec, unsigned int num)
+{
+	return __tinydrm_regmap_raw_writev(reg, raw, seq, num_seq, regnr, vec,
+					   num, false);
+}
+EXPORT_SYMBOL(tinydrm_regmap_raw_writev);
+
+/**
+ * tinydrm_regmap_raw_writev_async - Write buffers to the bus in the background
+ * @reg: Regmap
+ * @raw: Raw bus access from tinydrm_regmap_raw_get(), can be NULL
+ * @seq: Register writes to do first (optional)
+ * @num_seq: Number of register writes in @seq
+ * @regnr: Register to write to
+ * @vec: Buffers
+ * @num: Number of buffers
+ *
+ * Same as tinydrm_regmap_raw_writev(), but the bus can send the buffers
+ * without taking a copy. They must stay untouched until
+ * tinydrm_regmap_raw_sync() has returned. The caller owns the buffers, so this
+ * is meant for a driver transmit buffer and not for framebuffer memory.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_regmap_raw_writev_async(struct regmap *reg,
+				    struct tinydrm_regmap_raw *raw,
+				    const struct reg_sequence *seq,
+				    unsigned int num_seq, unsigned int regnr,
+				    const struct kvec *vec, unsigned int num)
+{
+	return __tinydrm_regmap_raw_writev(reg, raw, seq, num_seq, regnr, vec,
+					   num, true);
+}
+EXPORT_SYMBOL(tinydrm_regmap_raw_writev_async);
+
+/**
+ * tinydrm_regmap_raw_sync - Wait for raw writes to complete
+ * @raw: Raw bus access from tinydrm_regmap_raw_get(), can be NULL
+ *
+ * Waits until the writes issued with tinydrm_regmap_raw_writev() and
+ * tinydrm_regmap_raw_writev_async() have reached the controller. Drivers call
+ * this before they signal that a frame is on the panel and before they reuse a
+ * buffer passed to tinydrm_regmap_raw_writev_async().
+ */
+void tinydrm_regmap_raw_sync(struct tinydrm_regmap_raw *raw)
+{
+	if (raw && raw->funcs->sync)
+		raw->funcs->sync(raw->context);
+}
+EXPORT_SYMBOL(tinydrm_regmap_raw_sync);
+
+/*
+ * Payloads at least this big are handed off to the writer thread, smaller
+ * ones (register writes) are clocked out directly.
+ */
+#define TINYDRM_I80_ASYNC_MIN	64
+
+/* Register writes that can be queued ahead of a payload */
+#define TINYDRM_I80_MAX_SEQ	8
+
+struct tinydrm_regmap_i80;
+
+struct tinydrm_regmap_i80_buf {
+	struct kthread_work work;
+	struct tinydrm_regmap_i80 *i80;
+	struct reg_sequence seq[TINYDRM_I80_MAX_SEQ];
+	unsigned int num_seq;
+	u8 reg[2];
+	size_t reg_len;
+	const void *data;
+	size_t len;
+	void *val;
+	size_t size;
+	bool busy;
+};
+
+struct tinydrm_regmap_i80 {
+	struct device *dev;
+	struct regmap *reg;
+	struct gpio_desc *cs;
+	struct gpio_desc *idx;
+	struct tinydrm_i80_gpio *bus;
+	unsigned int reg_width;
+
+	/* serializes regmap and raw writes */
+	struct mutex lock;
+
+	/* asynchronous writes */
+	struct kthread_worker *worker;
+	struct tinydrm_regmap_i80_buf bufs[2];
+	unsigned int next;
+	wait_queue_head_t wait;
+};
+
+static void tinydrm_regmap_i80_xfer(struct tinydrm_regmap_i80 *i80,
+				    const void *reg, size_t reg_len,
+				    const struct kvec *vec, unsigned int num)
+{
+	unsigned int i;
 
 	if (i80->cs)
 		gpiod_set_value_cansleep(i80->cs, 0);
 
 	if (i80->idx)
 		gpiod_set_value_cansleep(i80->idx, 0);
-	tinydrm_i80_write_buf(i80->wr, i80->db, reg, reg_len);
+	tinydrm_i80_gpio_write(i80->bus, reg, reg_len);
 
 	if (i80->idx)
 		gpiod_set_value_cansleep(i80->idx, 1);
-	tinydrm_i80_write_buf(i80->wr, i80->db, val, val_len);
+	for (i = 0; i < num; i++)
+		tinydrm_i80_gpio_write(i80->bus, vec[i].iov_base,
+				       vec[i].iov_len);
 
 	if (i80->cs)
 		gpiod_set_value_cansleep(i80->cs, 1);
+}
+
+/* Same format as the regmap core produces for this bus */
+static size_t tinydrm_regmap_i80_format(struct tinydrm_regmap_i80 *i80,
+					unsigned int val, u8 *dst)
+{
+	if (i80->reg_width == 8) {
+		dst[0] = val;
+		return 1;
+	}
+
+	put_unaligned_be16(val, dst);
+
+	return 2;
+}
+
+static void tinydrm_regmap_i80_xfer_seq(struct tinydrm_regmap_i80 *i80,
+					const struct reg_sequence *seq,
+					unsigned int num_seq)
+{
+	unsigned int i;
+	struct kvec vec;
+	u8 reg[2], val[2];
+	size_t reg_len;
+
+	for (i = 0; i < num_seq; i++) {
+		reg_len = tinydrm_regmap_i80_format(i80, seq[i].reg, reg);
+		vec.iov_base = val;
+		vec.iov_len = tinydrm_regmap_i80_format(i80, seq[i].def, val);
+		tinydrm_regmap_i80_xfer(i80, reg, reg_len, &vec, 1);
+	}
+}
+
+static void tinydrm_regmap_i80_work(struct kthread_work *work)
+{
+	struct tinydrm_regmap_i80_buf *buf;
+	struct tinydrm_regmap_i80 *i80;
+	struct kvec vec;
+
+	buf = container_of(work, struct tinydrm_regmap_i80_buf, work);
+	i80 = buf->i80;
+
+	vec.iov_base = (void *)buf->data;
+	vec.iov_len = buf->len;
+	tinydrm_regmap_i80_xfer_seq(i80, buf->seq, buf->num_seq);
+	tinydrm_regmap_i80_xfer(i80, buf->reg, buf->reg_len, &vec, 1);
+
+	smp_store_release(&buf->busy, false);
+	wake_up(&i80->wait);
+}
+
+/*
+ * Queue the payload on the writer thread. Unless the caller keeps a single
+ * buffer untouched until the write is done (@async), it's copied to a free
+ * staging buffer. With two slots the caller can prepare the next frame while
+ * the previous one is clocked out, a third write waits for the oldest to
+ * finish.
+ */
+static int tinydrm_regmap_i80_queue(struct tinydrm_regmap_i80 *i80,
+				    const struct reg_sequence *seq,
+				    unsigned int num_seq,
+				    const void *reg, size_t reg_len,
+				    const struct kvec *vec, unsigned int num,
+				    bool async)
+{
+	struct tinydrm_regmap_i80_buf *buf = &i80->bufs[i80->next];
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		len += vec[i].iov_len;
+
+	wait_event(i80->wait, !smp_load_acquire(&buf->busy));
+
+	if (async && num == 1) {
+		buf->data = vec[0].iov_base;
+		goto out_queue;
+	}
+
+	if (buf->size < len) {
+		kvfree(buf->val);
+		buf->size = 0;
+		buf->val = kvmalloc(len, GFP_KERNEL);
+		if (!buf->val)
+			return -ENOMEM;
+		buf->size = len;
+	}
+
+	for (i = 0, len = 0; i < num; i++) {
+		memcpy(buf->val + len, vec[i].iov_base, vec[i].iov_len);
+		len += vec[i].iov_len;
+	}
+	buf->data = buf->val;
+
+out_queue:
+	memcpy(buf->seq, seq, num_seq * sizeof(*seq));
+	buf->num_seq = num_seq;
+	memcpy(buf->reg, reg, reg_len);
+	buf->reg_len = reg_len;
+	buf->len = len;
+
+	buf->busy = true;
+	kthread_queue_work(i80->worker, &buf->work);
+	i80->next ^= 1;
+
+	return 0;
+}
+
+static void tinydrm_regmap_i80_writev(struct tinydrm_regmap_i80 *i80,
+				      const struct reg_sequence *seq,
+				      unsigned int num_seq,
+				      const void *reg, size_t reg_len,
+				      const struct kvec *vec, unsigned int num,
+				      bool async)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		len += vec[i].iov_len;
+
+	if (len >= TINYDRM_I80_ASYNC_MIN && num_seq <= TINYDRM_I80_MAX_SEQ &&
+	    reg_len <= sizeof(i80->bufs[0].reg) &&
+	    !tinydrm_regmap_i80_queue(i80, seq, num_seq, reg, reg_len,
+				      vec, num, async))
+		return;
+
+	/* Keep ordering with the queued writes */
+	kthread_flush_worker(i80->worker);
+	tinydrm_regmap_i80_xfer_seq(i80, seq, num_seq);
+	tinydrm_regmap_i80_xfer(i80, reg, reg_len, vec, num);
+}
+
+static int tinydrm_regmap_i80_gather_write(void *context, const void *reg,
+					   size_t reg_len, const void *val,
+					   size_t val_len)
+{
+	struct tinydrm_regmap_i80 *i80 = context;
+	struct kvec vec = {
+		.iov_base = (void *)val,
+		.iov_len = val_len,
+	};
+
+	mutex_lock(&i80->lock);
+	tinydrm_regmap_i80_writev(i80, NULL, 0, reg, reg_len, &vec, 1, false);
+	mutex_unlock(&i80->lock);
 
 	return 0;
 }
@@ -143,10 +470,86 @@ static const struct regmap_bus tinydrm_i80_bus = {
 
 };
 
+static int tinydrm_regmap_i80_raw_write(void *context,
+					const struct reg_sequence *seq,
+					unsigned int num_seq,
+					unsigned int regnr,
+					const struct kvec *vec,
+					unsigned int num, bool async)
+{
+	struct tinydrm_regmap_i80 *i80 = context;
+	size_t reg_len;
+	u8 reg[2];
+
+	reg_len = tinydrm_regmap_i80_format(i80, regnr, reg);
+
+	mutex_lock(&i80->lock);
+	tinydrm_regmap_i80_writev(i80, seq, num_seq, reg, reg_len, vec, num,
+				  async);
+	mutex_unlock(&i80->lock);
+
+	return 0;
+}
+
+static void tinydrm_regmap_i80_raw_sync(void *context)
+{
+	struct tinydrm_regmap_i80 *i80 = context;
+
+	kthread_flush_worker(i80->worker);
+}
+
+static const struct tinydrm_regmap_raw_funcs tinydrm_regmap_i80_raw_funcs = {
+	.write = tinydrm_regmap_i80_raw_write,
+	.sync = tinydrm_regmap_i80_raw_sync,
+};
+
+static void tinydrm_regmap_i80_fini_async(void *data)
+{
+	struct tinydrm_regmap_i80 *i80 = data;
+
+	kthread_destroy_worker(i80->worker);
+	kvfree(i80->bufs[0].val);
+	kvfree(i80->bufs[1].val);
+}
+
+static int tinydrm_regmap_i80_init_async(struct tinydrm_regmap_i80 *i80)
+{
+	struct device *dev = i80->dev;
+	struct kthread_worker *worker;
+	u32 cpu;
+	int i;
+
+	if (!device_property_read_u32(dev, "i80-cpu", &cpu)) {
+		if (cpu >= nr_cpu_ids || !cpu_online(cpu)) {
+			dev_err(dev, "i80-cpu %u is not online\n", cpu);
+			return -EINVAL;
+		}
+		worker = kthread_create_worker_on_cpu(cpu, 0, "%s/%u",
+						      dev_name(dev), cpu);
+	} else {
+		worker = kthread_create_worker(0, "%s", dev_name(dev));
+	}
+	if (IS_ERR(worker)) {
+		dev_err(dev, "Failed to create writer thread\n");
+		return PTR_ERR(worker);
+	}
+
+	i80->worker = worker;
+	init_waitqueue_head(&i80->wait);
+	for (i = 0; i < ARRAY_SIZE(i80->bufs); i++) {
+		kthread_init_work(&i80->bufs[i].work, tinydrm_regmap_i80_work);
+		i80->bufs[i].i80 = i80;
+	}
+
+	return devm_add_action_or_reset(dev, tinydrm_regmap_i80_fini_async,
+					i80);
+}
+
 /**
- * tinydrm_i80_init - Initialize an I80 bus regmap
+ * tinydrm_i80_init_config - Initialize an I80 bus regmap with a config
  * @dev: Device
- * @reg_width: Register width in bits (8 or 16).
+ * @config: Regmap configuration, @reg_bits and @val_bits have to be equal
+ *          and 8 or 16. Drivers can use this to set up a register cache.
  * @cs: Chip Select gpio (optional).
  * @idx: Index gpio, low writing register number and high writing value
  *       (optional).
@@ -157,36 +560,94 @@ static const struct regmap_bus tinydrm_i80_bus = {
  * This function creates a &regmap to access the register on a I80 type bus
  * connected controller.
  *
+ * Large writes, like pixel data passed to regmap_raw_write(), are copied to
+ * one of two staging buffers and clocked out by a writer thread, so the call
+ * returns before the transfer is done. Smaller writes wait for queued
+ * transfers before they go out. The thread can be pinned to a CPU with the
+ * 'i80-cpu' device property. The bus also supports
+ * tinydrm_regmap_raw_writev() and tinydrm_regmap_raw_writev_async(), the latter
+ * sends a single buffer without the copy. tinydrm_regmap_raw_sync() waits for
+ * the writer thread.
+ *
+ * The bus can't read, so a register cache needs defaults that don't have to
+ * be read from the hardware.
+ *
  * Returns I80 &regmap on success or ERR_PTR on failure.
  */
-struct regmap *tinydrm_i80_init(struct device *dev, unsigned int reg_width,
-				struct gpio_desc *cs, struct gpio_desc *idx,
-				struct gpio_desc *wr, struct gpio_descs *db)
+struct regmap *tinydrm_i80_init_config(struct device *dev,
+				       const struct regmap_config *config,
+				       struct gpio_desc *cs,
+				       struct gpio_desc *idx,
+				       struct gpio_desc *wr,
+				       struct gpio_descs *db)
 {
+	unsigned int reg_width = config->reg_bits;
 	struct tinydrm_regmap_i80 *i80;
-	struct regmap_config config = {
-		.reg_bits = reg_width,
-		.val_bits = reg_width,
-		.cache_type = REGCACHE_NONE,
-	};
+	int ret;
 
 	if ((db->ndescs != 8 && db->ndescs != 16) ||
-	    (reg_width != 8 && reg_width != 16))
+	    (reg_width != 8 && reg_width != 16) ||
+	    config->val_bits != reg_width)
 		return ERR_PTR(-EINVAL);
 
 	i80 = devm_kzalloc(dev, sizeof(*i80), GFP_KERNEL);
 	if (!i80)
 		return ERR_PTR(-ENOMEM);
 
+	i80->bus = tinydrm_i80_gpio_init(dev, wr, db);
+	if (IS_ERR(i80->bus))
+		return ERR_CAST(i80->bus);
+
 	i80->dev = dev;
 	i80->cs = cs;
 	i80->idx = idx;
-	i80->wr = wr;
-	i80->db = db;
-	i80->reg = devm_regmap_init(dev, &tinydrm_i80_bus, i80, &config);
+	i80->reg_width = reg_width;
+	mutex_init(&i80->lock);
+
+	ret = tinydrm_regmap_i80_init_async(i80);
+	if (ret)
+		return ERR_PTR(ret);
+
+	i80->reg = devm_regmap_init(dev, &tinydrm_i80_bus, i80, config);
+	if (IS_ERR(i80->reg))
+		return i80->reg;
+
+	ret = devm_tinydrm_regmap_raw_init(i80->reg,
+					   &tinydrm_regmap_i80_raw_funcs, i80);
+	if (ret)
+		return ERR_PTR(ret);
 
 	return i80->reg;
 }
+EXPORT_SYMBOL(tinydrm_i80_init_config);
+
+/**
+ * tinydrm_i80_init - Initialize an I80 bus regmap
+ * @dev: Device
+ * @reg_width: Register width in bits (8 or 16).
+ * @cs: Chip Select gpio (optional).
+ * @idx: Index gpio, low writing register number and high writing value
+ *       (optional).
+ * @wr: Write latch gpio.
+ * @db: Databus gpio array. The bus can be 8-bit wide even if the register is
+ *      16-bit.
+ *
+ * Same as tinydrm_i80_init_config() without a register cache.
+ *
+ * Returns I80 &regmap on success or ERR_PTR on failure.
+ */
+struct regmap *tinydrm_i80_init(struct device *dev, unsigned int reg_width,
+				struct gpio_desc *cs, struct gpio_desc *idx,
+				struct gpio_desc *wr, struct gpio_descs *db)
+{
+	struct regmap_config config = {
+		.reg_bits = reg_width,
+		.val_bits = reg_width,
+		.cache_type = REGCACHE_NONE,
+	};
+
+	return tinydrm_i80_init_config(dev, &config, cs, idx, wr, db);
+}
 EXPORT_SYMBOL(tinydrm_i80_init);
 
 #ifdef CONFIG_DEBUG_FS
@@ -285,6 +746,36 @@ static const struct file_operations tinydrm_regmap_debugfs_reg_fops = {
 	.write = tinydrm_regmap_debugfs_reg_write,
 };
 
+/**
+ * tinydrm_i80_debugfs_init - Create I80 regmap bus debugfs entries
+ * @reg: Regmap
+ * @parent: Parent directory
+ * @lock: Lock that serializes the users of @reg
+ * @enabled: Display pipe state, protected by @lock
+ *
+ * Creates the 'i80_throughput' benchmark of tinydrm_i80_gpio_debugfs_init()
+ * for the bus behind a regmap from tinydrm_i80_init_config(). Nothing is
+ * created for other buses. The writer thread is idle once the pipe has been
+ * disabled, since a register write through regmap waits for it.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_i80_debugfs_init(struct regmap *reg, struct dentry *parent,
+			     struct mutex *lock, const bool *enabled)
+{
+	struct tinydrm_regmap_raw *raw = tinydrm_regmap_raw_get(reg);
+	struct tinydrm_regmap_i80 *i80;
+
+	if (!raw || raw->funcs != &tinydrm_regmap_i80_raw_funcs)
+		return 0;
+
+	i80 = raw->context;
+
+	return tinydrm_i80_gpio_debugfs_init(i80->bus, parent, lock, enabled);
+}
+EXPORT_SYMBOL(tinydrm_i80_debugfs_init);
+
 int tinydrm_regmap_debugfs_init(struct regmap *reg, struct dentry *parent)
 {
 	umode_t mode = S_IFREG | S_IWUSR;
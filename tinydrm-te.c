@@ -0,0 +1,379 @@
+/*
+ * Copyright 2017 Noralf Trønnes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/gpio/consumer.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+#include <drm/drmP.h>
+#include <drm/tinydrm/tinydrm-helpers2.h>
+
+/**
+ * DOC: overview
+ *
+ * Tearing effect synchronized flushing.
+ *
+ * The controller pulses its TE output when the panel scan starts a new frame.
+ * A flush waits for the pulse and then sends the clip in bands ordered along
+ * the scan. Before a band is sent, the scan line is estimated from the time
+ * since the pulse and the measured frame period, and the band waits until the
+ * scan has passed it. The write pointer so stays behind the scan line and the
+ * new content shows up in one piece on the next frame. A writer that is slower
+ * than the scan never waits, it only has to finish before the next scan
+ * catches up, which gives it almost two frame periods.
+ *
+ * The scan line estimate ignores the porches, so the real scan is a little
+ * ahead of it, which errs on the safe side.
+ */
+
+/* Edges further apart than this are not used to measure the frame period */
+#define TINYDRM_TE_MAX_PERIOD_US	100000
+
+/* Bands shorter than this cost more in commands than they save */
+#define TINYDRM_TE_MIN_BAND		16
+
+struct tinydrm_te {
+	struct gpio_desc *gpio;
+	wait_queue_head_t wait;
+	spinlock_t lock;
+
+	/* protected by @lock */
+	ktime_t edge;
+	unsigned int period_us;
+	unsigned long edges;
+
+	/* flush side, serialized by the caller */
+	ktime_t frame;
+	unsigned long frames;
+	unsigned long timeouts;
+	unsigned int lines;
+	bool columns;
+	bool reverse;
+};
+
+static irqreturn_t tinydrm_te_irq(int irq, void *arg)
+{
+	struct tinydrm_te *te = arg;
+	ktime_t now = ktime_get();
+	s64 delta;
+
+	spin_lock(&te->lock);
+	delta = ktime_us_delta(now, te->edge);
+	if (delta > 0 && delta < TINYDRM_TE_MAX_PERIOD_US)
+		te->period_us = (te->period_us * 7 + (unsigned int)delta) / 8;
+	te->edge = now;
+	te->edges++;
+	spin_unlock(&te->lock);
+
+	wake_up_all(&te->wait);
+
+	return IRQ_HANDLED;
+}
+
+/**
+ * devm_tinydrm_te_init - Set up the tearing effect gpio
+ * @dev: Device
+ * @fps: Nominal frame rate, used until the period has been measured. Zero
+ *       means 60.
+ *
+ * Looks up the optional 'te' gpio and requests an edge interrupt on its active
+ * edge. The scan is along the framebuffer rows until tinydrm_te_set_scan() is
+ * called.
+ *
+ * Returns:
+ * &tinydrm_te on success, NULL if the device has no 'te-gpios' or ERR_PTR on
+ * failure.
+ */
+struct tinydrm_te *devm_tinydrm_te_init(struct device *dev, unsigned int fps)
+{
+	unsigned long trigger;
+	struct tinydrm_te *te;
+	struct gpio_desc *gpio;
+	int irq, ret;
+
+	gpio = devm_gpiod_get_optional(dev, "te", GPIOD_IN);
+	if (IS_ERR(gpio)) {
+		dev_err(dev, "Failed to get gpio 'te'\n");
+		return ERR_CAST(gpio);
+	}
+
+	if (!gpio)
+		return NULL;
+
+	te = devm_kzalloc(dev, sizeof(*te), GFP_KERNEL);
+	if (!te)
+		return ERR_PTR(-ENOMEM);
+
+	te->gpio = gpio;
+	te->period_us = USEC_PER_SEC / (fps ? fps : 60);
+	te->edge = ktime_get();
+	te->frame = te->edge;
+	init_waitqueue_head(&te->wait);
+	spin_lock_init(&te->lock);
+
+	irq = gpiod_to_irq(gpio);
+	if (irq < 0) {
+		dev_err(dev, "gpio 'te' has no interrupt\n");
+		return ERR_PTR(irq);
+	}
+
+	trigger = gpiod_is_active_low(gpio) ? IRQF_TRIGGER_FALLING :
+					      IRQF_TRIGGER_RISING;
+	ret = devm_request_irq(dev, irq, tinydrm_te_irq, trigger,
+			       dev_name(dev), te);
+	if (ret) {
+		dev_err(dev, "Failed to request TE interrupt %d\n", ret);
+		return ERR_PTR(ret);
+	}
+
+	return te;
+}
+EXPORT_SYMBOL(devm_tinydrm_te_init);
+
+/**
+ * tinydrm_te_set_scan - Describe how the panel scan maps to the framebuffer
+ * @te: Tearing effect
+ * @lines: Number of scan lines, the framebuffer width or height
+ * @columns: The scan moves along the framebuffer columns (rotated panel)
+ * @reverse: The scan starts at the last row or column
+ *
+ * The caller is responsible for serializing this with flushing.
+ */
+void tinydrm_te_set_scan(struct tinydrm_te *te, unsigned int lines,
+			 bool columns, bool reverse)
+{
+	te->lines = lines;
+	te->columns = columns;
+	te->reverse = reverse;
+}
+EXPORT_SYMBOL(tinydrm_te_set_scan);
+
+/**
+ * tinydrm_te_wait - Wait for the start of the next panel frame
+ * @te: Tearing effect
+ *
+ * Waits for the next TE edge and makes it the frame that tinydrm_te_wait_band()
+ * paces against. If no edge arrives within two frame periods, the frame is
+ * assumed to start now.
+ *
+ * Returns:
+ * Zero on success, -ETIMEDOUT if the TE signal is missing.
+ */
+int tinydrm_te_wait(struct tinydrm_te *te)
+{
+	unsigned long edges, timeout;
+	long ret;
+
+	spin_lock_irq(&te->lock);
+	edges = te->edges;
+	timeout = usecs_to_jiffies(2 * te->period_us) + 1;
+	spin_unlock_irq(&te->lock);
+
+	ret = wait_event_timeout(te->wait, READ_ONCE(te->edges) != edges,
+				 timeout);
+
+	spin_lock_irq(&te->lock);
+	te->frame = ret ? te->edge : ktime_get();
+	spin_unlock_irq(&te->lock);
+
+	te->frames++;
+	if (!ret) {
+		te->timeouts++;
+		return -ETIMEDOUT;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(tinydrm_te_wait);
+
+/**
+ * tinydrm_te_timestamp - Start of the last frame a flush was synchronized to
+ * @te: Tearing effect
+ *
+ * The content sent by a flush is shown from the frame after this one, so this
+ * plus the frame period is the vblank-like timestamp of the flush.
+ */
+ktime_t tinydrm_te_timestamp(struct tinydrm_te *te)
+{
+	return te->frame;
+}
+EXPORT_SYMBOL(tinydrm_te_timestamp);
+
+/**
+ * tinydrm_te_edge - Time of the last TE edge
+ * @te: Tearing effect
+ *
+ * Can be called from any context.
+ */
+ktime_t tinydrm_te_edge(struct tinydrm_te *te)
+{
+	unsigned long flags;
+	ktime_t edge;
+
+	spin_lock_irqsave(&te->lock, flags);
+	edge = te->edge;
+	spin_unlock_irqrestore(&te->lock, flags);
+
+	return edge;
+}
+EXPORT_SYMBOL(tinydrm_te_edge);
+
+/**
+ * tinydrm_te_period_us - Measured frame period
+ * @te: Tearing effect
+ */
+unsigned int tinydrm_te_period_us(struct tinydrm_te *te)
+{
+	return READ_ONCE(te->period_us);
+}
+EXPORT_SYMBOL(tinydrm_te_period_us);
+
+/**
+ * tinydrm_te_split - Split a clip into bands in scan order
+ * @te: Tearing effect
+ * @clip: Clip rectangle
+ * @bands: Array of %TINYDRM_TE_BANDS rectangles to fill in
+ *
+ * Returns:
+ * Number of bands.
+ */
+unsigned int tinydrm_te_split(struct tinydrm_te *te,
+			      const struct drm_clip_rect *clip,
+			      struct drm_clip_rect *bands)
+{
+	unsigned int lo = te->columns ? clip->x1 : clip->y1;
+	unsigned int hi = te->columns ? clip->x2 : clip->y2;
+	unsigned int size, start, end, i, num = 0;
+
+	size = max_t(unsigned int, DIV_ROUND_UP(te->lines, TINYDRM_TE_BANDS),
+		     TINYDRM_TE_MIN_BAND);
+
+	for (start = lo; start < hi && num < TINYDRM_TE_BANDS; start = end) {
+		end = num == TINYDRM_TE_BANDS - 1 ? hi : min(start + size, hi);
+		bands[num] = *clip;
+		if (te->columns) {
+			bands[num].x1 = start;
+			bands[num].x2 = end;
+		} else {
+			bands[num].y1 = start;
+			bands[num].y2 = end;
+		}
+		num++;
+	}
+
+	if (te->reverse)
+		for (i = 0; i < num / 2; i++)
+			swap(bands[i], bands[num - 1 - i]);
+
+	return num;
+}
+EXPORT_SYMBOL(tinydrm_te_split);
+
+/**
+ * tinydrm_te_wait_band - Wait until the scan has passed a band
+ * @te: Tearing effect
+ * @band: Band from tinydrm_te_split()
+ *
+ * Sleeps until the scan of the frame from tinydrm_te_wait() is estimated to
+ * have passed the last line of @band.
+ */
+void tinydrm_te_wait_band(struct tinydrm_te *te,
+			  const struct drm_clip_rect *band)
+{
+	unsigned int last;
+	ktime_t expires;
+
+	if (!te->lines)
+		return;
+
+	if (te->columns)
+		last = te->reverse ? te->lines - band->x1 : band->x2;
+	else
+		last = te->reverse ? te->lines - band->y1 : band->y2;
+
+	expires = ktime_add_us(te->frame,
+			       div_u64((u64)last * tinydrm_te_period_us(te),
+				       te->lines));
+	if (ktime_before(ktime_get(), expires)) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	}
+}
+EXPORT_SYMBOL(tinydrm_te_wait_band);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int tinydrm_te_debugfs_show(struct seq_file *m, void *d)
+{
+	struct tinydrm_te *te = m->private;
+	unsigned int period_us = tinydrm_te_period_us(te);
+
+	seq_printf(m, "period: %u us\n", period_us);
+	seq_printf(m, "rate: %u mHz\n",
+		   period_us ? (u32)div_u64(1000ULL * USEC_PER_SEC, period_us) :
+			       0);
+	seq_printf(m, "edges: %lu\n", READ_ONCE(te->edges));
+	seq_printf(m, "frames: %lu\n", te->frames);
+	seq_printf(m, "timeouts: %lu\n", te->timeouts);
+	seq_printf(m, "last frame: %lld us\n", ktime_to_us(te->frame));
+	seq_printf(m, "scan: %u %s%s\n", te->lines,
+		   te->columns ? "columns" : "rows",
+		   te->reverse ? " reversed" : "");
+
+	return 0;
+}
+
+static int tinydrm_te_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tinydrm_te_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations tinydrm_te_debugfs_fops = {
+	.owner = THIS_MODULE,
+	.open = tinydrm_te_debugfs_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * tinydrm_te_debugfs_init - Create tearing effect debugfs entry
+ * @te: Tearing effect, can be NULL
+ * @parent: Parent directory
+ *
+ * Creates a 'te' file that shows the measured frame period and the flush
+ * counters. Nothing is created if @te is NULL.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int tinydrm_te_debugfs_init(struct tinydrm_te *te, struct dentry *parent)
+{
+	struct dentry *dentry;
+
+	if (!te)
+		return 0;
+
+	dentry = debugfs_create_file("te", S_IRUGO, parent, te,
+				     &tinydrm_te_debugfs_fops);
+
+	return dentry ? 0 : -ENOMEM;
+}
+EXPORT_SYMBOL(tinydrm_te_debugfs_init);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Copyright 2017 Noralf Trønnes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/device.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/property.h>
+#include <linux/spinlock.h>
+
+#include <drm/drmP.h>
+#include <drm/drm_simple_kms_helper.h>
+#include <drm/tinydrm/tinydrm.h>
+#include <drm/tinydrm/tinydrm-helpers2.h>
+
+/**
+ * DOC: overview
+ *
+ * Emulated vblank.
+ *
+ * The controllers have no scanout interrupt, so an hrtimer stands in for one.
+ * It ticks at the configured frame rate or, with a TE gpio, at the measured
+ * panel frame rate and in phase with the TE edges.
+ *
+ * tinydrm_vblank_pipe_update() flushes the new framebuffer and arms the
+ * page-flip event for the next tick. The flush is synchronous, so the event,
+ * and the atomic out-fence that signals with it, are never delivered before
+ * the last transfer of the frame has completed. Compositors can pace to the
+ * events instead of guessing how long a flush takes. Drivers whose bus hands
+ * the transfer to a writer thread wait for it in their own update function
+ * and arm the event with tinydrm_vblank_pipe_event().
+ *
+ * drm_atomic_helper_wait_for_vblanks() gives up after 50 ms, rounded to
+ * jiffies. The timer runs at the panel rate however slow, but from a period of
+ * %TINYDRM_VBLANK_SLOW_US, which leaves room for the rounding and the flush,
+ * the timer is pulled in to tick %TINYDRM_VBLANK_SOON_US after vblank is
+ * turned on and after each flush has completed. The commit waiting for a
+ * vblank then gets one as soon as its content is on the panel, and the
+ * regular ticks continue from there.
+ *
+ * The timer is only armed under &tinydrm_vblank->lock and the callback
+ * doesn't touch its expiry if it was re-armed while the callback ran.
+ */
+
+#define TINYDRM_VBLANK_SLOW_US		40000
+#define TINYDRM_VBLANK_SOON_US		1000
+
+struct tinydrm_vblank {
+	struct hrtimer timer;
+	struct drm_crtc *crtc;
+	struct tinydrm_te *te;
+	unsigned int period_us;
+	/* serializes arming the timer with the callback */
+	spinlock_t lock;
+	bool enabled;
+};
+
+static unsigned int tinydrm_vblank_period_us(struct tinydrm_vblank *vbl)
+{
+	return vbl->te ? tinydrm_te_period_us(vbl->te) : vbl->period_us;
+}
+
+/* Too slow for drm_atomic_helper_wait_for_vblanks() to see a tick */
+static bool tinydrm_vblank_slow(struct tinydrm_vblank *vbl)
+{
+	return tinydrm_vblank_period_us(vbl) >= TINYDRM_VBLANK_SLOW_US;
+}
+
+static ktime_t tinydrm_vblank_next(struct tinydrm_vblank *vbl, ktime_t last)
+{
+	u64 period_ns, periods = 1;
+	ktime_t min;
+
+	/* Stay in phase with the panel */
+	if (vbl->te)
+		last = tinydrm_te_edge(vbl->te);
+
+	/* Leave at least half a period so a late tick isn't doubled */
+	period_ns = (u64)tinydrm_vblank_period_us(vbl) * NSEC_PER_USEC;
+	min = ktime_add_ns(ktime_get(), period_ns / 2);
+	if (ktime_after(min, last))
+		periods += div64_u64(ktime_to_ns(ktime_sub(min, last)),
+				     period_ns);
+
+	return ktime_add_ns(last, periods * period_ns);
+}
+
+static enum hrtimer_restart tinydrm_vblank_timer(struct hrtimer *timer)
+{
+	struct tinydrm_vblank *vbl = container_of(timer, struct tinydrm_vblank,
+						  timer);
+	enum hrtimer_restart ret = HRTIMER_NORESTART;
+	unsigned long flags;
+
+	if (!READ_ONCE(vbl->enabled))
+		return HRTIMER_NORESTART;
+
+	drm_crtc_handle_vblank(vbl->crtc);
+
+	/* Leave a timer that was re-armed meanwhile alone */
+	spin_lock_irqsave(&vbl->lock, flags);
+	if (vbl->enabled && !hrtimer_is_queued(timer)) {
+		hrtimer_set_expires(timer, tinydrm_vblank_next(vbl,
+						hrtimer_get_expires(timer)));
+		ret = HRTIMER_RESTART;
+	}
+	spin_unlock_irqrestore(&vbl->lock, flags);
+
+	return ret;
+}
+
+static void tinydrm_vblank_arm(struct tinydrm_vblank *vbl, ktime_t expires)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&vbl->lock, flags);
+	if (vbl->enabled)
+		hrtimer_start(&vbl->timer, expires, HRTIMER_MODE_ABS);
+	spin_unlock_irqrestore(&vbl->lock, flags);
+}
+
+static void tinydrm_vblank_release(struct device *dev, void *res)
+{
+	struct tinydrm_vblank *vbl = res;
+
+	WRITE_ONCE(vbl->enabled, false);
+	hrtimer_cancel(&vbl->timer);
+}
+
+static struct tinydrm_vblank *tinydrm_vblank_get(struct drm_device *drm)
+{
+	return devres_find(drm->dev, tinydrm_vblank_release, NULL, NULL);
+}
+
+/**
+ * devm_tinydrm_vblank_init - Set up emulated vblank
+ * @tdev: tinydrm device
+ * @fps: Driver default frame rate, zero means 60
+ * @te: Tearing effect to follow, can be NULL
+ *
+ * Call this after the display pipe is initialized and before
+ * devm_tinydrm_register(). The driver uses tinydrm_vblank_enable() and
+ * tinydrm_vblank_disable() as its &drm_driver vblank callbacks,
+ * tinydrm_vblank_pipe_update() or an update function ending in
+ * tinydrm_vblank_pipe_event() as &drm_simple_display_pipe_funcs->update and
+ * turns vblank on and off with the pipe. The 'fps' device property overrides
+ * @fps.
+ *
+ * Returns:
+ * Zero on success, negative error code on failure.
+ */
+int devm_tinydrm_vblank_init(struct tinydrm_device *tdev, unsigned int fps,
+			     struct tinydrm_te *te)
+{
+	struct drm_device *drm = tdev->drm;
+	struct device *dev = drm->dev;
+	struct tinydrm_vblank *vbl;
+	int ret;
+
+	vbl = devres_alloc(tinydrm_vblank_release, sizeof(*vbl), GFP_KERNEL);
+	if (!vbl)
+		return -ENOMEM;
+
+	device_property_read_u32(dev, "fps", &fps);
+	if (!fps)
+		fps = 60;
+
+	vbl->period_us = USEC_PER_SEC / fps;
+	vbl->crtc = &tdev->pipe.crtc;
+	vbl->te = te;
+	spin_lock_init(&vbl->lock);
+	hrtimer_init(&vbl->timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	vbl->timer.function = tinydrm_vblank_timer;
+
+	ret = drm_vblank_init(drm, 1);
+	if (ret) {
+		devres_free(vbl);
+		return ret;
+	}
+
+	/* drm_wait_vblank_ioctl() wants an interrupt handler */
+	drm->irq_enabled = true;
+
+	devres_add(dev, vbl);
+
+	DRM_DEBUG_DRIVER("Emulated vblank every %u us%s\n", vbl->period_us,
+			 te ? ", following TE" : "");
+
+	return 0;
+}
+EXPORT_SYMBOL(devm_tinydrm_vblank_init);
+
+/**
+ * tinydrm_vblank_enable - Start the vblank timer
+ * @drm: DRM device
+ * @pipe: CRTC index
+ *
+ * &drm_driver->enable_vblank callback.
+ *
+ * Returns:
+ * Zero on success, -EINVAL if devm_tinydrm_vblank_init() hasn't been called.
+ */
+int tinydrm_vblank_enable(struct drm_device *drm, unsigned int pipe)
+{
+	struct tinydrm_vblank *vbl = tinydrm_vblank_get(drm);
+	unsigned long flags;
+	ktime_t expires;
+
+	if (!vbl)
+		return -EINVAL;
+
+	if (tinydrm_vblank_slow(vbl))
+		expires = ktime_add_us(ktime_get(), TINYDRM_VBLANK_SOON_US);
+	else
+		expires = tinydrm_vblank_next(vbl, ktime_get());
+
+	spin_lock_irqsave(&vbl->lock, flags);
+	WRITE_ONCE(vbl->enabled, true);
+	spin_unlock_irqrestore(&vbl->lock, flags);
+
+	tinydrm_vblank_arm(vbl, expires);
+
+	return 0;
+}
+EXPORT_SYMBOL(tinydrm_vblank_enable);
+
+/**
+ * tinydrm_vblank_disable - Stop the vblank timer
+ * @drm: DRM device
+ * @pipe: CRTC index
+ *
+ * &drm_driver->disable_vblank callback. This runs under the vblank spinlocks
+ * that the timer callback also takes, so the timer is not waited for, it
+ * stops itself on the next tick.
+ */
+void tinydrm_vblank_disable(struct drm_device *drm, unsigned int pipe)
+{
+	struct tinydrm_vblank *vbl = tinydrm_vblank_get(drm);
+	unsigned long flags;
+
+	if (!vbl)
+		return;
+
+	spin_lock_irqsave(&vbl->lock, flags);
+	WRITE_ONCE(vbl->enabled, false);
+	hrtimer_try_to_cancel(&vbl->timer);
+	spin_unlock_irqrestore(&vbl->lock, flags);
+}
+EXPORT_SYMBOL(tinydrm_vblank_disable);
+
+/**
+ * tinydrm_vblank_pipe_event - Arm the page-flip event of a completed flush
+ * @pipe: Simple display pipe
+ *
+ * The event half of tinydrm_vblank_pipe_update() for drivers whose flush can
+ * return before the last transfer has completed. They wait for the transfer
+ * in their own update function and then call this.
+ */
+void tinydrm_vblank_pipe_event(struct drm_simple_display_pipe *pipe)
+{
+	struct drm_crtc *crtc = &pipe->crtc;
+	struct drm_pending_vblank_event *event = crtc->state->event;
+	struct tinydrm_vblank *vbl = tinydrm_vblank_get(crtc->dev);
+
+	if (event) {
+		crtc->state->event = NULL;
+
+		spin_lock_irq(&crtc->dev->event_lock);
+		if (crtc->state->active && drm_crtc_vblank_get(crtc) == 0)
+			drm_crtc_arm_vblank_event(crtc, event);
+		else
+			drm_crtc_send_vblank_event(crtc, event);
+		spin_unlock_irq(&crtc->dev->event_lock);
+	}
+
+	/* The flush has completed, don't keep a commit waiting for the tick */
+	if (vbl && tinydrm_vblank_slow(vbl))
+		tinydrm_vblank_arm(vbl, ktime_add_us(ktime_get(),
+						     TINYDRM_VBLANK_SOON_US));
+}
+EXPORT_SYMBOL(tinydrm_vblank_pipe_event);
+
+/**
+ * tinydrm_vblank_pipe_update - Display pipe update helper with vblank events
+ * @pipe: Simple display pipe
+ * @old_state: Old plane state
+ *
+ * Like tinydrm_display_pipe_update(), but the page-flip event is sent on the
+ * first vblank after the flush has completed instead of right away. With a
+ * period longer than drm_atomic_helper_wait_for_vblanks() waits, that vblank
+ * comes right after the flush. The flush has to be synchronous.
+ */
+void tinydrm_vblank_pipe_update(struct drm_simple_display_pipe *pipe,
+				struct drm_plane_state *old_state)
+{
+	struct drm_framebuffer *fb = pipe->plane.state->fb;
+
+	if (fb && (fb != old_state->fb)) {
+		pipe->plane.fb = fb;
+		if (fb->funcs->dirty)
+			fb->funcs->dirty(fb, NULL, 0, 0, NULL, 0);
+	}
+
+	tinydrm_vblank_pipe_event(pipe);
+}
+EXPORT_SYMBOL(tinydrm_vblank_pipe_update);